@@ -1,5 +1,13 @@
 C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe shader.vert -o vert.spv
 C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe shader.frag -o frag.spv
 C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe shader_offscreen.vert -o vert_offscreen.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe -DMULTIVIEW shader_offscreen.vert -o vert_offscreen_multiview.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe -DLAYERED shader_offscreen.vert -o vert_offscreen_layered.spv
 C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe shader_offscreen.frag -o frag_offscreen.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe -DLIT shader_offscreen.frag -o frag_offscreen_lit.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe cull.comp -o cull.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe lights.comp -o lights.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe particles.comp -o particles.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe particle.vert -o vert_particle.spv
+C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe particle.frag -o frag_particle.spv
 pause
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragOffset;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // round and soft, the corners of the quad add nothing
+    float falloff = max(1.0 - dot(fragOffset, fragOffset), 0.0);
+    outColor = fragColor * falloff;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// one quad per instance, built from the particle the compute pass wrote
+struct Particle {
+    vec2 position;
+    vec2 velocity;
+    float age;
+    float lifetime;
+    uint color;
+    float size;
+};
+
+layout(std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+
+// camera of the first offscreen view, scale in xy and offset in zw
+layout(push_constant) uniform PushConstants {
+    vec4 view;
+} pushConstants;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragOffset;
+
+vec2[] corners = {
+     vec2(-1.0, -1.0),
+     vec2(1.0, -1.0),
+     vec2(1.0, 1.0),
+     vec2(1.0, 1.0),
+     vec2(-1.0, 1.0),
+     vec2(-1.0, -1.0)
+};
+
+void main() {
+     Particle particle = particles[gl_InstanceIndex];
+     vec2 corner = corners[gl_VertexIndex];
+
+     vec2 position = particle.position + corner * particle.size;
+     gl_Position = vec4(position * pushConstants.view.xy + pushConstants.view.zw, 0.0, 1.0);
+
+     // fades out over its life, the blending adds it to what is already there
+     fragColor = unpackUnorm4x8(particle.color) * (1.0 - particle.age / particle.lifetime);
+     fragOffset = corner;
+}
\ No newline at end of file
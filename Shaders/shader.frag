@@ -1,13 +1,53 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout (binding = 0) uniform sampler2D samplerColor;
+// one layer per offscreen view
+layout (binding = 0) uniform sampler2DArray samplerColor;
 
 layout (location = 1) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragColor;
 
+// specialization constant, the branch is folded away when the pipeline is built
+layout(constant_id = 0) const bool TONEMAP = false;
+layout(constant_id = 1) const int VIEW_COUNT = 1;
+
+layout(push_constant) uniform PushConstants {
+     vec2 uvScale;
+     // rendered area of level 0 in texels
+     vec2 renderExtent;
+} pushConstants;
+
+// the mips only downsample the rendered area, halved and rounded down like the level sizes
+vec4 sampleLevel(vec2 uv, float layer, float level)
+{
+  vec2 levelExtent = max(floor(pushConstants.renderExtent / exp2(level)), vec2(1.0));
+  vec2 levelSize = vec2(textureSize(samplerColor, int(level)).xy);
+
+  // half a texel inside, the linear filter must not reach outside of the rendered area
+  uv = clamp(uv, 0.5 / levelSize, (levelExtent - 0.5) / levelSize);
+  return textureLod(samplerColor, vec3(uv, layer), level);
+}
+
 void main() 
 {
-  outFragColor = texture(samplerColor, inUV);
+  // the views sit side by side, each one fills a column of the quad
+  float column = inUV.x / pushConstants.uvScale.x * float(VIEW_COUNT);
+  float layer = min(floor(column), float(VIEW_COUNT - 1));
+  vec2 uv = vec2((column - layer) * pushConstants.uvScale.x, inUV.y);
+
+  // trilinear by hand, each level is clamped to its own rendered area. The raw LOD goes past
+  // the levels the image has, below 0 when magnified and past the last one when minified
+  float lastLevel = float(textureQueryLevels(samplerColor) - 1);
+  float lod = clamp(textureQueryLod(samplerColor, uv).y, 0.0, lastLevel);
+  float level = floor(lod);
+  outFragColor = sampleLevel(uv, layer, level);
+  if (lod > level && level < lastLevel) {
+    outFragColor = mix(outFragColor, sampleLevel(uv, layer, level + 1.0), lod - level);
+  }
+  if (TONEMAP) {
+    // ACES filmic curve fit
+    vec3 x = outFragColor.rgb;
+    outFragColor.rgb = clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+  }
 }
\ No newline at end of file
@@ -7,6 +7,12 @@ layout(location = 1) in vec3 inColor;
 
 layout (location = 1) out vec2 tex;
 
+// part of the offscreen image covered by the current render area
+layout(push_constant) uniform PushConstants {
+     vec2 uvScale;
+     vec2 renderExtent;
+} pushConstants;
+
 vec2[] texCoord = {
      vec2(0.0, 0.0),
      vec2(0.0, 1.0),
@@ -17,5 +23,5 @@ vec2[] texCoord = {
 void main() 
 {
      gl_Position = vec4(inPosition, 0.0, 1.0);
-     tex = texCoord[gl_VertexIndex];
+     tex = texCoord[gl_VertexIndex] * pushConstants.uvScale;
 }
\ No newline at end of file
@@ -1,10 +1,79 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// compiled twice: plain, and -DLIT adding the point lights of set 1
+
+// streamed textures, the size has to match TextureStreamerSettings::maxTextures
+layout(binding = 0) uniform sampler2D textures[64];
+
+// specialization constant, off while the scene has no texture so nothing is sampled
+layout(constant_id = 0) const bool TEXTURED = true;
+
+#if defined(LIT)
+// specialization constant, off loops over every light instead of the ones of the tile
+layout(constant_id = 1) const bool TILED_LIGHTS = true;
+
+// LightCulling::tileSize and tileStride
+const uint tileSize = 16;
+const uint tileStride = 64;
+const float ambient = 0.15;
+
+struct Light {
+    vec2 position;
+    float radius;
+    float intensity;
+    vec4 color;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Lights { Light lights[]; };
+// per tile the light count, then the index of every light reaching it
+layout(std430, set = 1, binding = 1) readonly buffer Tiles { uint tileLights[]; };
+#endif
+
+// same block as the vertex shader, the views come first
+layout(push_constant) uniform PushConstants {
+    vec4 views[4];
+    uint textureIndex;
+    uint viewCount;
+    uint tileCountX;
+    uint lightCount;
+} pushConstants;
+
 layout(location = 0) in vec3 vertexColor;
+layout(location = 1) in vec2 texCoord;
+layout(location = 2) in vec2 scenePosition;
 
 layout(location = 0) out vec4 outColor;
 
+#if defined(LIT)
+// falls off to nothing at the radius
+vec3 Shade(Light light) {
+    float attenuation = max(1.0 - length(scenePosition - light.position) / light.radius, 0.0);
+    return light.color.rgb * light.intensity * attenuation * attenuation;
+}
+#endif
+
 void main() {
     outColor = vec4(vertexColor, 1.0);
+    if (TEXTURED) {
+        outColor *= texture(textures[pushConstants.textureIndex], texCoord);
+    }
+
+#if defined(LIT)
+    vec3 lighting = vec3(ambient);
+    if (TILED_LIGHTS) {
+        uvec2 tile = uvec2(gl_FragCoord.xy) / tileSize;
+        uint first = (tile.y * pushConstants.tileCountX + tile.x) * tileStride;
+        uint count = tileLights[first];
+        for (uint i = 0; i < count; i++) {
+            lighting += Shade(lights[tileLights[first + 1 + i]]);
+        }
+    }
+    else {
+        for (uint i = 0; i < pushConstants.lightCount; i++) {
+            lighting += Shade(lights[i]);
+        }
+    }
+    outColor.rgb *= lighting;
+#endif
 }
\ No newline at end of file
@@ -1,12 +1,54 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// compiled three times: plain for a single view, -DMULTIVIEW broadcasting every draw to all the
+// views, -DLAYERED drawing one instance per view into its own layer
+#if defined(MULTIVIEW)
+#extension GL_EXT_multiview : enable
+#elif defined(LAYERED)
+#extension GL_ARB_shader_viewport_layer_array : enable
+#endif
+
 layout(location = 0) in vec2 inPosition;
-layout(location = 1) in vec3 inColor;
+layout(location = 1) in vec4 inColor;
+// per instance, where the object sits: scale in xy and offset in zw
+layout(location = 2) in vec4 inObject;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+// scene coordinates before the camera, the lights are placed in them
+layout(location = 2) out vec2 fragScenePosition;
+
+// camera of every view, scale in xy and offset in zw. The size has to match ViewportToTexture::maxViews
+layout(push_constant) uniform PushConstants {
+    vec4 views[4];
+    uint textureIndex;
+    uint viewCount;
+    uint tileCountX;
+    uint lightCount;
+} pushConstants;
+
+vec2[] texCoord = {
+     vec2(0.0, 0.0),
+     vec2(0.0, 1.0),
+     vec2(1.0, 1.0),
+     vec2(1.0, 0.0)
+};
 
 void main() {
-     gl_Position = vec4(inPosition, 0.0, 1.0);
-     fragColor = vec3(inColor);
+#if defined(MULTIVIEW)
+     vec4 view = pushConstants.views[gl_ViewIndex];
+#elif defined(LAYERED)
+     // every object draws one instance per view, they start at a multiple of the view count
+     uint viewIndex = uint(gl_InstanceIndex) % pushConstants.viewCount;
+     vec4 view = pushConstants.views[viewIndex];
+     gl_Layer = int(viewIndex);
+#else
+     vec4 view = pushConstants.views[0];
+#endif
+     vec2 position = inPosition * inObject.xy + inObject.zw;
+     gl_Position = vec4(position * view.xy + view.zw, 0.0, 1.0);
+     fragColor = inColor.rgb;
+     fragTexCoord = texCoord[gl_VertexIndex];
+     fragScenePosition = position;
 }
\ No newline at end of file
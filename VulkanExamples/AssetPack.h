@@ -0,0 +1,271 @@
+/*
+	single file archive of the shaders and textures, memory mapped once at startup.
+
+	Assets are handed out as spans into the mapping: shader code goes straight into
+	VkShaderModuleCreateInfo and texture levels straight into the staging buffer, nothing is
+	read into a heap buffer first. Entries are named by the path the program would otherwise
+	open, so anything missing from the pack still loads from disk.
+
+	Layout, little endian:
+		header		"VKAP", version, entry count, 0
+		entries		data offset (u64), size (u64), name offset (u32), name length (u32)
+		names		entry names, not null terminated
+		data		every entry starts on a 16 byte boundary, enough for SPIR-V and any texel block
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ByteSpan.h"
+
+class AssetPack {
+public:
+	static const uint32_t version = 1;
+	static const size_t headerSize = 16;
+	static const size_t entrySize = 24;
+	static const size_t dataAlignment = 16;
+
+	ByteSpan file;
+	std::unordered_map<std::string, ByteSpan> entries;
+
+#ifdef _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = nullptr;
+#endif
+
+	AssetPack() = default;
+	AssetPack(const AssetPack&) = delete;
+	AssetPack& operator=(const AssetPack&) = delete;
+	~AssetPack() {
+		Close();
+	}
+
+	// maps the pack and reads its index, false when the file is missing or malformed
+	bool Open(const std::string& path) {
+		Close();
+
+		if (!Map(path)) {
+			std::cout << "asset pack: can't map " << path << std::endl;
+			return false;
+		}
+
+		if (!ReadIndex()) {
+			std::cout << "asset pack: " << path << " is not a valid pack" << std::endl;
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool IsOpen() const {
+		return file.data != nullptr;
+	}
+
+	// empty span when the pack doesn't have the asset. Valid as long as the pack is open
+	ByteSpan Find(const std::string& name) const {
+		auto entry = entries.find(name);
+		return entry != entries.end() ? entry->second : ByteSpan{};
+	}
+
+	void Close() {
+		entries.clear();
+		if (!file.data) {
+			return;
+		}
+
+#ifdef _WIN32
+		UnmapViewOfFile(file.data);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		munmap(const_cast<uint8_t*>(file.data), file.size);
+#endif
+		file = ByteSpan{};
+	}
+
+	/*
+		writes a pack with the given files, each one named by its path. Used by the --build-pack
+		option, the files are only read here so it doesn't need to be fast
+	*/
+	static bool Write(const std::string& outputPath, const std::vector<std::string>& paths) {
+		std::vector<std::vector<char>> contents(paths.size());
+		for (size_t i = 0; i < paths.size(); i++) {
+			std::ifstream input(paths[i], std::ios::ate | std::ios::binary);
+			if (!input.is_open()) {
+				std::cout << "asset pack: can't read " << paths[i] << std::endl;
+				return false;
+			}
+
+			contents[i].resize(static_cast<size_t>(input.tellg()));
+			input.seekg(0);
+			input.read(contents[i].data(), contents[i].size());
+		}
+
+		size_t namesOffset = headerSize + entrySize * paths.size();
+		size_t dataOffset = namesOffset;
+		for (const std::string& path : paths) {
+			dataOffset += path.size();
+		}
+
+		std::vector<uint8_t> index(namesOffset);
+		std::string names;
+
+		auto write32 = [&index](size_t offset, uint32_t value) {
+			for (int i = 0; i < 4; i++) {
+				index[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+			}
+		};
+		auto write64 = [&write32](size_t offset, uint64_t value) {
+			write32(offset, static_cast<uint32_t>(value));
+			write32(offset + 4, static_cast<uint32_t>(value >> 32));
+		};
+
+		std::memcpy(index.data(), "VKAP", 4);
+		write32(4, version);
+		write32(8, static_cast<uint32_t>(paths.size()));
+		write32(12, 0);
+
+		std::vector<size_t> offsets(paths.size());
+		for (size_t i = 0; i < paths.size(); i++) {
+			dataOffset = (dataOffset + dataAlignment - 1) / dataAlignment * dataAlignment;
+			offsets[i] = dataOffset;
+
+			size_t entry = headerSize + entrySize * i;
+			write64(entry, dataOffset);
+			write64(entry + 8, contents[i].size());
+			write32(entry + 16, static_cast<uint32_t>(namesOffset + names.size()));
+			write32(entry + 20, static_cast<uint32_t>(paths[i].size()));
+
+			names += paths[i];
+			dataOffset += contents[i].size();
+		}
+
+		std::ofstream output(outputPath, std::ios::binary);
+		if (!output.is_open()) {
+			std::cout << "asset pack: can't write " << outputPath << std::endl;
+			return false;
+		}
+
+		output.write(reinterpret_cast<const char*>(index.data()), index.size());
+		output.write(names.data(), names.size());
+
+		size_t position = namesOffset + names.size();
+		for (size_t i = 0; i < paths.size(); i++) {
+			std::vector<char> padding(offsets[i] - position, 0);
+			output.write(padding.data(), padding.size());
+			output.write(contents[i].data(), contents[i].size());
+			position = offsets[i] + contents[i].size();
+		}
+
+		return static_cast<bool>(output);
+	}
+
+private:
+	bool Map(const std::string& path) {
+#ifdef _WIN32
+		fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0) {
+			CloseHandle(fileHandle);
+			fileHandle = INVALID_HANDLE_VALUE;
+			return false;
+		}
+
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* mapped = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!mapped) {
+			if (mappingHandle) {
+				CloseHandle(mappingHandle);
+			}
+			CloseHandle(fileHandle);
+			mappingHandle = nullptr;
+			fileHandle = INVALID_HANDLE_VALUE;
+			return false;
+		}
+
+		file = ByteSpan{ static_cast<const uint8_t*>(mapped), static_cast<size_t>(size.QuadPart) };
+#else
+		int descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			return false;
+		}
+
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+			close(descriptor);
+			return false;
+		}
+
+		// the mapping keeps the file alive
+		void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		close(descriptor);
+		if (mapped == MAP_FAILED) {
+			return false;
+		}
+
+		file = ByteSpan{ static_cast<const uint8_t*>(mapped), static_cast<size_t>(status.st_size) };
+#endif
+		return true;
+	}
+
+	static uint32_t Read32(const uint8_t* bytes) {
+		return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+	}
+
+	static uint64_t Read64(const uint8_t* bytes) {
+		return Read32(bytes) | (static_cast<uint64_t>(Read32(bytes + 4)) << 32);
+	}
+
+	bool ReadIndex() {
+		if (file.size < headerSize || std::memcmp(file.data, "VKAP", 4) != 0 || Read32(file.data + 4) != version) {
+			return false;
+		}
+
+		uint32_t entryCount = Read32(file.data + 8);
+		if (entryCount > (file.size - headerSize) / entrySize) {
+			return false;
+		}
+
+		for (uint32_t i = 0; i < entryCount; i++) {
+			const uint8_t* entry = file.data + headerSize + entrySize * i;
+
+			ByteSpan data = file.Sub(static_cast<size_t>(Read64(entry)), static_cast<size_t>(Read64(entry + 8)));
+			ByteSpan name = file.Sub(Read32(entry + 16), Read32(entry + 20));
+			if ((data.Empty() && Read64(entry + 8) != 0) || name.Empty()) {
+				return false;
+			}
+
+			entries[std::string(reinterpret_cast<const char*>(name.data), name.size)] = data;
+		}
+
+		return true;
+	}
+};
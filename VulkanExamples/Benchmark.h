@@ -0,0 +1,409 @@
+/*
+	runs the example for a fixed amount of frames per configuration and prints the averages,
+	so the cost of a feature can be compared on the same machine
+*/
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+#include "ViewportToTexture.cpp"
+
+struct BenchmarkResult {
+	std::string name;
+	double cpuFrameMs = 0.0;
+	double gpuFrameMs = 0.0;
+	double gpuOffscreenMs = 0.0;
+	double gpuPresentMs = 0.0;
+	double gpuParticlesMs = 0.0;
+	double gpuLightsMs = 0.0;
+	uint32_t commandBuffersRecorded = 0;
+};
+
+static const uint32_t benchmarkWarmupFrames = 60;
+static const uint32_t benchmarkFrames = 600;
+
+static BenchmarkResult RunExampleBenchmark(const std::string& name, SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	BenchmarkResult result = {};
+	result.name = name;
+
+	ViewportToTexture exampleCode(window, vulkanInitializer, settings);
+
+	SDL_Event eventInfo;
+	for (uint32_t frame = 0; frame < benchmarkWarmupFrames + benchmarkFrames; frame++) {
+		// keeping the window responsive while measuring
+		while (SDL_PollEvent(&eventInfo)) {
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		exampleCode.Draw();
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		if (frame < benchmarkWarmupFrames) {
+			continue;
+		}
+
+		result.cpuFrameMs += std::chrono::duration<double, std::milli>(end - start).count();
+		result.gpuFrameMs += exampleCode.gpuProfiler->GetScopeMilliseconds(ViewportToTexture::GpuScopeFrame);
+		result.gpuOffscreenMs += exampleCode.gpuProfiler->GetScopeMilliseconds(ViewportToTexture::GpuScopeOffscreen);
+		result.gpuPresentMs += exampleCode.gpuProfiler->GetScopeMilliseconds(ViewportToTexture::GpuScopePresent);
+		result.gpuParticlesMs += exampleCode.gpuProfiler->GetScopeMilliseconds(ViewportToTexture::GpuScopeParticles);
+		result.gpuLightsMs += exampleCode.gpuProfiler->GetScopeMilliseconds(ViewportToTexture::GpuScopeLights);
+	}
+
+	result.commandBuffersRecorded = exampleCode.commandBuffersRecorded;
+
+	result.cpuFrameMs /= benchmarkFrames;
+	result.gpuFrameMs /= benchmarkFrames;
+	result.gpuOffscreenMs /= benchmarkFrames;
+	result.gpuPresentMs /= benchmarkFrames;
+	result.gpuParticlesMs /= benchmarkFrames;
+	result.gpuLightsMs /= benchmarkFrames;
+
+	return result;
+}
+
+static void PrintBenchmarkResults(const std::string& title, const std::vector<BenchmarkResult>& results) {
+	std::cout << std::endl << title << " (" << benchmarkFrames << " frames each)" << std::endl;
+	std::cout << std::left << std::setw(28) << "configuration"
+		<< std::right << std::setw(14) << "cpu frame ms"
+		<< std::setw(14) << "gpu frame ms"
+		<< std::setw(14) << "offscreen ms"
+		<< std::setw(14) << "present ms" << std::endl;
+
+	for (const auto& result : results) {
+		std::cout << std::left << std::setw(28) << result.name
+			<< std::right << std::fixed << std::setprecision(3)
+			<< std::setw(14) << result.cpuFrameMs
+			<< std::setw(14) << result.gpuFrameMs
+			<< std::setw(14) << result.gpuOffscreenMs
+			<< std::setw(14) << result.gpuPresentMs << std::endl;
+	}
+	std::cout << std::defaultfloat;
+}
+
+static void BenchmarkMsaa(SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	VkPhysicalDeviceProperties physicalDeviceProperties = {};
+	vkGetPhysicalDeviceProperties(vulkanInitializer->physicalDevice, &physicalDeviceProperties);
+
+	std::vector<BenchmarkResult> results;
+	for (VkSampleCountFlagBits samples : { VK_SAMPLE_COUNT_1_BIT, VK_SAMPLE_COUNT_2_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_8_BIT }) {
+		if ((physicalDeviceProperties.limits.framebufferColorSampleCounts & samples) == 0) {
+			std::cout << samples << "x MSAA not supported, skipped" << std::endl;
+			continue;
+		}
+
+		settings.offscreenSampleCount = samples;
+		results.push_back(RunExampleBenchmark(std::to_string(samples) + "x MSAA", window, vulkanInitializer, settings));
+	}
+
+	PrintBenchmarkResults("offscreen MSAA", results);
+}
+
+// CPU cost of recording every frame against submitting the same recorded command buffers again
+static void BenchmarkCommandBuffers(SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	// the scene has to stay the same for the recorded buffers to be reused
+	settings.dynamicResolution.enabled = false;
+
+	std::vector<BenchmarkResult> results;
+	for (bool reuse : { false, true }) {
+		settings.reuseCommandBuffers = reuse;
+		results.push_back(RunExampleBenchmark(reuse ? "reused command buffers" : "recorded every frame", window, vulkanInitializer, settings));
+	}
+
+	PrintBenchmarkResults("command buffer reuse", results);
+
+	for (const auto& result : results) {
+		std::cout << result.name << ": " << result.commandBuffersRecorded << " command buffers recorded in "
+			<< benchmarkWarmupFrames + benchmarkFrames << " frames" << std::endl;
+	}
+	std::cout << "cpu frame time saved: " << std::fixed << std::setprecision(3)
+		<< results[0].cpuFrameMs - results[1].cpuFrameMs << " ms" << std::defaultfloat << std::endl;
+}
+
+// CPU culling with a draw per object against the compute culling pass and its indirect draws
+static void BenchmarkCulling(SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	if (!GpuCulling::IsSupported(vulkanInitializer)) {
+		std::cout << "gpu culling not supported, skipped" << std::endl;
+		return;
+	}
+
+	std::vector<BenchmarkResult> results;
+	for (uint32_t objects : { 1000u, 10000u, 100000u }) {
+		settings.sceneObjects = objects;
+		for (bool gpu : { false, true }) {
+			settings.gpuCulling = gpu;
+			results.push_back(RunExampleBenchmark(std::to_string(objects) + (gpu ? " objects, gpu" : " objects, cpu"), window, vulkanInitializer, settings));
+		}
+	}
+
+	PrintBenchmarkResults("object culling", results);
+}
+
+// compute simulation of the particles, and their draw as what they add to the offscreen pass
+static void BenchmarkParticles(SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	std::vector<BenchmarkResult> results;
+	for (uint32_t particles : { 0u, 100000u, 1000000u, 10000000u }) {
+		settings.particles.capacity = particles;
+		results.push_back(RunExampleBenchmark(std::to_string(particles) + " particles", window, vulkanInitializer, settings));
+	}
+
+	PrintBenchmarkResults("particles", results);
+
+	// the first run has no particles, its offscreen pass is the scene alone
+	std::cout << std::left << std::setw(28) << "configuration"
+		<< std::right << std::setw(14) << "simulate ms"
+		<< std::setw(14) << "draw ms" << std::endl;
+	for (size_t i = 1; i < results.size(); i++) {
+		std::cout << std::left << std::setw(28) << results[i].name
+			<< std::right << std::fixed << std::setprecision(3)
+			<< std::setw(14) << results[i].gpuParticlesMs
+			<< std::setw(14) << results[i].gpuOffscreenMs - results[0].gpuOffscreenMs << std::endl;
+	}
+	std::cout << std::defaultfloat;
+}
+
+// lit offscreen pass with the lights culled per tile against every pixel looping over all of them
+static void BenchmarkLights(SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	std::vector<BenchmarkResult> results;
+	settings.lights.lightCount = 0;
+	results.push_back(RunExampleBenchmark("unlit", window, vulkanInitializer, settings));
+	for (uint32_t lights : { 64u, 256u, 1024u, 4096u }) {
+		settings.lights.lightCount = lights;
+		for (bool tiled : { false, true }) {
+			settings.lights.tiled = tiled;
+			results.push_back(RunExampleBenchmark(std::to_string(lights) + (tiled ? " lights, tiled" : " lights, untiled"), window, vulkanInitializer, settings));
+		}
+	}
+
+	PrintBenchmarkResults("point lights", results);
+
+	// the tiles are built before the offscreen pass, its time is only the draws
+	std::cout << std::left << std::setw(28) << "configuration"
+		<< std::right << std::setw(14) << "culling ms"
+		<< std::setw(14) << "lighting ms" << std::endl;
+	for (size_t i = 1; i < results.size(); i++) {
+		std::cout << std::left << std::setw(28) << results[i].name
+			<< std::right << std::fixed << std::setprecision(3)
+			<< std::setw(14) << results[i].gpuLightsMs
+			<< std::setw(14) << results[i].gpuOffscreenMs - results[0].gpuOffscreenMs << std::endl;
+	}
+	std::cout << std::defaultfloat;
+}
+
+// some arithmetic per element so the loop is bound by the cores, not by memory
+static void JobBenchmarkKernel(std::vector<float>& values, uint32_t begin, uint32_t end) {
+	for (uint32_t i = begin; i < end; i++) {
+		float value = static_cast<float>(i);
+		for (uint32_t iteration = 0; iteration < 64; iteration++) {
+			value = std::sqrt(value * value + 1.0f) * 0.999f;
+		}
+		values[i] = value;
+	}
+}
+
+// task throughput and parallel for scaling, from one thread up to every core
+static void BenchmarkJobs() {
+	const uint32_t emptyJobCount = 1000000;
+	const uint32_t elementCount = 1 << 20;
+	const uint32_t grainSize = 1024;
+	uint32_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<float> values(elementCount);
+
+	// a single thread without any scheduling is the baseline of the scaling
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	JobBenchmarkKernel(values, 0, elementCount);
+	double serialMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::endl << "job system (" << emptyJobCount << " empty jobs, parallel for over " << elementCount << " elements)" << std::endl;
+	std::cout << std::left << std::setw(12) << "threads"
+		<< std::right << std::setw(16) << "jobs/s"
+		<< std::setw(18) << "parallel for ms"
+		<< std::setw(12) << "speedup" << std::endl;
+
+	std::cout << std::left << std::setw(12) << 1
+		<< std::right << std::fixed << std::setprecision(3)
+		<< std::setw(16) << "-"
+		<< std::setw(18) << serialMs
+		<< std::setw(12) << 1.0 << std::endl;
+
+	for (uint32_t threads = 2; threads <= coreCount; threads++) {
+		// the benchmark thread works too while it waits
+		JobSystem jobSystem(threads - 1);
+
+		// jobs spawned from a job land on a worker deque and have to be stolen by the others
+		JobCounter counter;
+		start = std::chrono::steady_clock::now();
+		jobSystem.Run([&jobSystem, &counter, emptyJobCount] {
+			for (uint32_t i = 0; i < emptyJobCount; i++) {
+				jobSystem.Run([] {}, &counter);
+			}
+		}, &counter);
+		jobSystem.Wait(counter);
+		double jobsSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		jobSystem.ParallelFor(elementCount, grainSize, [&values](uint32_t begin, uint32_t end) {
+			JobBenchmarkKernel(values, begin, end);
+		});
+		double parallelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << std::left << std::setw(12) << threads
+			<< std::right << std::fixed << std::setprecision(0)
+			<< std::setw(16) << emptyJobCount / jobsSeconds
+			<< std::setprecision(3)
+			<< std::setw(18) << parallelMs
+			<< std::setw(12) << serialMs / parallelMs << std::endl;
+	}
+	std::cout << std::defaultfloat;
+}
+
+// spatial grid queries against testing every box, and the cost of moving every entity
+static void BenchmarkSpatialGrid() {
+	const uint32_t queryCount = 1000;
+	// the camera sees the same part of a bigger world, so the grid has to skip more of it
+	const float cameraSize = 64.0f;
+	std::mt19937 random(42);
+
+	std::cout << std::endl << "spatial grid (" << SpatialGrid::InstructionSet() << ", " << queryCount << " camera queries of " << cameraSize << "x" << cameraSize << " units)" << std::endl;
+	std::cout << std::left << std::setw(12) << "entities"
+		<< std::right << std::setw(12) << "build ms"
+		<< std::setw(14) << "query us"
+		<< std::setw(16) << "brute force us"
+		<< std::setw(16) << "updates/s"
+		<< std::setw(14) << "cell moves" << std::endl;
+
+	for (uint32_t entityCount : { 10000u, 100000u, 1000000u }) {
+		// same density at every size, about four entities per cell
+		float worldSize = std::sqrt(static_cast<float>(entityCount)) * 4.0f;
+		std::uniform_real_distribution<float> position(0.0f, worldSize);
+		std::uniform_real_distribution<float> size(0.5f, 2.0f);
+		std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+
+		std::vector<Aabb> boxes(entityCount);
+		for (Aabb& box : boxes) {
+			float x = position(random);
+			float y = position(random);
+			box = { x, y, x + size(random), y + size(random) };
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		SpatialGrid grid({ 0.0f, 0.0f, worldSize, worldSize }, 8.0f);
+		for (uint32_t i = 0; i < entityCount; i++) {
+			grid.Insert(i, boxes[i]);
+		}
+		double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// every box in flat arrays, what the grid saves is testing all of them
+		std::vector<float> minX(entityCount), minY(entityCount), maxX(entityCount), maxY(entityCount);
+		std::vector<uint32_t> ids(entityCount);
+		for (uint32_t i = 0; i < entityCount; i++) {
+			minX[i] = boxes[i].minX;
+			minY[i] = boxes[i].minY;
+			maxX[i] = boxes[i].maxX;
+			maxY[i] = boxes[i].maxY;
+			ids[i] = i;
+		}
+
+		std::uniform_real_distribution<float> cameraPosition(0.0f, worldSize - cameraSize);
+		std::vector<Aabb> cameras(queryCount);
+		for (Aabb& camera : cameras) {
+			float x = cameraPosition(random);
+			float y = cameraPosition(random);
+			camera = { x, y, x + cameraSize, y + cameraSize };
+		}
+
+		std::vector<uint32_t> results;
+		results.reserve(entityCount);
+
+		start = std::chrono::steady_clock::now();
+		for (const Aabb& camera : cameras) {
+			results.clear();
+			grid.Query(camera, results);
+		}
+		double queryUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queryCount;
+
+		start = std::chrono::steady_clock::now();
+		for (const Aabb& camera : cameras) {
+			results.clear();
+			SpatialGrid::QueryBoxes(minX.data(), minY.data(), maxX.data(), maxY.data(), ids.data(), entityCount, camera, results);
+		}
+		double bruteForceUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queryCount;
+
+		// every entity takes a small step, like a frame of movement
+		std::vector<float> steps(entityCount * 2);
+		for (float& value : steps) {
+			value = step(random);
+		}
+
+		uint32_t cellMoves = 0;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < entityCount; i++) {
+			uint32_t cell = grid.locations[i].cell;
+			float dx = steps[i * 2];
+			float dy = steps[i * 2 + 1];
+			boxes[i] = { boxes[i].minX + dx, boxes[i].minY + dy, boxes[i].maxX + dx, boxes[i].maxY + dy };
+			grid.Update(i, boxes[i]);
+			cellMoves += grid.locations[i].cell != cell;
+		}
+		double updateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << std::left << std::setw(12) << entityCount
+			<< std::right << std::fixed << std::setprecision(3)
+			<< std::setw(12) << buildMs
+			<< std::setw(14) << queryUs
+			<< std::setw(16) << bruteForceUs
+			<< std::setprecision(0)
+			<< std::setw(16) << entityCount / updateSeconds
+			<< std::setw(14) << cellMoves << std::endl;
+	}
+	std::cout << std::defaultfloat;
+}
+
+// returns false when there is no benchmark with that name
+static bool RunBenchmark(const std::string& name, SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings) {
+	// timings come from the benchmark itself
+	settings.printStats = false;
+	// vsync would hide the differences between configurations
+	settings.presentPolicy = PresentPolicy::Uncapped;
+	// a skipped offscreen pass would leave nothing to measure
+	settings.lazyOffscreen = false;
+
+	if (name == "msaa") {
+		BenchmarkMsaa(window, vulkanInitializer, settings);
+		return true;
+	}
+	if (name == "commandbuffers") {
+		BenchmarkCommandBuffers(window, vulkanInitializer, settings);
+		return true;
+	}
+	if (name == "culling") {
+		BenchmarkCulling(window, vulkanInitializer, settings);
+		return true;
+	}
+	if (name == "particles") {
+		BenchmarkParticles(window, vulkanInitializer, settings);
+		return true;
+	}
+	if (name == "lights") {
+		BenchmarkLights(window, vulkanInitializer, settings);
+		return true;
+	}
+	if (name == "spatial") {
+		BenchmarkSpatialGrid();
+		return true;
+	}
+	if (name == "jobs") {
+		BenchmarkJobs();
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,25 @@
+/*
+	non owning view of a block of bytes, a file in memory or a part of it
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct ByteSpan {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+	bool Empty() const {
+		return size == 0;
+	}
+
+	// empty when the range is not fully inside the span
+	ByteSpan Sub(size_t offset, size_t length) const {
+		if (offset > size || length > size - offset) {
+			return ByteSpan{};
+		}
+
+		return ByteSpan{ data + offset, length };
+	}
+};
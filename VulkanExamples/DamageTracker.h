@@ -0,0 +1,136 @@
+/*
+	parts of the swapchain images that changed since each image was last drawn.
+
+	A change has to reach every swapchain image, and each image picks it up the next time it
+	is acquired, so every image keeps its own list of rectangles. An image that was never drawn,
+	or collected so much damage that a partial redraw wouldn't pay off, is drawn whole.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+class DamageTracker {
+public:
+	// more rectangles than this merge into their bounding box
+	static const size_t maxRects = 8;
+
+	struct ImageDamage {
+		bool full = true;
+		std::vector<VkRect2D> rects;
+	};
+
+	std::vector<ImageDamage> images;
+	VkExtent2D extent = {};
+
+	DamageTracker() = default;
+	DamageTracker(uint32_t imageCount, VkExtent2D imageExtent) {
+		images.resize(imageCount);
+		extent = imageExtent;
+	}
+
+	// every image is drawn whole the next time
+	void AddFull() {
+		for (ImageDamage& image : images) {
+			image.full = true;
+			image.rects.clear();
+		}
+	}
+
+	void Add(VkRect2D rect) {
+		rect = Clip(rect);
+		if (rect.extent.width == 0 || rect.extent.height == 0) {
+			return;
+		}
+
+		if (rect.extent.width == extent.width && rect.extent.height == extent.height) {
+			AddFull();
+			return;
+		}
+
+		for (ImageDamage& image : images) {
+			if (!image.full) {
+				AddToImage(image, rect);
+			}
+		}
+	}
+
+	// false when the image has to be drawn whole, otherwise rects gets its damage, empty when nothing changed
+	bool Take(uint32_t imageIndex, std::vector<VkRect2D>& rects) {
+		ImageDamage& image = images[imageIndex];
+		bool partial = !image.full;
+
+		rects.swap(image.rects);
+		image.rects.clear();
+		image.full = false;
+
+		return partial;
+	}
+
+	static VkRect2D Union(const VkRect2D& a, const VkRect2D& b) {
+		int32_t left = std::min(a.offset.x, b.offset.x);
+		int32_t top = std::min(a.offset.y, b.offset.y);
+		int32_t right = std::max(a.offset.x + static_cast<int32_t>(a.extent.width), b.offset.x + static_cast<int32_t>(b.extent.width));
+		int32_t bottom = std::max(a.offset.y + static_cast<int32_t>(a.extent.height), b.offset.y + static_cast<int32_t>(b.extent.height));
+
+		return { { left, top }, { static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top) } };
+	}
+
+	// touching rectangles count too, their union covers nothing more than the two
+	static bool Touches(const VkRect2D& a, const VkRect2D& b) {
+		return a.offset.x <= b.offset.x + static_cast<int32_t>(b.extent.width)
+			&& b.offset.x <= a.offset.x + static_cast<int32_t>(a.extent.width)
+			&& a.offset.y <= b.offset.y + static_cast<int32_t>(b.extent.height)
+			&& b.offset.y <= a.offset.y + static_cast<int32_t>(a.extent.height);
+	}
+
+	static uint64_t Area(const std::vector<VkRect2D>& rects) {
+		uint64_t area = 0;
+		for (const VkRect2D& rect : rects) {
+			area += static_cast<uint64_t>(rect.extent.width) * rect.extent.height;
+		}
+		return area;
+	}
+
+private:
+	VkRect2D Clip(VkRect2D rect) const {
+		int32_t left = std::max(rect.offset.x, 0);
+		int32_t top = std::max(rect.offset.y, 0);
+		int32_t right = std::min(rect.offset.x + static_cast<int32_t>(rect.extent.width), static_cast<int32_t>(extent.width));
+		int32_t bottom = std::min(rect.offset.y + static_cast<int32_t>(rect.extent.height), static_cast<int32_t>(extent.height));
+
+		if (right <= left || bottom <= top) {
+			return {};
+		}
+
+		return { { left, top }, { static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top) } };
+	}
+
+	void AddToImage(ImageDamage& image, VkRect2D rect) {
+		// a merged rectangle can reach others, so it goes around again until nothing touches it
+		bool merged = true;
+		while (merged) {
+			merged = false;
+			for (size_t i = 0; i < image.rects.size(); i++) {
+				if (Touches(image.rects[i], rect)) {
+					rect = Union(image.rects[i], rect);
+					image.rects.erase(image.rects.begin() + i);
+					merged = true;
+					break;
+				}
+			}
+		}
+		image.rects.push_back(rect);
+
+		if (image.rects.size() > maxRects) {
+			VkRect2D bounds = image.rects[0];
+			for (const VkRect2D& other : image.rects) {
+				bounds = Union(bounds, other);
+			}
+			image.rects = { bounds };
+		}
+	}
+};
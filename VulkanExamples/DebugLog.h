@@ -0,0 +1,268 @@
+/*
+	asynchronous sink for the validation layer messages.
+
+	The debug callback runs on whatever thread the driver calls it from, in the middle of
+	Vulkan calls. It only copies the message into a bounded lock-free multi producer ring;
+	a background thread drains the ring, prints the first occurrence of each message id and
+	counts the repetitions, so validation can stay enabled in long runs without distorting
+	frame times.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+enum class ValidationLevel {
+	Off,
+	Errors,
+	Warnings,
+	Info,
+	Verbose
+};
+
+static VkDebugUtilsMessageSeverityFlagsEXT ValidationLevelSeverities(ValidationLevel level) {
+	VkDebugUtilsMessageSeverityFlagsEXT severities = 0;
+
+	switch (level) {
+	case ValidationLevel::Verbose:
+		severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+		// fall through
+	case ValidationLevel::Info:
+		severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+		// fall through
+	case ValidationLevel::Warnings:
+		severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+		// fall through
+	case ValidationLevel::Errors:
+		severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		break;
+	default:
+		break;
+	}
+
+	return severities;
+}
+
+static bool ParseValidationLevel(const std::string& name, ValidationLevel& level) {
+	if (name == "off") {
+		level = ValidationLevel::Off;
+	}
+	else if (name == "errors") {
+		level = ValidationLevel::Errors;
+	}
+	else if (name == "warnings") {
+		level = ValidationLevel::Warnings;
+	}
+	else if (name == "info") {
+		level = ValidationLevel::Info;
+	}
+	else if (name == "verbose") {
+		level = ValidationLevel::Verbose;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+class DebugLog {
+public:
+	// longer messages are truncated, the ring never allocates
+	static const size_t maxMessageLength = 1024;
+
+	struct Message {
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+		int32_t messageIdNumber = 0;
+		char text[maxMessageLength] = {};
+	};
+
+	// bounded MPMC ring (Vyukov), used here with a single consumer
+	struct Cell {
+		std::atomic<size_t> sequence = { 0 };
+		Message message;
+	};
+
+	struct Repetition {
+		uint64_t count = 0;
+		uint64_t reported = 0;
+	};
+
+	std::vector<Cell> cells;
+	size_t mask = 0;
+	std::atomic<size_t> enqueuePosition = { 0 };
+	size_t dequeuePosition = 0;
+
+	std::atomic<uint64_t> droppedMessages = { 0 };
+
+	// consumer thread only
+	std::unordered_map<uint64_t, Repetition> repetitions = {};
+	std::chrono::steady_clock::time_point lastSummary = std::chrono::steady_clock::now();
+	// how often the repetition counts are printed
+	std::chrono::seconds summaryInterval = std::chrono::seconds(5);
+
+	std::thread drainThread;
+	std::atomic<bool> running = { false };
+
+	// capacity is rounded up to a power of two
+	DebugLog(size_t capacity = 1024) : cells(RoundUpPowerOfTwo(capacity)) {
+		mask = cells.size() - 1;
+		for (size_t i = 0; i < cells.size(); i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		running = true;
+		drainThread = std::thread(&DebugLog::DrainLoop, this);
+	}
+	~DebugLog() {
+		running = false;
+		drainThread.join();
+	}
+
+	static size_t RoundUpPowerOfTwo(size_t value) {
+		size_t result = 1;
+		while (result < value) {
+			result <<= 1;
+		}
+		return result;
+	}
+
+	// called from any thread, never blocks
+	bool Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, int32_t messageIdNumber, const char* text) {
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		Cell* cell = nullptr;
+
+		while (true) {
+			cell = &cells[position & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0) {
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (difference < 0) {
+				// full, the consumer is behind
+				droppedMessages.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			else {
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->message.severity = severity;
+		cell->message.messageIdNumber = messageIdNumber;
+		std::strncpy(cell->message.text, text ? text : "", maxMessageLength - 1);
+		cell->message.text[maxMessageLength - 1] = '\0';
+
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(Message& message) {
+		Cell& cell = cells[dequeuePosition & mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+		if (sequence != dequeuePosition + 1) {
+			return false;
+		}
+
+		message = cell.message;
+		cell.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+		dequeuePosition++;
+
+		return true;
+	}
+
+	// general messages don't carry an id, their text identifies them
+	static uint64_t MessageKey(const Message& message) {
+		if (message.messageIdNumber != 0) {
+			return static_cast<uint32_t>(message.messageIdNumber);
+		}
+
+		// FNV-1a, kept out of the id range
+		uint64_t hash = 14695981039346656037ull;
+		for (const char* c = message.text; *c; c++) {
+			hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+		}
+		return hash | (uint64_t(1) << 63);
+	}
+
+	static const char* SeverityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+		switch (severity) {
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
+			return "error";
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+			return "warning";
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
+			return "info";
+		default:
+			return "verbose";
+		}
+	}
+
+	void DrainLoop() {
+		Message message;
+
+		while (true) {
+			bool drained = true;
+
+			while (Pop(message)) {
+				drained = false;
+
+				Repetition& repetition = repetitions[MessageKey(message)];
+				repetition.count++;
+
+				// only the first occurrence is printed, the rest shows up in the summary
+				if (repetition.count == 1) {
+					repetition.reported = 1;
+					std::cout << "[" << SeverityName(message.severity) << "] " << message.text << '\n';
+				}
+			}
+
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now - lastSummary >= summaryInterval || (!running && drained)) {
+				PrintRepetitions();
+				lastSummary = now;
+			}
+
+			if (drained) {
+				std::cout.flush();
+
+				if (!running) {
+					break;
+				}
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		}
+
+		if (droppedMessages > 0) {
+			std::cout << "validation: " << droppedMessages << " messages dropped, the log ring was full" << std::endl;
+		}
+	}
+
+	void PrintRepetitions() {
+		for (auto& entry : repetitions) {
+			Repetition& repetition = entry.second;
+			if (repetition.count == repetition.reported) {
+				continue;
+			}
+
+			std::cout << "validation: message 0x" << std::hex << entry.first << std::dec
+				<< " repeated " << (repetition.count - repetition.reported) << " more times"
+				<< " (" << repetition.count << " total)" << '\n';
+			repetition.reported = repetition.count;
+		}
+	}
+};
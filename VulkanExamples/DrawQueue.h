@@ -0,0 +1,268 @@
+/*
+	draws submitted in any order, sorted by a 64 bit key and replayed with only the state
+	changes between neighbours.
+
+	key, most significant bits first:
+		layer 8 | pipeline 12 | descriptor set 12 | texture 16 | order 16
+
+	Sorting groups the draws of a layer by pipeline, then by descriptor set and texture, so the
+	replay binds each of them once per run instead of once per draw. The ids in the key are
+	whatever the submitter numbers its state with, they only decide the order. Whether a bind
+	can be skipped is decided by comparing the handles of the draw with the ones bound last.
+
+	The keys are sorted with an LSD radix sort, 8 bits per pass, and a pass is skipped when
+	every key has the same digit in it. Large queues split the histograms and the scatter of
+	each pass between the jobs of the job system.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "JobSystem.h"
+
+struct DrawItem {
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	// set 0, left alone when null
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+	// binding 0 per vertex, binding 1 per instance when there is one
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer instanceBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+
+	uint32_t indexCount = 0;
+	uint32_t instanceCount = 1;
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	uint32_t firstInstance = 0;
+};
+
+// counts of the last replay
+struct DrawQueueStats {
+	uint32_t drawCalls = 0;
+	uint32_t binds = 0;
+	// binds the submission order would have needed on top of binds
+	uint32_t bindsSaved = 0;
+};
+
+class DrawQueue {
+public:
+	static const uint32_t layerBits = 8;
+	static const uint32_t pipelineBits = 12;
+	static const uint32_t descriptorSetBits = 12;
+	static const uint32_t textureBits = 16;
+	static const uint32_t orderBits = 16;
+
+	// below this many draws the sort stays on the calling thread, the jobs cost more than they save
+	static const uint32_t parallelSortThreshold = 16384;
+
+	static uint64_t MakeKey(uint32_t layer, uint32_t pipeline, uint32_t descriptorSet, uint32_t texture, uint32_t order) {
+		uint64_t key = layer & ((1u << layerBits) - 1);
+		key = (key << pipelineBits) | (pipeline & ((1u << pipelineBits) - 1));
+		key = (key << descriptorSetBits) | (descriptorSet & ((1u << descriptorSetBits) - 1));
+		key = (key << textureBits) | (texture & ((1u << textureBits) - 1));
+		key = (key << orderBits) | (order & ((1u << orderBits) - 1));
+		return key;
+	}
+
+	JobSystem* jobSystem = nullptr;
+
+	std::vector<uint64_t> keys;
+	std::vector<DrawItem> items;
+	// item of each sorted key
+	std::vector<uint32_t> order;
+
+	DrawQueueStats stats = {};
+
+	DrawQueue() = default;
+	DrawQueue(JobSystem* jobs) {
+		jobSystem = jobs;
+	}
+
+	// frame boundary, the storage is kept for the next frame
+	void Clear() {
+		keys.clear();
+		items.clear();
+	}
+
+	void Submit(uint64_t key, const DrawItem& item) {
+		keys.push_back(key);
+		items.push_back(item);
+	}
+
+	size_t Size() const {
+		return items.size();
+	}
+
+	void Sort() {
+		uint32_t count = static_cast<uint32_t>(keys.size());
+		order.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			order[i] = i;
+		}
+
+		sortKeys.assign(keys.begin(), keys.end());
+		RadixSort(sortKeys, order, scratchKeys, scratchOrder, count >= parallelSortThreshold ? jobSystem : nullptr);
+	}
+
+	// inside a render pass, after Sort
+	void Replay(VkCommandBuffer commandBuffer) {
+		stats = {};
+
+		// the binds the submission order would have needed, with the same elision
+		uint32_t unsortedBinds = 0;
+		for (size_t i = 0; i < items.size(); i++) {
+			unsortedBinds += i == 0 ? CountChanges(items[i]) : CountChanges(items[i - 1], items[i]);
+		}
+
+		const DrawItem* bound = nullptr;
+		for (uint32_t index : order) {
+			const DrawItem& item = items[index];
+
+			if (!bound || bound->pipeline != item.pipeline) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item.pipeline);
+				stats.binds++;
+			}
+			if (item.descriptorSet != VK_NULL_HANDLE && (!bound || bound->descriptorSet != item.descriptorSet || bound->layout != item.layout)) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item.layout, 0, 1, &item.descriptorSet, 0, nullptr);
+				stats.binds++;
+			}
+			if (!bound || bound->vertexBuffer != item.vertexBuffer) {
+				VkDeviceSize offset = 0;
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &item.vertexBuffer, &offset);
+				stats.binds++;
+			}
+			if (item.instanceBuffer != VK_NULL_HANDLE && (!bound || bound->instanceBuffer != item.instanceBuffer)) {
+				VkDeviceSize offset = 0;
+				vkCmdBindVertexBuffers(commandBuffer, 1, 1, &item.instanceBuffer, &offset);
+				stats.binds++;
+			}
+			if (!bound || bound->indexBuffer != item.indexBuffer || bound->indexType != item.indexType) {
+				vkCmdBindIndexBuffer(commandBuffer, item.indexBuffer, 0, item.indexType);
+				stats.binds++;
+			}
+			bound = &item;
+
+			vkCmdDrawIndexed(commandBuffer, item.indexCount, item.instanceCount, item.firstIndex, item.vertexOffset, item.firstInstance);
+			stats.drawCalls++;
+		}
+
+		stats.bindsSaved = unsortedBinds > stats.binds ? unsortedBinds - stats.binds : 0;
+	}
+
+	// sorts keys and carries values along, stable, the scratch vectors are resized as needed
+	static void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchValues, JobSystem* jobSystem = nullptr) {
+		uint32_t count = static_cast<uint32_t>(keys.size());
+		scratchKeys.resize(count);
+		scratchValues.resize(count);
+		if (count < 2) {
+			return;
+		}
+
+		// one chunk per thread, each one keeps its own histogram so nothing is shared while counting
+		uint32_t chunkCount = 1;
+		if (jobSystem) {
+			chunkCount = std::min(jobSystem->GetWorkerCount() + 1, std::max(count / 4096, 1u));
+		}
+		uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+		std::vector<std::array<uint32_t, 256>> histograms(chunkCount);
+
+		uint64_t* source = keys.data();
+		uint32_t* sourceValues = values.data();
+		uint64_t* destination = scratchKeys.data();
+		uint32_t* destinationValues = scratchValues.data();
+
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			auto countChunk = [&](uint32_t begin, uint32_t end) {
+				std::array<uint32_t, 256>& histogram = histograms[begin / chunkSize];
+				histogram.fill(0);
+				for (uint32_t i = begin; i < end; i++) {
+					histogram[(source[i] >> shift) & 0xff]++;
+				}
+			};
+			ForEachChunk(jobSystem, count, chunkSize, countChunk);
+
+			// every key has the same digit, the pass would only copy
+			bool skip = false;
+			for (uint32_t digit = 0; digit < 256 && !skip; digit++) {
+				uint32_t total = 0;
+				for (const auto& histogram : histograms) {
+					total += histogram[digit];
+				}
+				skip = total == count;
+			}
+			if (skip) {
+				continue;
+			}
+
+			// offsets in digit order, chunk order inside a digit keeps the sort stable
+			uint32_t offset = 0;
+			for (uint32_t digit = 0; digit < 256; digit++) {
+				for (auto& histogram : histograms) {
+					uint32_t digitCount = histogram[digit];
+					histogram[digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			auto scatterChunk = [&](uint32_t begin, uint32_t end) {
+				std::array<uint32_t, 256>& offsets = histograms[begin / chunkSize];
+				for (uint32_t i = begin; i < end; i++) {
+					uint32_t target = offsets[(source[i] >> shift) & 0xff]++;
+					destination[target] = source[i];
+					destinationValues[target] = sourceValues[i];
+				}
+			};
+			ForEachChunk(jobSystem, count, chunkSize, scatterChunk);
+
+			std::swap(source, destination);
+			std::swap(sourceValues, destinationValues);
+		}
+
+		// an odd number of passes leaves the result in the scratch vectors
+		if (source != keys.data()) {
+			std::memcpy(keys.data(), source, count * sizeof(uint64_t));
+			std::memcpy(values.data(), sourceValues, count * sizeof(uint32_t));
+		}
+	}
+
+private:
+	std::vector<uint64_t> sortKeys;
+	std::vector<uint64_t> scratchKeys;
+	std::vector<uint32_t> scratchOrder;
+
+	template <typename Function>
+	static void ForEachChunk(JobSystem* jobSystem, uint32_t count, uint32_t chunkSize, Function& function) {
+		if (jobSystem && count > chunkSize) {
+			jobSystem->ParallelFor(count, chunkSize, function);
+			return;
+		}
+		for (uint32_t begin = 0; begin < count; begin += chunkSize) {
+			function(begin, std::min(count, begin + chunkSize));
+		}
+	}
+
+	// binds needed to go from one item to the next
+	static uint32_t CountChanges(const DrawItem& from, const DrawItem& to) {
+		uint32_t changes = 0;
+		changes += from.pipeline != to.pipeline;
+		changes += to.descriptorSet != VK_NULL_HANDLE && (from.descriptorSet != to.descriptorSet || from.layout != to.layout);
+		changes += from.vertexBuffer != to.vertexBuffer;
+		changes += to.instanceBuffer != VK_NULL_HANDLE && from.instanceBuffer != to.instanceBuffer;
+		changes += from.indexBuffer != to.indexBuffer || from.indexType != to.indexType;
+		return changes;
+	}
+
+	// binds of the first draw
+	static uint32_t CountChanges(const DrawItem& first) {
+		return 3 + (first.descriptorSet != VK_NULL_HANDLE) + (first.instanceBuffer != VK_NULL_HANDLE);
+	}
+};
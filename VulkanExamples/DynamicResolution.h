@@ -0,0 +1,90 @@
+/*
+	picks the internal resolution of the offscreen pass from the measured GPU frame time.
+
+	The offscreen target is allocated once at maxScale and the pass only renders into
+	the top left sub rectangle, so a new scale never recreates any resource.
+*/
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "vulkan/vulkan.h"
+
+struct DynamicResolutionSettings {
+	bool enabled = false;
+	// GPU budget for a whole frame
+	float targetFrameMs = 16.0f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+};
+
+class DynamicResolution {
+public:
+	DynamicResolutionSettings m_settings = {};
+	float scale = 1.0f;
+
+	// relative distance to the target where the scale is left untouched
+	float tolerance = 0.05f;
+	// biggest step in a single frame, avoids oscillating on a noisy frame
+	float maxStep = 0.1f;
+	// keep the render size aligned, it is friendlier to tiled hardware
+	uint32_t alignment = 8;
+
+	DynamicResolution(DynamicResolutionSettings settings = {}) {
+		m_settings = settings;
+		m_settings.minScale = std::max(m_settings.minScale, 0.01f);
+		m_settings.maxScale = std::max(m_settings.maxScale, m_settings.minScale);
+		scale = std::min(1.0f, m_settings.maxScale);
+	}
+
+	void Update(float gpuFrameMs) {
+		if (!m_settings.enabled || gpuFrameMs <= 0.0f) {
+			return;
+		}
+
+		float ratio = m_settings.targetFrameMs / gpuFrameMs;
+		if (std::fabs(ratio - 1.0f) < tolerance) {
+			return;
+		}
+
+		// the pass cost grows with the pixel count, so with the square of the scale
+		float desired = scale * std::sqrt(ratio);
+		desired = std::clamp(desired, scale - maxStep, scale + maxStep);
+		scale = std::clamp(desired, m_settings.minScale, m_settings.maxScale);
+	}
+
+	// size of the image the offscreen pass has to allocate
+	VkExtent2D GetTargetExtent(VkExtent2D displayExtent) {
+		if (!m_settings.enabled) {
+			return displayExtent;
+		}
+
+		return ScaleExtent(displayExtent, m_settings.maxScale);
+	}
+
+	// area of the target used in the current frame
+	VkExtent2D GetRenderExtent(VkExtent2D displayExtent) {
+		if (!m_settings.enabled) {
+			return displayExtent;
+		}
+
+		VkExtent2D targetExtent = GetTargetExtent(displayExtent);
+		VkExtent2D renderExtent = ScaleExtent(displayExtent, scale);
+		renderExtent.width = std::min(renderExtent.width, targetExtent.width);
+		renderExtent.height = std::min(renderExtent.height, targetExtent.height);
+
+		return renderExtent;
+	}
+
+	VkExtent2D ScaleExtent(VkExtent2D extent, float factor) {
+		uint32_t width = static_cast<uint32_t>(extent.width * factor);
+		uint32_t height = static_cast<uint32_t>(extent.height * factor);
+
+		// rounding up to the alignment, but never below a single block
+		width = std::max(alignment, (width + alignment - 1) / alignment * alignment);
+		height = std::max(alignment, (height + alignment - 1) / alignment * alignment);
+
+		return VkExtent2D{ width, height };
+	}
+};
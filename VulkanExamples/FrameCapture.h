@@ -0,0 +1,317 @@
+/*
+	streams rendered frames to disk without stalling the render loop.
+
+	Each captured frame is copied into one slot of a ring of host cached staging buffers,
+	submitted with its own fence. A writer thread polls the fences in ring order and appends
+	the finished frames to a capture file. When every slot is still waiting for the writer the
+	frame is dropped and counted instead of blocking Draw().
+
+	file layout, little endian:
+		header: char magic[8] "VKCAP01", uint32 format (VkFormat), uint32 bytesPerPixel
+		frame:  uint64 frameIndex, uint64 timestampNs, uint32 width, uint32 height, uint32 size, bytes[size]
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "VulkanInitializer.h"
+
+struct FrameCaptureSettings {
+	bool enabled = false;
+	std::string outputPath = "capture.vkcap";
+	// staging buffers in flight, frames are dropped once all of them wait for the writer
+	uint32_t queueDepth = 4;
+};
+
+class FrameCapture {
+public:
+	VulkanInitializer* m_vulkanInitializer;
+	FrameCaptureSettings m_settings = {};
+
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t bytesPerPixel = 4;
+
+	enum SlotState {
+		SlotFree,
+		SlotInFlight,
+	};
+
+	struct Slot {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+
+		// owned by the render thread while free, by the writer thread while in flight
+		std::atomic<uint32_t> state = { SlotFree };
+
+		uint64_t frameIndex = 0;
+		uint64_t timestampNs = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	std::vector<std::unique_ptr<Slot>> slots = {};
+	VkDeviceSize slotSize = 0;
+	bool hostCoherent = true;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+
+	// next slot used by the render thread
+	uint32_t captureIndex = 0;
+
+	std::ofstream file;
+	std::thread writerThread;
+	std::atomic<bool> running = { false };
+
+	std::chrono::steady_clock::time_point captureStart = std::chrono::steady_clock::now();
+
+	std::atomic<uint64_t> capturedFrames = { 0 };
+	std::atomic<uint64_t> writtenFrames = { 0 };
+	std::atomic<uint64_t> droppedFrames = { 0 };
+
+	FrameCapture(VulkanInitializer* vulkanInitializer, VkFormat imageFormat, VkExtent2D maxExtent, FrameCaptureSettings settings) {
+		m_vulkanInitializer = vulkanInitializer;
+		m_settings = settings;
+		format = imageFormat;
+		slotSize = static_cast<VkDeviceSize>(maxExtent.width) * maxExtent.height * bytesPerPixel;
+
+		file.open(m_settings.outputPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open capture file!");
+		}
+
+		char magic[8] = { 'V', 'K', 'C', 'A', 'P', '0', '1', '\0' };
+		uint32_t header[2] = { static_cast<uint32_t>(format), bytesPerPixel };
+		file.write(magic, sizeof(magic));
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+		VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+		commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		commandPoolCreateInfo.queueFamilyIndex = m_vulkanInitializer->getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT);
+		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		ASSERT(vkCreateCommandPool(m_vulkanInitializer->device, &commandPoolCreateInfo, nullptr, &commandPool), "failed to create capture command pool.");
+
+		for (uint32_t i = 0; i < std::max(m_settings.queueDepth, 1u); i++) {
+			slots.push_back(std::make_unique<Slot>());
+			CreateSlot(*slots.back());
+		}
+
+		running = true;
+		writerThread = std::thread(&FrameCapture::WriterLoop, this);
+	}
+	~FrameCapture() {
+		running = false;
+		writerThread.join();
+
+		for (auto& slot : slots) {
+			vkDestroyFence(m_vulkanInitializer->device, slot->fence, nullptr);
+			vkUnmapMemory(m_vulkanInitializer->device, slot->memory);
+			vkDestroyBuffer(m_vulkanInitializer->device, slot->buffer, nullptr);
+			m_vulkanInitializer->FreeMemory(slot->memory);
+		}
+		vkDestroyCommandPool(m_vulkanInitializer->device, commandPool, nullptr);
+
+		std::cout << "capture: " << writtenFrames << " frames written, " << droppedFrames << " dropped" << std::endl;
+	}
+
+	void CreateSlot(Slot& slot) {
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = slotSize;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		ASSERT(vkCreateBuffer(m_vulkanInitializer->device, &bufferInfo, nullptr, &slot.buffer), "failed to create capture buffer.");
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_vulkanInitializer->device, slot.buffer, &memRequirements);
+
+		// cached memory makes the CPU reads fast, it only needs an invalidate when not coherent
+		uint32_t memoryTypeIndex = m_vulkanInitializer->TryFindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, memRequirements.size);
+		if (memoryTypeIndex == UINT32_MAX) {
+			memoryTypeIndex = m_vulkanInitializer->TryFindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memRequirements.size);
+		}
+		if (memoryTypeIndex == UINT32_MAX) {
+			throw std::runtime_error("failed to find memory type for frame capture!");
+		}
+		hostCoherent = (m_vulkanInitializer->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		ASSERT(m_vulkanInitializer->AllocateMemory(&allocInfo, &slot.memory), "failed to allocate capture buffer memory!");
+		ASSERT(vkBindBufferMemory(m_vulkanInitializer->device, slot.buffer, slot.memory, 0));
+
+		// persistently mapped, the writer reads straight from it
+		ASSERT(vkMapMemory(m_vulkanInitializer->device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped));
+
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
+		commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferAllocateInfo.commandPool = commandPool;
+		commandBufferAllocateInfo.commandBufferCount = 1;
+
+		ASSERT(vkAllocateCommandBuffers(m_vulkanInitializer->device, &commandBufferAllocateInfo, &slot.commandBuffer));
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		ASSERT(vkCreateFence(m_vulkanInitializer->device, &fenceInfo, nullptr, &slot.fence), "error creating fence");
+	}
+
+	/*
+		copies the level 0 of an image in SHADER_READ_ONLY layout into the next free slot.
+		Submitted right after the frame on the same queue, so the frame commands are done before the copy starts
+	*/
+	void Capture(VkQueue queue, VkImage image, VkExtent2D extent, uint64_t frameIndex) {
+		capturedFrames++;
+
+		Slot& slot = *slots[captureIndex];
+		if (slot.state.load(std::memory_order_acquire) != SlotFree) {
+			// the writer is behind, never wait for it
+			droppedFrames++;
+			return;
+		}
+
+		slot.frameIndex = frameIndex;
+		slot.timestampNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - captureStart).count());
+		slot.width = extent.width;
+		slot.height = extent.height;
+
+		vkResetFences(m_vulkanInitializer->device, 1, &slot.fence);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		ASSERT(vkBeginCommandBuffer(slot.commandBuffer, &beginInfo));
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			slot.commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+
+		vkCmdCopyImageToBuffer(slot.commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+		// back to the layout the rest of the frame expects
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = slot.buffer;
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(
+			slot.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &bufferBarrier, 1, &barrier);
+
+		ASSERT(vkEndCommandBuffer(slot.commandBuffer));
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &slot.commandBuffer;
+
+		ASSERT(vkQueueSubmit(queue, 1, &submitInfo, slot.fence), "failed to submit capture.");
+
+		// from now on the slot belongs to the writer
+		slot.state.store(SlotInFlight, std::memory_order_release);
+		captureIndex = (captureIndex + 1) % static_cast<uint32_t>(slots.size());
+	}
+
+	void WriterLoop() {
+		uint32_t writeIndex = 0;
+
+		while (true) {
+			Slot& slot = *slots[writeIndex];
+
+			if (slot.state.load(std::memory_order_acquire) != SlotInFlight) {
+				// nothing left to write
+				if (!running) {
+					break;
+				}
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			if (vkGetFenceStatus(m_vulkanInitializer->device, slot.fence) != VK_SUCCESS) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			if (!hostCoherent) {
+				VkMappedMemoryRange range = {};
+				range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory = slot.memory;
+				range.offset = 0;
+				range.size = VK_WHOLE_SIZE;
+
+				vkInvalidateMappedMemoryRanges(m_vulkanInitializer->device, 1, &range);
+			}
+
+			uint32_t size = slot.width * slot.height * bytesPerPixel;
+			uint32_t frameHeader[3] = { slot.width, slot.height, size };
+
+			file.write(reinterpret_cast<const char*>(&slot.frameIndex), sizeof(slot.frameIndex));
+			file.write(reinterpret_cast<const char*>(&slot.timestampNs), sizeof(slot.timestampNs));
+			file.write(reinterpret_cast<const char*>(frameHeader), sizeof(frameHeader));
+			file.write(static_cast<const char*>(slot.mapped), size);
+
+			writtenFrames++;
+
+			slot.state.store(SlotFree, std::memory_order_release);
+			writeIndex = (writeIndex + 1) % static_cast<uint32_t>(slots.size());
+		}
+
+		file.flush();
+	}
+};
@@ -0,0 +1,255 @@
+/*
+	present mode policy and frame pacing for the main loop.
+
+	The pacer keeps the loop from burning a whole core: it waits for the next frame slot of the
+	target frame rate (sleeping first and spinning only for the last part, sleep alone isn't
+	precise enough) and tracks the CPU usage of the process and the input to present latency.
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "vulkan/vulkan.h"
+
+enum class PresentPolicy {
+	// no tearing, newest frame wins, falls back to tearing before blocking
+	LowestLatency,
+	// classic vsync queue
+	Vsync,
+	// no synchronization with the display at all
+	Uncapped,
+	// vsync, and the loop only draws when something changed
+	PowerSaver
+};
+
+// present modes to try in order, FIFO is always supported so every list ends with it
+static std::vector<VkPresentModeKHR> PresentModePreferences(PresentPolicy policy) {
+	switch (policy) {
+	case PresentPolicy::LowestLatency:
+		return { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR };
+	case PresentPolicy::Uncapped:
+		return { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
+	case PresentPolicy::Vsync:
+	case PresentPolicy::PowerSaver:
+	default:
+		return { VK_PRESENT_MODE_FIFO_KHR };
+	}
+}
+
+static bool ParsePresentPolicy(const std::string& name, PresentPolicy& policy) {
+	if (name == "latency") {
+		policy = PresentPolicy::LowestLatency;
+	}
+	else if (name == "vsync") {
+		policy = PresentPolicy::Vsync;
+	}
+	else if (name == "uncapped") {
+		policy = PresentPolicy::Uncapped;
+	}
+	else if (name == "powersaver") {
+		policy = PresentPolicy::PowerSaver;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+static const char* PresentModeName(VkPresentModeKHR mode) {
+	switch (mode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "fifo";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "fifo relaxed";
+	default:
+		return "other";
+	}
+}
+
+// CPU time used by every thread of the process
+static double ProcessCpuSeconds() {
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return 0.0;
+	}
+
+	// 100 ns units
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+
+	return (kernel.QuadPart + user.QuadPart) * 1e-7;
+#else
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+struct FramePacerSettings {
+	// 0 leaves the frame rate to the present mode
+	float targetFps = 0.0f;
+	// the end of the wait is spun instead of slept
+	float spinMs = 1.5f;
+	// the render loop sleeps while nothing needs to be drawn
+	bool idleWhenUnchanged = false;
+	// longest sleep while idle, keeps the loops alive for housekeeping
+	uint32_t idleTimeoutMs = 250;
+};
+
+class FramePacer {
+public:
+	FramePacerSettings m_settings = {};
+
+	std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+
+	// oldest input not yet shown on screen
+	bool hasPendingInput = false;
+	std::chrono::steady_clock::time_point pendingInputTime = {};
+
+	// set from any thread when something needs to be drawn again
+	std::atomic<bool> redrawRequested = { true };
+	std::mutex redrawMutex;
+	std::condition_variable redrawCondition;
+
+	// measurements of the current stats window
+	std::chrono::steady_clock::time_point statsStart = std::chrono::steady_clock::now();
+	double statsCpuStart = ProcessCpuSeconds();
+	uint32_t statsFrames = 0;
+	uint32_t statsIdleWakeups = 0;
+	uint32_t latencySamples = 0;
+	double latencySumMs = 0.0;
+	double latencyMaxMs = 0.0;
+
+	FramePacer(FramePacerSettings settings = {}) {
+		m_settings = settings;
+	}
+
+	void RecordInput(std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now()) {
+		if (!hasPendingInput) {
+			hasPendingInput = true;
+			pendingInputTime = time;
+		}
+	}
+
+	void RequestRedraw() {
+		{
+			std::lock_guard<std::mutex> lock(redrawMutex);
+			redrawRequested = true;
+		}
+		redrawCondition.notify_one();
+	}
+
+	// sleeps until a redraw is requested or the idle timeout runs out, consumes the request
+	bool WaitForRedraw() {
+		std::unique_lock<std::mutex> lock(redrawMutex);
+		redrawCondition.wait_for(lock, std::chrono::milliseconds(m_settings.idleTimeoutMs), [this] { return redrawRequested.load(); });
+
+		bool redraw = redrawRequested.exchange(false);
+		if (!redraw) {
+			// the timeout ran out with nothing to draw
+			statsIdleWakeups++;
+		}
+		return redraw;
+	}
+
+	// blocks until the next frame of the target frame rate is due
+	void WaitForNextFrame() {
+		if (m_settings.targetFps <= 0.0f) {
+			return;
+		}
+
+		std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / m_settings.targetFps));
+		std::chrono::steady_clock::duration spin = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double, std::milli>(m_settings.spinMs));
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		// more than a frame late, don't try to catch up with a burst of frames
+		if (now > nextFrame + period) {
+			nextFrame = now;
+		}
+
+		if (nextFrame - now > spin) {
+			std::this_thread::sleep_until(nextFrame - spin);
+		}
+		while (std::chrono::steady_clock::now() < nextFrame) {
+			std::this_thread::yield();
+		}
+
+		nextFrame += period;
+	}
+
+	// called once the frame is queued for presentation. The GPU time is added since the frame
+	// reaches the screen only after the GPU is done with it
+	void FramePresented(float gpuFrameMs) {
+		statsFrames++;
+
+		if (hasPendingInput) {
+			double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pendingInputTime).count() + gpuFrameMs;
+
+			latencySamples++;
+			latencySumMs += latencyMs;
+			latencyMaxMs = std::max(latencyMaxMs, latencyMs);
+			hasPendingInput = false;
+		}
+	}
+
+	void ReportStats() {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsedSeconds = std::chrono::duration<double>(now - statsStart).count();
+		if (elapsedSeconds < 1.0) {
+			return;
+		}
+
+		double cpuNow = ProcessCpuSeconds();
+
+		std::cout << "pacer: " << statsFrames / elapsedSeconds << " frames/s"
+			<< " | cpu usage: " << 100.0 * (cpuNow - statsCpuStart) / elapsedSeconds << "%"
+			<< " | idle wakeups: " << statsIdleWakeups;
+
+		if (latencySamples > 0) {
+			std::cout << " | input to present: " << latencySumMs / latencySamples << " ms avg, " << latencyMaxMs << " ms max";
+		}
+
+		std::cout << std::endl;
+
+		statsStart = now;
+		statsCpuStart = cpuNow;
+		statsFrames = 0;
+		statsIdleWakeups = 0;
+		latencySamples = 0;
+		latencySumMs = 0.0;
+		latencyMaxMs = 0.0;
+	}
+};
@@ -0,0 +1,402 @@
+/*
+	culls the scene objects on the GPU and draws the ones left without the CPU touching them.
+
+	A compute pass tests the bounds of every object against the views and appends the visible
+	ones to an indirect command buffer, together with their instance data and a draw count.
+	The graphics pass draws straight from those buffers:
+		- vkCmdDrawIndexedIndirectCount when the device has VK_KHR_draw_indirect_count
+		- otherwise one multi draw over every slot, the slots past the count are zeroed and draw nothing
+		- one indirect draw per slot when even multiDrawIndirect is missing, the only mode whose
+		  recording still grows with the number of objects
+
+	The visible objects are appended in whatever order the invocations reach the counter, so
+	objects overlapping each other would flicker. The scene keeps them apart.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "VulkanInitializer.h"
+#include "Helpers.cpp"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// one drawable, laid out like the Object struct of cull.comp
+struct CullObject {
+	// scale in xy and offset in zw, applied to the mesh
+	glm::vec4 transform;
+	// mesh bounds before the transform, min in xy and max in zw
+	glm::vec4 bounds;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t padding;
+
+	// same test as cull.comp, so the CPU path draws exactly what the GPU one would
+	static bool IsVisible(const CullObject& object, const glm::vec4* views, uint32_t viewCount) {
+		glm::vec2 scale = glm::vec2(object.transform);
+		glm::vec2 offset = glm::vec2(object.transform.z, object.transform.w);
+		glm::vec2 a = glm::vec2(object.bounds) * scale + offset;
+		glm::vec2 b = glm::vec2(object.bounds.z, object.bounds.w) * scale + offset;
+
+		for (uint32_t view = 0; view < viewCount; view++) {
+			glm::vec2 viewScale = glm::vec2(views[view]);
+			glm::vec2 viewOffset = glm::vec2(views[view].z, views[view].w);
+			glm::vec2 viewA = a * viewScale + viewOffset;
+			glm::vec2 viewB = b * viewScale + viewOffset;
+
+			glm::vec2 low = glm::min(viewA, viewB);
+			glm::vec2 high = glm::max(viewA, viewB);
+			if (low.x <= 1.0f && low.y <= 1.0f && high.x >= -1.0f && high.y >= -1.0f) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+class GpuCulling {
+public:
+	// has to match the views array of cull.comp
+	static const uint32_t maxViews = 4;
+	static const uint32_t workgroupSize = 64;
+
+	enum class DrawMode {
+		IndirectCount,
+		MultiDrawIndirect,
+		IndirectPerSlot,
+	};
+
+	struct PushConstants {
+		glm::vec4 views[maxViews];
+		uint32_t objectCount;
+		uint32_t viewCount;
+		uint32_t instancesPerObject;
+	};
+
+	// the buffers written by one frame, a frame slot only reuses them once its fence was waited
+	struct FrameBuffers {
+		VkBuffer commands = VK_NULL_HANDLE;
+		VkDeviceMemory commandsMemory = VK_NULL_HANDLE;
+		VkBuffer instances = VK_NULL_HANDLE;
+		VkDeviceMemory instancesMemory = VK_NULL_HANDLE;
+		VkBuffer count = VK_NULL_HANDLE;
+		VkDeviceMemory countMemory = VK_NULL_HANDLE;
+
+		// the count copied back for the stats
+		VkBuffer readback = VK_NULL_HANDLE;
+		VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+		uint32_t* readbackMapped = nullptr;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	VulkanInitializer* m_vulkanInitializer;
+	DrawMode drawMode = DrawMode::IndirectPerSlot;
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+
+	uint32_t objectCount = 0;
+	uint32_t instancesPerObject = 1;
+
+	VkBuffer objectBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory objectMemory = VK_NULL_HANDLE;
+	std::vector<FrameBuffers> frames;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+
+	// objects drawn by the last frame that finished, read back with a frame of delay
+	uint32_t visibleObjects = 0;
+
+	// false when the device can't start an indirect draw at a non zero instance, the CPU has to draw then
+	static bool IsSupported(const VulkanInitializer* vulkanInitializer) {
+		return vulkanInitializer->enabledFeatures.drawIndirectFirstInstance == VK_TRUE;
+	}
+
+	// objects are uploaded once, they don't move
+	GpuCulling(VulkanInitializer* vulkanInitializer, const AssetPack* assetPack, const std::vector<CullObject>& objects, uint32_t instancesPerObjectCount, uint32_t framesInFlight) {
+		m_vulkanInitializer = vulkanInitializer;
+		objectCount = static_cast<uint32_t>(objects.size());
+		instancesPerObject = instancesPerObjectCount;
+
+		if (m_vulkanInitializer->IsDeviceExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+				vkGetDeviceProcAddr(m_vulkanInitializer->device, "vkCmdDrawIndexedIndirectCountKHR"));
+		}
+		if (cmdDrawIndexedIndirectCount) {
+			drawMode = DrawMode::IndirectCount;
+		}
+		else if (m_vulkanInitializer->enabledFeatures.multiDrawIndirect) {
+			drawMode = DrawMode::MultiDrawIndirect;
+		}
+		else {
+			std::cout << "gpu culling: no indirect count nor multi draw indirect, one indirect draw per object" << std::endl;
+		}
+
+		VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+		commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		commandPoolCreateInfo.queueFamilyIndex = m_vulkanInitializer->getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT);
+		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		ASSERT(vkCreateCommandPool(m_vulkanInitializer->device, &commandPoolCreateInfo, nullptr, &commandPool), "failed to create culling command pool.");
+
+		UploadObjects(objects);
+
+		VkDeviceSize slotCount = std::max(objectCount, 1u);
+		frames.resize(framesInFlight);
+		for (FrameBuffers& frame : frames) {
+			m_vulkanInitializer->CreateBuffer(slotCount * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands, frame.commandsMemory);
+			m_vulkanInitializer->CreateBuffer(slotCount * instancesPerObject * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.instances, frame.instancesMemory);
+			m_vulkanInitializer->CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.count, frame.countMemory);
+			m_vulkanInitializer->CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.readback, frame.readbackMemory);
+
+			void* mapped = nullptr;
+			ASSERT(vkMapMemory(m_vulkanInitializer->device, frame.readbackMemory, 0, VK_WHOLE_SIZE, 0, &mapped));
+			frame.readbackMapped = static_cast<uint32_t*>(mapped);
+			*frame.readbackMapped = 0;
+		}
+
+		CreateDescriptors();
+		CreatePipelineLayout();
+		pipeline = CreatePipeline(assetPack);
+	}
+	~GpuCulling() {
+		vkDestroyPipeline(m_vulkanInitializer->device, pipeline, nullptr);
+		vkDestroyPipelineLayout(m_vulkanInitializer->device, pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_vulkanInitializer->device, descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(m_vulkanInitializer->device, descriptorSetLayout, nullptr);
+
+		for (FrameBuffers& frame : frames) {
+			vkUnmapMemory(m_vulkanInitializer->device, frame.readbackMemory);
+			m_vulkanInitializer->DestroyBuffer(frame.readback, frame.readbackMemory);
+			m_vulkanInitializer->DestroyBuffer(frame.count, frame.countMemory);
+			m_vulkanInitializer->DestroyBuffer(frame.instances, frame.instancesMemory);
+			m_vulkanInitializer->DestroyBuffer(frame.commands, frame.commandsMemory);
+		}
+		m_vulkanInitializer->DestroyBuffer(objectBuffer, objectMemory);
+
+		vkDestroyCommandPool(m_vulkanInitializer->device, commandPool, nullptr);
+	}
+
+	/*
+		outside of a render pass, before the draws of the same frame. The fence of the frame slot
+		has to be waited already, the buffers of the slot are overwritten
+	*/
+	void RecordCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::vec4* views, uint32_t viewCount) {
+		FrameBuffers& frame = frames[frameIndex];
+		visibleObjects = *frame.readbackMapped;
+
+		vkCmdFillBuffer(commandBuffer, frame.count, 0, sizeof(uint32_t), 0);
+		if (drawMode != DrawMode::IndirectCount) {
+			// every slot is drawn, the ones the compute pass doesn't write have to stay empty
+			vkCmdFillBuffer(commandBuffer, frame.commands, 0, VK_WHOLE_SIZE, 0);
+		}
+
+		BufferBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		PushConstants pushConstants = {};
+		for (uint32_t view = 0; view < std::min(viewCount, maxViews); view++) {
+			pushConstants.views[view] = views[view];
+		}
+		pushConstants.objectCount = objectCount;
+		pushConstants.viewCount = std::min(viewCount, maxViews);
+		pushConstants.instancesPerObject = instancesPerObject;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (objectCount + workgroupSize - 1) / workgroupSize, 1, 1);
+
+		BufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		VkBufferCopy region = {};
+		region.size = sizeof(uint32_t);
+		vkCmdCopyBuffer(commandBuffer, frame.count, frame.readback, 1, &region);
+
+		// read once the fence of the frame slot comes back
+		BufferBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+	}
+
+	// inside the render pass, with the pipeline and the mesh buffers already bound
+	void RecordDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t instanceBinding) {
+		FrameBuffers& frame = frames[frameIndex];
+
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, instanceBinding, 1, &frame.instances, &offset);
+
+		uint32_t stride = static_cast<uint32_t>(sizeof(VkDrawIndexedIndirectCommand));
+		switch (drawMode) {
+		case DrawMode::IndirectCount:
+			cmdDrawIndexedIndirectCount(commandBuffer, frame.commands, 0, frame.count, 0, objectCount, stride);
+			break;
+		case DrawMode::MultiDrawIndirect:
+			vkCmdDrawIndexedIndirect(commandBuffer, frame.commands, 0, objectCount, stride);
+			break;
+		case DrawMode::IndirectPerSlot:
+			for (uint32_t slot = 0; slot < objectCount; slot++) {
+				vkCmdDrawIndexedIndirect(commandBuffer, frame.commands, static_cast<VkDeviceSize>(slot) * stride, 1, stride);
+			}
+			break;
+		}
+	}
+
+	static const char* DrawModeName(DrawMode mode) {
+		switch (mode) {
+		case DrawMode::IndirectCount: return "indirect count";
+		case DrawMode::MultiDrawIndirect: return "multi draw indirect";
+		default: return "indirect per object";
+		}
+	}
+
+	// any thread, the shader hot reload builds a new one while the old one is still in use
+	VkPipeline CreatePipeline(const AssetPack* assetPack) {
+		std::vector<char> shaderStorage;
+		ByteSpan shaderCode = loadShaderCode(assetPack, "../Shaders/cull.spv", shaderStorage);
+		VkShaderModule shaderModule = createShaderModule(m_vulkanInitializer->device, shaderCode);
+
+		VkComputePipelineCreateInfo pipelineCreateInfo = {};
+		pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineCreateInfo.stage.module = shaderModule;
+		pipelineCreateInfo.stage.pName = "main";
+		pipelineCreateInfo.layout = pipelineLayout;
+
+		VkPipeline computePipeline = VK_NULL_HANDLE;
+		ASSERT(vkCreateComputePipelines(m_vulkanInitializer->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &computePipeline), "failed to create culling pipeline.");
+
+		vkDestroyShaderModule(m_vulkanInitializer->device, shaderModule, nullptr);
+
+		return computePipeline;
+	}
+
+private:
+	// the one barrier covers every buffer of the pass, there is nothing else in flight between them
+	static void BufferBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstAccessMask = dstAccessMask;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// read by every frame, so it lives in device memory and goes through a staging copy
+	void UploadObjects(const std::vector<CullObject>& objects) {
+		VkDeviceSize size = std::max<VkDeviceSize>(objects.size(), 1) * sizeof(CullObject);
+		m_vulkanInitializer->CreateBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, objectBuffer, objectMemory);
+
+		if (objects.empty()) {
+			return;
+		}
+
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+		m_vulkanInitializer->CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+
+		void* data = nullptr;
+		ASSERT(vkMapMemory(m_vulkanInitializer->device, stagingMemory, 0, size, 0, &data));
+		std::memcpy(data, objects.data(), objects.size() * sizeof(CullObject));
+		vkUnmapMemory(m_vulkanInitializer->device, stagingMemory);
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		BeginOneTimeCommandBuffer(m_vulkanInitializer->device, commandPool, commandBuffer);
+
+		VkBufferCopy region = {};
+		region.size = size;
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, objectBuffer, 1, &region);
+
+		EndOneTimeCommandBuffer(m_vulkanInitializer->device, m_vulkanInitializer->queue, commandPool, commandBuffer);
+
+		m_vulkanInitializer->DestroyBuffer(stagingBuffer, stagingMemory);
+	}
+
+	void CreateDescriptors() {
+		// objects, draw commands, instances, draw count
+		std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		ASSERT(vkCreateDescriptorSetLayout(m_vulkanInitializer->device, &layoutInfo, nullptr, &descriptorSetLayout), "failed to create culling descriptor set layout.");
+
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = static_cast<uint32_t>(bindings.size() * frames.size());
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = static_cast<uint32_t>(frames.size());
+
+		ASSERT(vkCreateDescriptorPool(m_vulkanInitializer->device, &poolInfo, nullptr, &descriptorPool), "failed to create culling descriptor pool.");
+
+		for (FrameBuffers& frame : frames) {
+			VkDescriptorSetAllocateInfo allocInfo = {};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = descriptorPool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &descriptorSetLayout;
+
+			ASSERT(vkAllocateDescriptorSets(m_vulkanInitializer->device, &allocInfo, &frame.descriptorSet), "failed to allocate culling descriptor set.");
+
+			std::array<VkDescriptorBufferInfo, 4> bufferInfos = {};
+			bufferInfos[0] = { objectBuffer, 0, VK_WHOLE_SIZE };
+			bufferInfos[1] = { frame.commands, 0, VK_WHOLE_SIZE };
+			bufferInfos[2] = { frame.instances, 0, VK_WHOLE_SIZE };
+			bufferInfos[3] = { frame.count, 0, VK_WHOLE_SIZE };
+
+			std::array<VkWriteDescriptorSet, 4> writes = {};
+			for (uint32_t i = 0; i < writes.size(); i++) {
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = frame.descriptorSet;
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[i].pBufferInfo = &bufferInfos[i];
+			}
+
+			vkUpdateDescriptorSets(m_vulkanInitializer->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	void CreatePipelineLayout() {
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+		pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+		ASSERT(vkCreatePipelineLayout(m_vulkanInitializer->device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout), "failed to create culling pipeline layout.");
+	}
+};
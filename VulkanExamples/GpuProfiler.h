@@ -0,0 +1,137 @@
+/*
+	GPU timestamps around the passes recorded in a command buffer.
+
+	Every command buffer slot owns its own range of queries, so the results of a slot
+	can be read back without stalling as soon as the fence of its last submission has signaled.
+*/
+#pragma once
+
+#include <vector>
+
+#include "VulkanInitializer.h"
+
+class GpuProfiler {
+public:
+	VulkanInitializer* m_vulkanInitializer;
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	uint32_t slotCount = 0;
+	uint32_t scopeCount = 0;
+
+	// nanoseconds per timestamp tick and the bits the queue actually writes
+	float timestampPeriod = 1.0f;
+	uint64_t timestampMask = 0;
+
+	// scopes written at least once in each slot, bit per scope. A scope that was reset and not written
+	// again reads as unavailable and keeps its last duration, so passes may be skipped or replayed from
+	// a command buffer recorded in an earlier frame
+	std::vector<uint32_t> writtenScopes = {};
+	// last collected duration of each scope
+	std::vector<float> scopeMilliseconds = {};
+
+	GpuProfiler(VulkanInitializer* vulkanInitializer, uint32_t slots, uint32_t scopes) {
+		m_vulkanInitializer = vulkanInitializer;
+		slotCount = slots;
+		scopeCount = scopes;
+
+		writtenScopes.resize(slotCount, 0);
+		scopeMilliseconds.resize(scopeCount, 0.0f);
+
+		VkPhysicalDeviceProperties properties = {};
+		vkGetPhysicalDeviceProperties(m_vulkanInitializer->physicalDevice, &properties);
+		timestampPeriod = properties.limits.timestampPeriod;
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(m_vulkanInitializer->physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(m_vulkanInitializer->physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		uint32_t validBits = queueFamilies[m_vulkanInitializer->getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT)].timestampValidBits;
+		if (validBits == 0) {
+			std::cout << "graphics queue doesn't support timestamps, GPU timings disabled" << std::endl;
+			return;
+		}
+		timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t(1) << validBits) - 1);
+
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		// begin and end timestamp per scope
+		queryPoolCreateInfo.queryCount = slotCount * scopeCount * 2;
+
+		ASSERT(vkCreateQueryPool(m_vulkanInitializer->device, &queryPoolCreateInfo, nullptr, &queryPool), "failed to create timestamp query pool");
+	}
+	~GpuProfiler() {
+		vkDestroyQueryPool(m_vulkanInitializer->device, queryPool, nullptr);
+	}
+
+	bool IsSupported() {
+		return queryPool != VK_NULL_HANDLE;
+	}
+
+	// must be called once the last submission of the slot has finished
+	void CollectResults(uint32_t slot) {
+		if (!IsSupported()) {
+			return;
+		}
+
+		for (uint32_t scope = 0; scope < scopeCount; scope++) {
+			if ((writtenScopes[slot] & (1u << scope)) == 0) {
+				continue;
+			}
+
+			// timestamp and availability for begin and end
+			uint64_t results[4] = {};
+			VkResult res = vkGetQueryPoolResults(
+				m_vulkanInitializer->device,
+				queryPool,
+				QueryIndex(slot, scope),
+				2,
+				sizeof(results),
+				results,
+				sizeof(uint64_t) * 2,
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+			if (res != VK_SUCCESS || results[1] == 0 || results[3] == 0) {
+				continue;
+			}
+
+			uint64_t ticks = ((results[2] & timestampMask) - (results[0] & timestampMask)) & timestampMask;
+			scopeMilliseconds[scope] = static_cast<float>(ticks * timestampPeriod / 1000000.0);
+		}
+	}
+
+	// resets the queries of the slot, has to be recorded outside of a render pass
+	void BeginFrame(VkCommandBuffer commandBuffer, uint32_t slot) {
+		if (!IsSupported()) {
+			return;
+		}
+
+		vkCmdResetQueryPool(commandBuffer, queryPool, QueryIndex(slot, 0), scopeCount * 2);
+	}
+
+	void BeginScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope) {
+		if (!IsSupported()) {
+			return;
+		}
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, QueryIndex(slot, scope));
+	}
+
+	void EndScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope) {
+		if (!IsSupported()) {
+			return;
+		}
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, QueryIndex(slot, scope) + 1);
+		writtenScopes[slot] |= 1u << scope;
+	}
+
+	float GetScopeMilliseconds(uint32_t scope) {
+		return scopeMilliseconds[scope];
+	}
+
+	uint32_t QueryIndex(uint32_t slot, uint32_t scope) {
+		return (slot * scopeCount + scope) * 2;
+	}
+};
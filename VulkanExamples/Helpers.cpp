@@ -1,9 +1,12 @@
+#pragma once
+
 #include <vector>
 #include <fstream>
 
 #include <vulkan/vulkan.h>
 
 #include "VulkanInitializer.h"
+#include "AssetPack.h"
 
 static std::vector<char> readShaderFile(const std::string& fileName) {
 	std::ifstream file(fileName, std::ios::ate | std::ios::binary);
@@ -24,12 +27,27 @@ static std::vector<char> readShaderFile(const std::string& fileName) {
 	return buffer;
 }
 
-static VkShaderModule createShaderModule(VkDevice device, std::vector<char> code) {
+// shader code from the asset pack when it has it, otherwise read from disk into storage
+static ByteSpan loadShaderCode(const AssetPack* assetPack, const std::string& fileName, std::vector<char>& storage) {
+	if (assetPack) {
+		ByteSpan code = assetPack->Find(fileName);
+		if (!code.Empty()) {
+			return code;
+		}
+	}
+
+	storage = readShaderFile(fileName);
+
+	return ByteSpan{ reinterpret_cast<const uint8_t*>(storage.data()), storage.size() };
+}
+
+// code has to be 4 byte aligned, pack entries and vector allocations are
+static VkShaderModule createShaderModule(VkDevice device, ByteSpan code) {
 	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
 	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 
-	shaderModuleCreateInfo.codeSize = code.size();
-	shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(code.data());
+	shaderModuleCreateInfo.codeSize = code.size;
+	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data);
 
 	VkShaderModule shaderModule;
 	ASSERT(vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule), "failed to create shader module");
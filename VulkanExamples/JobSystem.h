@@ -0,0 +1,405 @@
+/*
+	work stealing job system.
+
+	Every worker owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom without
+	locks while idle workers steal from the top of the others. Threads outside the pool hand
+	their jobs over through a small locked queue. Completion is tracked with counters, a job
+	can be held back until a counter reaches zero, and waiting on a counter runs other jobs
+	instead of blocking, so jobs can wait on the jobs they spawned. ParallelFor doesn't, its
+	caller only runs ranges of its own loop.
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+
+// number of unfinished jobs attached to it, plus the jobs waiting for it to reach zero
+struct JobCounter {
+	std::atomic<int32_t> value = { 0 };
+	// jobs between their decrement and the hand over of the continuations, the counter has to outlive them
+	std::atomic<int32_t> finishing = { 0 };
+
+	std::mutex mutex;
+	std::vector<Job*> continuations;
+	// first exception thrown by one of the jobs, rethrown by the wait
+	std::exception_ptr exception;
+
+	bool IsDone() const {
+		return value.load(std::memory_order_acquire) == 0 && finishing.load(std::memory_order_acquire) == 0;
+	}
+};
+
+struct Job {
+	std::function<void()> function;
+	JobCounter* counter = nullptr;
+};
+
+// single owner, multiple thieves. Fixed capacity, a full deque makes the owner run the job inline
+class WorkStealingDeque {
+public:
+	std::vector<std::atomic<Job*>> buffer;
+	int64_t mask = 0;
+
+	std::atomic<int64_t> top = { 0 };
+	std::atomic<int64_t> bottom = { 0 };
+
+	WorkStealingDeque(size_t capacity = 4096) : buffer(capacity) {
+		mask = static_cast<int64_t>(capacity) - 1;
+	}
+
+	// owner only
+	bool Push(Job* job) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t > mask) {
+			return false;
+		}
+
+		buffer[b & mask].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// owner only, newest job first
+	Job* Pop() {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_seq_cst);
+
+		if (t > b) {
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = buffer[b & mask].load(std::memory_order_relaxed);
+		if (t == b) {
+			// last job, race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				job = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	// any thread, oldest job first
+	Job* Steal() {
+		int64_t t = top.load(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_seq_cst);
+		if (t >= b) {
+			return nullptr;
+		}
+
+		Job* job = buffer[t & mask].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+
+		return job;
+	}
+};
+
+class JobSystem {
+public:
+	struct Worker {
+		WorkStealingDeque deque;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// jobs coming from threads outside the pool
+	std::mutex injectionMutex;
+	std::deque<Job*> injectionQueue;
+
+	// idle workers sleep until a job is queued
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	std::atomic<uint32_t> queuedJobs = { 0 };
+	std::atomic<uint32_t> sleepingWorkers = { 0 };
+	// failed steal rounds before a worker goes to sleep
+	uint32_t spinRounds = 64;
+
+	std::atomic<bool> running = { false };
+
+	// 0 workers means one per core, leaving a core to the thread that owns the system. The
+	// owner still takes part in the work while it waits on a counter. There is always one
+	// worker, a job nobody waits for would never run otherwise
+	JobSystem(uint32_t workerCount = 0) {
+		if (workerCount == 0) {
+			workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+		}
+
+		running = true;
+
+		workers.resize(workerCount);
+		for (auto& worker : workers) {
+			worker = std::make_unique<Worker>();
+		}
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers[i]->thread = std::thread(&JobSystem::WorkerLoop, this, static_cast<int32_t>(i));
+		}
+	}
+	~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running = false;
+		}
+		sleepCondition.notify_all();
+
+		for (auto& worker : workers) {
+			worker->thread.join();
+		}
+
+		// nobody waits on whatever is left
+		for (Job* job : injectionQueue) {
+			delete job;
+		}
+	}
+
+	uint32_t GetWorkerCount() const {
+		return static_cast<uint32_t>(workers.size());
+	}
+
+	// pool the calling thread works for, -1 outside of any pool
+	struct ThreadContext {
+		JobSystem* owner = nullptr;
+		int32_t workerIndex = -1;
+	};
+
+	static ThreadContext& CurrentThread() {
+		static thread_local ThreadContext context;
+		return context;
+	}
+
+	int32_t CurrentWorkerIndex() const {
+		ThreadContext& context = CurrentThread();
+		return context.owner == this ? context.workerIndex : -1;
+	}
+
+	// queues the function, after dependency reaches zero when one is given
+	void Run(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr) {
+		Job* job = new Job();
+		job->function = std::move(function);
+		job->counter = counter;
+
+		if (counter) {
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if (dependency) {
+			// the job finishing the dependency takes the continuations under the same lock
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (dependency->value.load(std::memory_order_acquire) != 0) {
+				dependency->continuations.push_back(job);
+				return;
+			}
+		}
+
+		Schedule(job);
+	}
+
+	/*
+		splits [0, count) in ranges of grainSize and calls function(begin, end) on each of them.
+		The caller and a few helper jobs take the ranges from a shared index, so the caller only
+		runs ranges of this loop and only waits for the ones already taken by a helper. Wait would
+		run whatever job comes next instead, a pipeline build or a texture decode on the render
+		thread in the middle of a frame
+	*/
+	template <typename Function>
+	void ParallelFor(uint32_t count, uint32_t grainSize, Function function) {
+		grainSize = std::max(grainSize, 1u);
+		uint32_t rangeCount = (count + grainSize - 1) / grainSize;
+
+		// shared with the helpers, one that starts after the loop is done only looks at nextRange
+		struct Ranges {
+			std::atomic<uint32_t> nextRange = { 0 };
+			std::atomic<uint32_t> finishedRanges = { 0 };
+			std::mutex mutex;
+			std::exception_ptr exception;
+		};
+		auto ranges = std::make_shared<Ranges>();
+
+		auto runRanges = [ranges, rangeCount, count, grainSize, &function] {
+			for (uint32_t range = ranges->nextRange.fetch_add(1); range < rangeCount; range = ranges->nextRange.fetch_add(1)) {
+				uint32_t begin = range * grainSize;
+				try {
+					function(begin, std::min(count, begin + grainSize));
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(ranges->mutex);
+					if (!ranges->exception) {
+						ranges->exception = std::current_exception();
+					}
+				}
+				ranges->finishedRanges.fetch_add(1, std::memory_order_acq_rel);
+			}
+		};
+
+		uint32_t helperCount = std::min(rangeCount > 0 ? rangeCount - 1 : 0, GetWorkerCount());
+		for (uint32_t i = 0; i < helperCount; i++) {
+			Run(runRanges);
+		}
+
+		runRanges();
+		while (ranges->finishedRanges.load(std::memory_order_acquire) < rangeCount) {
+			std::this_thread::yield();
+		}
+
+		if (ranges->exception) {
+			std::rethrow_exception(ranges->exception);
+		}
+	}
+
+	// runs other jobs until the counter reaches zero
+	void Wait(JobCounter& counter) {
+		int32_t workerIndex = CurrentWorkerIndex();
+
+		while (!counter.IsDone()) {
+			Job* job = FindJob(workerIndex);
+			if (job) {
+				Execute(job);
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+
+		std::exception_ptr exception;
+		{
+			std::lock_guard<std::mutex> lock(counter.mutex);
+			std::swap(exception, counter.exception);
+		}
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
+	void Schedule(Job* job) {
+		int32_t workerIndex = CurrentWorkerIndex();
+
+		if (workerIndex >= 0) {
+			if (!workers[workerIndex]->deque.Push(job)) {
+				// deque full, running it here is still correct and keeps the memory bounded
+				Execute(job);
+				return;
+			}
+		}
+		else {
+			// without workers the caller runs it when it waits
+			std::lock_guard<std::mutex> lock(injectionMutex);
+			injectionQueue.push_back(job);
+		}
+
+		queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+		if (sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			sleepCondition.notify_one();
+		}
+	}
+
+	Job* FindJob(int32_t workerIndex) {
+		Job* job = nullptr;
+
+		if (workerIndex >= 0) {
+			job = workers[workerIndex]->deque.Pop();
+		}
+
+		// steal from the others, starting next to ourselves so thieves spread out
+		uint32_t workerCount = GetWorkerCount();
+		for (uint32_t i = 1; !job && i <= workerCount; i++) {
+			uint32_t victim = (workerIndex + i) % workerCount;
+			if (static_cast<int32_t>(victim) != workerIndex) {
+				job = workers[victim]->deque.Steal();
+			}
+		}
+
+		if (!job) {
+			std::lock_guard<std::mutex> lock(injectionMutex);
+			if (!injectionQueue.empty()) {
+				job = injectionQueue.front();
+				injectionQueue.pop_front();
+			}
+		}
+
+		if (job) {
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	void Execute(Job* job) {
+		try {
+			job->function();
+		}
+		catch (...) {
+			if (job->counter) {
+				std::lock_guard<std::mutex> lock(job->counter->mutex);
+				if (!job->counter->exception) {
+					job->counter->exception = std::current_exception();
+				}
+			}
+		}
+
+		JobCounter* counter = job->counter;
+		delete job;
+
+		if (!counter) {
+			return;
+		}
+
+		counter->finishing.fetch_add(1, std::memory_order_acq_rel);
+		if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			// release the jobs that were waiting on this counter
+			std::vector<Job*> continuations;
+			{
+				std::lock_guard<std::mutex> lock(counter->mutex);
+				std::swap(continuations, counter->continuations);
+			}
+			for (Job* continuation : continuations) {
+				Schedule(continuation);
+			}
+		}
+		counter->finishing.fetch_sub(1, std::memory_order_release);
+	}
+
+	void WorkerLoop(int32_t workerIndex) {
+		CurrentThread().owner = this;
+		CurrentThread().workerIndex = workerIndex;
+
+		uint32_t idleRounds = 0;
+		while (running) {
+			Job* job = FindJob(workerIndex);
+			if (job) {
+				Execute(job);
+				idleRounds = 0;
+				continue;
+			}
+
+			if (++idleRounds < spinRounds) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+			sleepCondition.wait(lock, [this] { return !running || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+			sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+			idleRounds = 0;
+		}
+	}
+};
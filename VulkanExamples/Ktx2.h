@@ -0,0 +1,112 @@
+/*
+	reader for KTX2 containers holding a single 2D texture.
+
+	Only files without supercompression are supported, so every level can be handed to the GPU
+	as it is stored. The levels point into the file data, nothing is copied.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ByteSpan.h"
+#include "TextureTranscoder.h"
+
+struct Ktx2Level {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	ByteSpan data;
+};
+
+struct Ktx2Texture {
+	const TextureTranscoder::FormatInfo* format = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// level 0 first
+	std::vector<Ktx2Level> levels;
+};
+
+namespace Ktx2 {
+
+	static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	// identifier, 9 header fields, the data format, key value and supercompression indices
+	static const size_t headerSize = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+	static const size_t levelIndexEntrySize = 3 * 8;
+
+	static inline uint32_t Read32(const uint8_t* bytes) {
+		return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+	}
+
+	static inline uint64_t Read64(const uint8_t* bytes) {
+		return Read32(bytes) | (static_cast<uint64_t>(Read32(bytes + 4)) << 32);
+	}
+
+	static inline bool IsKtx2(ByteSpan file) {
+		return file.size >= sizeof(identifier) && std::memcmp(file.data, identifier, sizeof(identifier)) == 0;
+	}
+
+	// false with the reason in error when the file can't be used
+	static bool Parse(ByteSpan file, Ktx2Texture& texture, std::string& error) {
+		if (file.size < headerSize || !IsKtx2(file)) {
+			error = "not a KTX2 file";
+			return false;
+		}
+
+		const uint8_t* header = file.data + sizeof(identifier);
+		VkFormat vkFormat = static_cast<VkFormat>(Read32(header + 0));
+		uint32_t pixelWidth = Read32(header + 8);
+		uint32_t pixelHeight = Read32(header + 12);
+		uint32_t pixelDepth = Read32(header + 16);
+		uint32_t layerCount = Read32(header + 20);
+		uint32_t faceCount = Read32(header + 24);
+		uint32_t levelCount = Read32(header + 28);
+		uint32_t supercompressionScheme = Read32(header + 32);
+
+		texture.format = TextureTranscoder::FindFormat(vkFormat);
+		if (!texture.format) {
+			error = "unsupported format " + std::to_string(vkFormat);
+			return false;
+		}
+		if (pixelWidth == 0 || pixelHeight == 0 || pixelDepth > 1 || layerCount > 1 || faceCount != 1) {
+			error = "only single 2D textures are supported";
+			return false;
+		}
+		if (supercompressionScheme != 0) {
+			error = "supercompressed files are not supported";
+			return false;
+		}
+
+		// 0 asks the loader to generate the mips, the base level is all there is
+		levelCount = std::max(levelCount, 1u);
+		if (levelCount > 32 || file.size < headerSize + levelCount * levelIndexEntrySize) {
+			error = "truncated level index";
+			return false;
+		}
+
+		texture.width = pixelWidth;
+		texture.height = pixelHeight;
+		texture.levels.resize(levelCount);
+
+		for (uint32_t level = 0; level < levelCount; level++) {
+			const uint8_t* entry = file.data + headerSize + level * levelIndexEntrySize;
+			uint64_t byteOffset = Read64(entry);
+			uint64_t byteLength = Read64(entry + 8);
+
+			Ktx2Level& ktxLevel = texture.levels[level];
+			ktxLevel.width = std::max(1u, pixelWidth >> level);
+			ktxLevel.height = std::max(1u, pixelHeight >> level);
+			ktxLevel.data = file.Sub(static_cast<size_t>(byteOffset), static_cast<size_t>(byteLength));
+
+			if (ktxLevel.data.Empty() || ktxLevel.data.size < TextureTranscoder::LevelSize(*texture.format, ktxLevel.width, ktxLevel.height)) {
+				error = "level " + std::to_string(level) + " is out of the file or too short";
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,311 @@
+/*
+	2D point lights, culled against screen tiles in a compute pass so every pixel of the lit
+	offscreen shader only loops over the lights reaching its tile.
+
+	The render area is split in tiles of tileSize pixels. One workgroup per tile turns its
+	rectangle back into scene coordinates, tests every light circle against it and writes the
+	indices of the ones touching it into the tile buffer:
+		tile i, tileStride uints: light count | index | index | ...
+	A tile keeps maxLightsPerTile lights, the ones past that are dropped from it.
+
+	The lights move every frame, the CPU writes them into a buffer of the frame slot. Without
+	tiling the compute pass is skipped and the shader loops over every light, to measure what
+	the tiles save.
+
+	The tiles are built with the camera of the first view, the other views are lit with them too.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "VulkanInitializer.h"
+#include "Helpers.cpp"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+struct LightCullingSettings {
+	// point lights moving over the scene, 0 leaves the scene unlit
+	uint32_t lightCount = 0;
+	// cull the lights per tile, otherwise every pixel loops over all of them
+	bool tiled = true;
+};
+
+// laid out like the Light struct of lights.comp and shader_offscreen.frag
+struct PointLight {
+	glm::vec2 position;
+	float radius;
+	float intensity;
+	glm::vec4 color;
+};
+
+class LightCulling {
+public:
+	// have to match lights.comp and shader_offscreen.frag
+	static const uint32_t tileSize = 16;
+	static const uint32_t tileStride = 64;
+	static const uint32_t maxLightsPerTile = tileStride - 1;
+	// has to match local_size_x of lights.comp
+	static const uint32_t workgroupSize = 64;
+
+	struct PushConstants {
+		// camera of the first view, scale in xy and offset in zw
+		glm::vec4 view;
+		glm::vec2 renderSize;
+		uint32_t lightCount;
+		uint32_t tileCountX;
+	};
+
+	// where a light moves around, its position is recomputed every frame
+	struct LightPath {
+		glm::vec2 center;
+		float orbit;
+		float speed;
+		float phase;
+	};
+
+	struct FrameBuffers {
+		// written by the CPU every frame
+		VkBuffer lights = VK_NULL_HANDLE;
+		VkDeviceMemory lightsMemory = VK_NULL_HANDLE;
+		PointLight* lightsMapped = nullptr;
+
+		VkBuffer tiles = VK_NULL_HANDLE;
+		VkDeviceMemory tilesMemory = VK_NULL_HANDLE;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	VulkanInitializer* m_vulkanInitializer;
+	LightCullingSettings m_settings = {};
+
+	std::vector<PointLight> lights;
+	std::vector<LightPath> paths;
+	std::vector<FrameBuffers> frames;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	// read by the compute pass and by the lit offscreen shader, set 1 of the offscreen pipeline
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	// the tile buffers are sized for the biggest render extent, the lights are spread over the scene bounds
+	LightCulling(VulkanInitializer* vulkanInitializer, const AssetPack* assetPack, uint32_t framesInFlight, VkExtent2D maxExtent, glm::vec4 sceneBounds, LightCullingSettings settings) {
+		m_vulkanInitializer = vulkanInitializer;
+		m_settings = settings;
+
+		CreateLights(sceneBounds);
+
+		VkDeviceSize tileCount = static_cast<VkDeviceSize>(GetTileCount(maxExtent.width)) * GetTileCount(maxExtent.height);
+		frames.resize(framesInFlight);
+		for (FrameBuffers& frame : frames) {
+			m_vulkanInitializer->CreateBuffer(std::max<VkDeviceSize>(lights.size(), 1) * sizeof(PointLight), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.lights, frame.lightsMemory);
+			m_vulkanInitializer->CreateBuffer(tileCount * tileStride * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.tiles, frame.tilesMemory);
+
+			void* mapped = nullptr;
+			ASSERT(vkMapMemory(m_vulkanInitializer->device, frame.lightsMemory, 0, VK_WHOLE_SIZE, 0, &mapped));
+			frame.lightsMapped = static_cast<PointLight*>(mapped);
+		}
+
+		CreateDescriptors();
+		CreatePipelineLayout();
+		pipeline = CreatePipeline(assetPack);
+	}
+	~LightCulling() {
+		vkDestroyPipeline(m_vulkanInitializer->device, pipeline, nullptr);
+		vkDestroyPipelineLayout(m_vulkanInitializer->device, pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_vulkanInitializer->device, descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(m_vulkanInitializer->device, descriptorSetLayout, nullptr);
+
+		for (FrameBuffers& frame : frames) {
+			vkUnmapMemory(m_vulkanInitializer->device, frame.lightsMemory);
+			m_vulkanInitializer->DestroyBuffer(frame.lights, frame.lightsMemory);
+			m_vulkanInitializer->DestroyBuffer(frame.tiles, frame.tilesMemory);
+		}
+	}
+
+	static uint32_t GetTileCount(uint32_t pixels) {
+		return std::max((pixels + tileSize - 1) / tileSize, 1u);
+	}
+
+	uint32_t GetLightCount() const {
+		return static_cast<uint32_t>(lights.size());
+	}
+
+	VkDescriptorSet GetDescriptorSet(uint32_t frameIndex) const {
+		return frames[frameIndex].descriptorSet;
+	}
+
+	/*
+		outside of a render pass, before the lit draws of the same frame. The fence of the frame
+		slot has to be waited already, its lights are overwritten
+	*/
+	void RecordCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::vec4& view, VkExtent2D renderExtent) {
+		FrameBuffers& frame = frames[frameIndex];
+
+		float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		for (size_t i = 0; i < lights.size(); i++) {
+			const LightPath& path = paths[i];
+			float angle = path.phase + path.speed * time;
+			lights[i].position = path.center + glm::vec2(std::cos(angle), std::sin(angle)) * path.orbit;
+		}
+		std::copy(lights.begin(), lights.end(), frame.lightsMapped);
+
+		if (!m_settings.tiled) {
+			return;
+		}
+
+		PushConstants pushConstants = {};
+		pushConstants.view = view;
+		pushConstants.renderSize = glm::vec2(static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height));
+		pushConstants.lightCount = GetLightCount();
+		pushConstants.tileCountX = GetTileCount(renderExtent.width);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, GetTileCount(renderExtent.width), GetTileCount(renderExtent.height), 1);
+
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// any thread, the shader hot reload builds a new one while the old one is still in use
+	VkPipeline CreatePipeline(const AssetPack* assetPack) {
+		std::vector<char> shaderStorage;
+		ByteSpan shaderCode = loadShaderCode(assetPack, "../Shaders/lights.spv", shaderStorage);
+		VkShaderModule shaderModule = createShaderModule(m_vulkanInitializer->device, shaderCode);
+
+		VkComputePipelineCreateInfo pipelineCreateInfo = {};
+		pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineCreateInfo.stage.module = shaderModule;
+		pipelineCreateInfo.stage.pName = "main";
+		pipelineCreateInfo.layout = pipelineLayout;
+
+		VkPipeline computePipeline = VK_NULL_HANDLE;
+		ASSERT(vkCreateComputePipelines(m_vulkanInitializer->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &computePipeline), "failed to create light culling pipeline.");
+
+		vkDestroyShaderModule(m_vulkanInitializer->device, shaderModule, nullptr);
+
+		return computePipeline;
+	}
+
+private:
+	/*
+		scattered over the scene with a fixed seed. The radius shrinks as the count grows so a
+		point is reached by about the same number of lights whatever the count, more lights
+		means smaller ones and not a brighter scene
+	*/
+	void CreateLights(glm::vec4 sceneBounds) {
+		glm::vec2 low = glm::vec2(sceneBounds);
+		glm::vec2 high = glm::vec2(sceneBounds.z, sceneBounds.w);
+		glm::vec2 size = high - low;
+		float area = std::max(size.x * size.y, 0.0001f);
+		float radius = 1.5f * std::sqrt(area / std::max(m_settings.lightCount, 1u));
+
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		lights.resize(m_settings.lightCount);
+		paths.resize(m_settings.lightCount);
+		for (uint32_t i = 0; i < m_settings.lightCount; i++) {
+			PointLight& light = lights[i];
+			light.radius = radius * (0.75f + 0.5f * unit(random));
+			light.intensity = 0.6f + 0.4f * unit(random);
+			light.color = glm::vec4(0.5f + 0.5f * unit(random), 0.5f + 0.5f * unit(random), 0.5f + 0.5f * unit(random), 1.0f);
+
+			LightPath& path = paths[i];
+			path.center = low + glm::vec2(unit(random), unit(random)) * size;
+			path.orbit = light.radius * 0.5f;
+			path.speed = 0.5f + unit(random);
+			path.phase = unit(random) * 6.2831853f;
+			light.position = path.center;
+		}
+	}
+
+	void CreateDescriptors() {
+		// lights, tiles
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		ASSERT(vkCreateDescriptorSetLayout(m_vulkanInitializer->device, &layoutInfo, nullptr, &descriptorSetLayout), "failed to create light descriptor set layout.");
+
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = static_cast<uint32_t>(bindings.size() * frames.size());
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = static_cast<uint32_t>(frames.size());
+
+		ASSERT(vkCreateDescriptorPool(m_vulkanInitializer->device, &poolInfo, nullptr, &descriptorPool), "failed to create light descriptor pool.");
+
+		for (FrameBuffers& frame : frames) {
+			VkDescriptorSetAllocateInfo allocInfo = {};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = descriptorPool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &descriptorSetLayout;
+
+			ASSERT(vkAllocateDescriptorSets(m_vulkanInitializer->device, &allocInfo, &frame.descriptorSet), "failed to allocate light descriptor set.");
+
+			std::array<VkDescriptorBufferInfo, 2> bufferInfos = {};
+			bufferInfos[0] = { frame.lights, 0, VK_WHOLE_SIZE };
+			bufferInfos[1] = { frame.tiles, 0, VK_WHOLE_SIZE };
+
+			std::array<VkWriteDescriptorSet, 2> writes = {};
+			for (uint32_t i = 0; i < writes.size(); i++) {
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = frame.descriptorSet;
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[i].pBufferInfo = &bufferInfos[i];
+			}
+
+			vkUpdateDescriptorSets(m_vulkanInitializer->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	void CreatePipelineLayout() {
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+		pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+		ASSERT(vkCreatePipelineLayout(m_vulkanInitializer->device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout), "failed to create light culling pipeline layout.");
+	}
+};
@@ -0,0 +1,519 @@
+/*
+	particles simulated in compute shaders and drawn from the buffers they live in, the CPU only
+	records the dispatches and never sees a particle.
+
+	The particles are kept in two buffers used in turn. Every frame:
+		- simulate reads the particles alive in one buffer, ages and moves them, and appends the
+		  ones still alive to the other buffer, so the dead ones are dropped without a hole
+		- emit appends the new particles of the frame behind them
+		- finalize clamps the count to the capacity and writes the indirect draw of the frame and
+		  the indirect dispatch of the next one, which starts from this count
+	The draw is one instanced quad per particle, its vertex shader reads the particle buffer.
+
+	The particles are drawn with the camera of the first view. Multiview broadcasts them to every
+	layer, the layered views only get them in the first layer.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "VulkanInitializer.h"
+#include "Helpers.cpp"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+struct ParticleSystemSettings {
+	// particles that can be alive at once, 0 turns the particles off
+	uint32_t capacity = 0;
+	// seconds a particle lives at most, particles are emitted at capacity / lifetime per second
+	float lifetime = 2.0f;
+};
+
+// laid out like the Particle struct of particles.comp and particle.vert
+struct Particle {
+	glm::vec2 position;
+	glm::vec2 velocity;
+	float age;
+	float lifetime;
+	// RGBA8
+	uint32_t color;
+	float size;
+};
+
+// laid out like the State struct of particles.comp
+struct ParticleState {
+	// alive particles of each buffer
+	uint32_t aliveCount[2];
+	// VkDispatchIndirectCommand of the next simulate
+	uint32_t simulateGroups[3];
+	// VkDrawIndirectCommand of the particles written last
+	uint32_t vertexCount;
+	uint32_t instanceCount;
+	uint32_t firstVertex;
+	uint32_t firstInstance;
+};
+
+class ParticleSystem {
+public:
+	// has to match local_size_x of particles.comp
+	static const uint32_t workgroupSize = 64;
+	// the minimum maxComputeWorkGroupCount, invocations loop over what doesn't fit
+	static const uint32_t maxWorkgroups = 65535;
+
+	// the stage a compute pipeline runs, the STAGE specialization constant of particles.comp
+	enum Stage {
+		StageSimulate,
+		StageEmit,
+		StageFinalize,
+		StageCount
+	};
+
+	struct ComputePushConstants {
+		float deltaTime;
+		uint32_t emitCount;
+		uint32_t seed;
+		// buffer read by simulate, the other one is written
+		uint32_t source;
+		uint32_t capacity;
+		float lifetime;
+	};
+
+	struct DrawPushConstants {
+		// scale in xy and offset in zw
+		glm::vec4 view;
+	};
+
+	VulkanInitializer* m_vulkanInitializer;
+	ParticleSystemSettings m_settings = {};
+
+	uint32_t capacity = 0;
+
+	std::array<VkBuffer, 2> particleBuffers = {};
+	std::array<VkDeviceMemory, 2> particleMemories = {};
+	VkBuffer stateBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory stateMemory = VK_NULL_HANDLE;
+
+	// the alive count copied back for the stats, one per frame slot
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<VkDeviceMemory> readbackMemories;
+	std::vector<uint32_t*> readbackMapped;
+
+	// compute sets read one buffer and write the other, the draw sets read one
+	VkDescriptorSetLayout computeSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout drawSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	std::array<VkDescriptorSet, 2> computeSets = {};
+	std::array<VkDescriptorSet, 2> drawSets = {};
+
+	VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+	std::array<VkPipeline, StageCount> computePipelines = {};
+	VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline drawPipeline = VK_NULL_HANDLE;
+	// what the draw pipeline is built for, kept to build it again
+	VkRenderPass drawRenderPass = VK_NULL_HANDLE;
+	VkSampleCountFlagBits drawSampleCount = VK_SAMPLE_COUNT_1_BIT;
+
+	// buffer the particles of the last simulation were written to
+	uint32_t current = 0;
+	uint32_t seed = 0;
+	// fraction of a particle left over from the emission of the last frames
+	float emitRemainder = 0.0f;
+	bool stateCleared = false;
+	std::chrono::steady_clock::time_point lastSimulation = {};
+
+	// particles alive after the last frame that finished, read back with a frame of delay
+	uint32_t aliveParticles = 0;
+
+	// the draw pipeline is made for the render pass the particles are drawn in
+	ParticleSystem(VulkanInitializer* vulkanInitializer, const AssetPack* assetPack, VkRenderPass renderPass, VkSampleCountFlagBits sampleCount, uint32_t framesInFlight, ParticleSystemSettings settings) {
+		m_vulkanInitializer = vulkanInitializer;
+		m_settings = settings;
+		drawRenderPass = renderPass;
+		drawSampleCount = sampleCount;
+
+		// a storage buffer descriptor can't reach past maxStorageBufferRange
+		VkPhysicalDeviceProperties physicalDeviceProperties = {};
+		vkGetPhysicalDeviceProperties(m_vulkanInitializer->physicalDevice, &physicalDeviceProperties);
+		uint32_t maxCapacity = physicalDeviceProperties.limits.maxStorageBufferRange / sizeof(Particle);
+		capacity = std::max(std::min(m_settings.capacity, maxCapacity), 1u);
+		if (capacity < m_settings.capacity) {
+			std::cout << "particles: " << m_settings.capacity << " don't fit in a storage buffer, using " << capacity << std::endl;
+		}
+
+		for (uint32_t i = 0; i < 2; i++) {
+			m_vulkanInitializer->CreateBuffer(static_cast<VkDeviceSize>(capacity) * sizeof(Particle), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particleBuffers[i], particleMemories[i]);
+		}
+		m_vulkanInitializer->CreateBuffer(sizeof(ParticleState), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, stateBuffer, stateMemory);
+
+		readbackBuffers.resize(framesInFlight);
+		readbackMemories.resize(framesInFlight);
+		readbackMapped.resize(framesInFlight);
+		for (uint32_t i = 0; i < framesInFlight; i++) {
+			m_vulkanInitializer->CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffers[i], readbackMemories[i]);
+
+			void* mapped = nullptr;
+			ASSERT(vkMapMemory(m_vulkanInitializer->device, readbackMemories[i], 0, VK_WHOLE_SIZE, 0, &mapped));
+			readbackMapped[i] = static_cast<uint32_t*>(mapped);
+			*readbackMapped[i] = 0;
+		}
+
+		CreateDescriptors();
+		CreatePipelineLayouts();
+		computePipelines = CreateComputePipelines(assetPack);
+		drawPipeline = CreateDrawPipeline(assetPack);
+	}
+	~ParticleSystem() {
+		vkDestroyPipeline(m_vulkanInitializer->device, drawPipeline, nullptr);
+		vkDestroyPipelineLayout(m_vulkanInitializer->device, drawPipelineLayout, nullptr);
+		for (VkPipeline pipeline : computePipelines) {
+			vkDestroyPipeline(m_vulkanInitializer->device, pipeline, nullptr);
+		}
+		vkDestroyPipelineLayout(m_vulkanInitializer->device, computePipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_vulkanInitializer->device, descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(m_vulkanInitializer->device, drawSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(m_vulkanInitializer->device, computeSetLayout, nullptr);
+
+		for (size_t i = 0; i < readbackBuffers.size(); i++) {
+			vkUnmapMemory(m_vulkanInitializer->device, readbackMemories[i]);
+			m_vulkanInitializer->DestroyBuffer(readbackBuffers[i], readbackMemories[i]);
+		}
+		m_vulkanInitializer->DestroyBuffer(stateBuffer, stateMemory);
+		for (uint32_t i = 0; i < 2; i++) {
+			m_vulkanInitializer->DestroyBuffer(particleBuffers[i], particleMemories[i]);
+		}
+	}
+
+	/*
+		outside of a render pass, before RecordDraw in the same frame. The fence of the frame slot
+		has to be waited already, its readback is overwritten. Advances the simulation by the time
+		since it was recorded last
+	*/
+	void RecordSimulation(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		aliveParticles = *readbackMapped[frameIndex];
+
+		// a long stall would emit a burst and throw the particles far away, the simulation slows down instead
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		float deltaTime = stateCleared ? std::min(std::chrono::duration<float>(now - lastSimulation).count(), 0.1f) : 0.0f;
+		lastSimulation = now;
+
+		if (!stateCleared) {
+			vkCmdFillBuffer(commandBuffer, stateBuffer, 0, VK_WHOLE_SIZE, 0);
+			stateCleared = true;
+		}
+
+		// the previous frame may still simulate from or draw the buffers that are written now
+		Barrier(commandBuffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+
+		float emitted = emitRemainder + deltaTime * capacity / std::max(m_settings.lifetime, 0.001f);
+		uint32_t emitCount = std::min(static_cast<uint32_t>(emitted), capacity);
+		emitRemainder = emitted - static_cast<float>(static_cast<uint32_t>(emitted));
+
+		ComputePushConstants pushConstants = {};
+		pushConstants.deltaTime = deltaTime;
+		pushConstants.emitCount = emitCount;
+		pushConstants.seed = seed++;
+		pushConstants.source = current;
+		pushConstants.capacity = capacity;
+		pushConstants.lifetime = m_settings.lifetime;
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &computeSets[current], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+
+		// as many groups as the last finalize asked for
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelines[StageSimulate]);
+		vkCmdDispatchIndirect(commandBuffer, stateBuffer, offsetof(ParticleState, simulateGroups));
+		ComputeBarrier(commandBuffer);
+
+		if (emitCount > 0) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelines[StageEmit]);
+			vkCmdDispatch(commandBuffer, GetGroupCount(emitCount), 1, 1);
+			ComputeBarrier(commandBuffer);
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelines[StageFinalize]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+		Barrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		current = 1 - current;
+
+		VkBufferCopy region = {};
+		region.srcOffset = offsetof(ParticleState, aliveCount) + current * sizeof(uint32_t);
+		region.size = sizeof(uint32_t);
+		vkCmdCopyBuffer(commandBuffer, stateBuffer, readbackBuffers[frameIndex], 1, &region);
+
+		// read once the fence of the frame slot comes back
+		Barrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+	}
+
+	// inside the render pass the draw pipeline was made for, binds its own pipeline
+	void RecordDraw(VkCommandBuffer commandBuffer, const glm::vec4& view) {
+		DrawPushConstants pushConstants = {};
+		pushConstants.view = view;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipelineLayout, 0, 1, &drawSets[current], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+		vkCmdDrawIndirect(commandBuffer, stateBuffer, offsetof(ParticleState, vertexCount), 1, sizeof(VkDrawIndirectCommand));
+	}
+
+	// groups for a dispatch over count particles, the invocations loop when it's capped
+	static uint32_t GetGroupCount(uint32_t count) {
+		return std::min((count + workgroupSize - 1) / workgroupSize, maxWorkgroups);
+	}
+
+	// any thread, the shader hot reload builds new pipelines while the old ones are still in use
+	std::array<VkPipeline, StageCount> CreateComputePipelines(const AssetPack* assetPack) {
+		std::vector<char> shaderStorage;
+		ByteSpan shaderCode = loadShaderCode(assetPack, "../Shaders/particles.spv", shaderStorage);
+		VkShaderModule shaderModule = createShaderModule(m_vulkanInitializer->device, shaderCode);
+
+		// one shader, the stage is picked by a specialization constant
+		std::array<uint32_t, StageCount> stages = { StageSimulate, StageEmit, StageFinalize };
+		std::array<VkSpecializationInfo, StageCount> specializationInfos = {};
+		std::array<VkComputePipelineCreateInfo, StageCount> pipelineCreateInfos = {};
+
+		VkSpecializationMapEntry specializationMapEntry = {};
+		specializationMapEntry.constantID = 0;
+		specializationMapEntry.offset = 0;
+		specializationMapEntry.size = sizeof(uint32_t);
+
+		for (uint32_t stage = 0; stage < StageCount; stage++) {
+			specializationInfos[stage].mapEntryCount = 1;
+			specializationInfos[stage].pMapEntries = &specializationMapEntry;
+			specializationInfos[stage].dataSize = sizeof(uint32_t);
+			specializationInfos[stage].pData = &stages[stage];
+
+			pipelineCreateInfos[stage].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipelineCreateInfos[stage].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipelineCreateInfos[stage].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineCreateInfos[stage].stage.module = shaderModule;
+			pipelineCreateInfos[stage].stage.pName = "main";
+			pipelineCreateInfos[stage].stage.pSpecializationInfo = &specializationInfos[stage];
+			pipelineCreateInfos[stage].layout = computePipelineLayout;
+		}
+
+		std::array<VkPipeline, StageCount> pipelines = {};
+		ASSERT(vkCreateComputePipelines(m_vulkanInitializer->device, VK_NULL_HANDLE, StageCount, pipelineCreateInfos.data(), nullptr, pipelines.data()), "failed to create particle compute pipelines.");
+
+		vkDestroyShaderModule(m_vulkanInitializer->device, shaderModule, nullptr);
+
+		return pipelines;
+	}
+
+	// no vertex input, the vertex shader builds the quads from the particle buffer
+	VkPipeline CreateDrawPipeline(const AssetPack* assetPack) {
+		std::vector<char> vertexStorage, fragmentStorage;
+		VkShaderModule vertexModule = createShaderModule(m_vulkanInitializer->device, loadShaderCode(assetPack, "../Shaders/vert_particle.spv", vertexStorage));
+		VkShaderModule fragmentModule = createShaderModule(m_vulkanInitializer->device, loadShaderCode(assetPack, "../Shaders/frag_particle.spv", fragmentStorage));
+
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = vertexModule;
+		shaderStages[0].pName = "main";
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = fragmentModule;
+		shaderStages[1].pName = "main";
+
+		VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+		vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+		inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		// set while recording, like the other pipelines of the pass
+		VkPipelineViewportStateCreateInfo viewportState = {};
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = {};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
+
+		VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+		rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rasterizationState.lineWidth = 1.0f;
+
+		VkPipelineMultisampleStateCreateInfo multisampleState = {};
+		multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampleState.rasterizationSamples = drawSampleCount;
+
+		// additive, the particles don't have to be sorted
+		VkPipelineColorBlendAttachmentState blendAttachment = {};
+		blendAttachment.blendEnable = VK_TRUE;
+		blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+		VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+		colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlendState.attachmentCount = 1;
+		colorBlendState.pAttachments = &blendAttachment;
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+		pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCreateInfo.pStages = shaderStages.data();
+		pipelineCreateInfo.pVertexInputState = &vertexInputState;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pRasterizationState = &rasterizationState;
+		pipelineCreateInfo.pMultisampleState = &multisampleState;
+		pipelineCreateInfo.pColorBlendState = &colorBlendState;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.layout = drawPipelineLayout;
+		pipelineCreateInfo.renderPass = drawRenderPass;
+		pipelineCreateInfo.subpass = 0;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		ASSERT(vkCreateGraphicsPipelines(m_vulkanInitializer->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline), "failed to create particle pipeline.");
+
+		vkDestroyShaderModule(m_vulkanInitializer->device, fragmentModule, nullptr);
+		vkDestroyShaderModule(m_vulkanInitializer->device, vertexModule, nullptr);
+
+		return pipeline;
+	}
+
+private:
+	static void Barrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstAccessMask = dstAccessMask;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// the stages append to the same buffer and count, each one has to see what the last wrote
+	static void ComputeBarrier(VkCommandBuffer commandBuffer) {
+		Barrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	VkDescriptorSetLayout CreateSetLayout(uint32_t bindingCount, VkShaderStageFlags stageFlags) {
+		std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+		for (uint32_t i = 0; i < bindingCount; i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = stageFlags;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings.data();
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		ASSERT(vkCreateDescriptorSetLayout(m_vulkanInitializer->device, &layoutInfo, nullptr, &layout), "failed to create particle descriptor set layout.");
+		return layout;
+	}
+
+	VkDescriptorSet AllocateSet(VkDescriptorSetLayout layout, const std::vector<VkBuffer>& buffers) {
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		ASSERT(vkAllocateDescriptorSets(m_vulkanInitializer->device, &allocInfo, &descriptorSet), "failed to allocate particle descriptor set.");
+
+		std::vector<VkDescriptorBufferInfo> bufferInfos(buffers.size());
+		std::vector<VkWriteDescriptorSet> writes(buffers.size());
+		for (uint32_t i = 0; i < buffers.size(); i++) {
+			bufferInfos[i] = { buffers[i], 0, VK_WHOLE_SIZE };
+
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(m_vulkanInitializer->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		return descriptorSet;
+	}
+
+	void CreateDescriptors() {
+		// source particles, destination particles, state
+		computeSetLayout = CreateSetLayout(3, VK_SHADER_STAGE_COMPUTE_BIT);
+		// particles
+		drawSetLayout = CreateSetLayout(1, VK_SHADER_STAGE_VERTEX_BIT);
+
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = 2 * 3 + 2;
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = 4;
+
+		ASSERT(vkCreateDescriptorPool(m_vulkanInitializer->device, &poolInfo, nullptr, &descriptorPool), "failed to create particle descriptor pool.");
+
+		for (uint32_t i = 0; i < 2; i++) {
+			computeSets[i] = AllocateSet(computeSetLayout, { particleBuffers[i], particleBuffers[1 - i], stateBuffer });
+			drawSets[i] = AllocateSet(drawSetLayout, { particleBuffers[i] });
+		}
+	}
+
+	void CreatePipelineLayouts() {
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(ComputePushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+		pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &computeSetLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+		ASSERT(vkCreatePipelineLayout(m_vulkanInitializer->device, &pipelineLayoutCreateInfo, nullptr, &computePipelineLayout), "failed to create particle compute pipeline layout.");
+
+		VkPushConstantRange drawPushConstantRange = {};
+		drawPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		drawPushConstantRange.offset = 0;
+		drawPushConstantRange.size = sizeof(DrawPushConstants);
+
+		VkPipelineLayoutCreateInfo drawPipelineLayoutCreateInfo = {};
+		drawPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		drawPipelineLayoutCreateInfo.setLayoutCount = 1;
+		drawPipelineLayoutCreateInfo.pSetLayouts = &drawSetLayout;
+		drawPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		drawPipelineLayoutCreateInfo.pPushConstantRanges = &drawPushConstantRange;
+
+		ASSERT(vkCreatePipelineLayout(m_vulkanInitializer->device, &drawPipelineLayoutCreateInfo, nullptr, &drawPipelineLayout), "failed to create particle pipeline layout.");
+	}
+};
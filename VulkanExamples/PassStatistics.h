@@ -0,0 +1,206 @@
+/*
+	pipeline statistics and occlusion queries around the render passes recorded in a command buffer.
+
+	Works like the GpuProfiler: every command buffer slot owns a query per pass in each pool and
+	reads them back without waiting once the fence of its last submission has signaled. The
+	queries are begun and ended outside of the render passes, so a multiview pass doesn't spread
+	them over one query per view.
+
+	Both kinds depend on device features, enabled when the device has them: pipelineStatisticsQuery
+	for the shader invocations and occlusionQueryPrecise for the samples passed. Without the
+	precise feature an occlusion query only tells whether anything passed, which is useless here,
+	so it is left out.
+*/
+#pragma once
+
+#include <vector>
+
+#include "VulkanInitializer.h"
+
+struct PassCounters {
+	uint64_t inputPrimitives = 0;
+	uint64_t vertexInvocations = 0;
+	uint64_t clippingInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentInvocations = 0;
+	uint64_t samplesPassed = 0;
+	// render area of the pass times its layers, what the per pixel numbers are relative to
+	uint64_t pixels = 0;
+	uint32_t sampleCount = 1;
+
+	// fragments shaded per pixel, 1 is every pixel shaded once
+	double Overdraw() const {
+		return pixels ? static_cast<double>(fragmentInvocations) / pixels : 0.0;
+	}
+
+	// shaded fragments whose samples all failed the tests or were discarded
+	double WastedFragments() const {
+		double passedFragments = static_cast<double>(samplesPassed) / sampleCount;
+		return fragmentInvocations > passedFragments ? 1.0 - passedFragments / fragmentInvocations : 0.0;
+	}
+
+	// primitives the clipper took in and dropped, more come out than went in when it splits them
+	uint64_t ClippedPrimitives() const {
+		return clippingInvocations > clippingPrimitives ? clippingInvocations - clippingPrimitives : 0;
+	}
+};
+
+class PassStatistics {
+public:
+	VulkanInitializer* m_vulkanInitializer;
+
+	VkQueryPool statisticsPool = VK_NULL_HANDLE;
+	VkQueryPool occlusionPool = VK_NULL_HANDLE;
+	uint32_t slotCount = 0;
+	uint32_t passCount = 0;
+
+	// passes written at least once in each slot, bit per pass. Same as the scopes of the profiler, a
+	// pass that was reset and not recorded again reads as unavailable and keeps its last counters
+	std::vector<uint32_t> writtenPasses = {};
+	// pixels and samples the pass covered when it was recorded, per slot and pass
+	std::vector<PassCounters> recordedAreas = {};
+	// last collected counters of each pass
+	std::vector<PassCounters> passCounters = {};
+
+	// in the order of their bits, that is the order the results come in
+	static const VkQueryPipelineStatisticFlags statisticFlags =
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	static const uint32_t statisticCount = 5;
+
+	PassStatistics(VulkanInitializer* vulkanInitializer, uint32_t slots, uint32_t passes) {
+		m_vulkanInitializer = vulkanInitializer;
+		slotCount = slots;
+		passCount = passes;
+
+		writtenPasses.resize(slotCount, 0);
+		recordedAreas.resize(static_cast<size_t>(slotCount) * passCount);
+		passCounters.resize(passCount);
+
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryCount = slotCount * passCount;
+
+		if (m_vulkanInitializer->enabledFeatures.pipelineStatisticsQuery) {
+			queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolCreateInfo.pipelineStatistics = statisticFlags;
+			ASSERT(vkCreateQueryPool(m_vulkanInitializer->device, &queryPoolCreateInfo, nullptr, &statisticsPool), "failed to create pipeline statistics query pool");
+		}
+		else {
+			std::cout << "device doesn't support pipeline statistics queries, shader invocations not counted" << std::endl;
+		}
+
+		if (m_vulkanInitializer->enabledFeatures.occlusionQueryPrecise) {
+			queryPoolCreateInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+			queryPoolCreateInfo.pipelineStatistics = 0;
+			ASSERT(vkCreateQueryPool(m_vulkanInitializer->device, &queryPoolCreateInfo, nullptr, &occlusionPool), "failed to create occlusion query pool");
+		}
+		else {
+			std::cout << "device doesn't support precise occlusion queries, samples passed not counted" << std::endl;
+		}
+	}
+	~PassStatistics() {
+		vkDestroyQueryPool(m_vulkanInitializer->device, statisticsPool, nullptr);
+		vkDestroyQueryPool(m_vulkanInitializer->device, occlusionPool, nullptr);
+	}
+
+	bool HasStatistics() {
+		return statisticsPool != VK_NULL_HANDLE;
+	}
+
+	bool HasOcclusion() {
+		return occlusionPool != VK_NULL_HANDLE;
+	}
+
+	// must be called once the last submission of the slot has finished
+	void CollectResults(uint32_t slot) {
+		for (uint32_t pass = 0; pass < passCount; pass++) {
+			if ((writtenPasses[slot] & (1u << pass)) == 0) {
+				continue;
+			}
+
+			PassCounters counters = passCounters[pass];
+			bool available = false;
+
+			if (HasStatistics()) {
+				// the statistics followed by the availability
+				uint64_t results[statisticCount + 1] = {};
+				VkResult res = vkGetQueryPoolResults(m_vulkanInitializer->device, statisticsPool, QueryIndex(slot, pass), 1,
+					sizeof(results), results, sizeof(results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+				if (res == VK_SUCCESS && results[statisticCount] != 0) {
+					counters.inputPrimitives = results[0];
+					counters.vertexInvocations = results[1];
+					counters.clippingInvocations = results[2];
+					counters.clippingPrimitives = results[3];
+					counters.fragmentInvocations = results[4];
+					available = true;
+				}
+			}
+
+			if (HasOcclusion()) {
+				uint64_t results[2] = {};
+				VkResult res = vkGetQueryPoolResults(m_vulkanInitializer->device, occlusionPool, QueryIndex(slot, pass), 1,
+					sizeof(results), results, sizeof(results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+				if (res == VK_SUCCESS && results[1] != 0) {
+					counters.samplesPassed = results[0];
+					available = true;
+				}
+			}
+
+			if (available) {
+				const PassCounters& area = recordedAreas[QueryIndex(slot, pass)];
+				counters.pixels = area.pixels;
+				counters.sampleCount = area.sampleCount;
+				passCounters[pass] = counters;
+			}
+		}
+	}
+
+	// resets the queries of the slot, has to be recorded outside of a render pass
+	void BeginFrame(VkCommandBuffer commandBuffer, uint32_t slot) {
+		if (HasStatistics()) {
+			vkCmdResetQueryPool(commandBuffer, statisticsPool, QueryIndex(slot, 0), passCount);
+		}
+		if (HasOcclusion()) {
+			vkCmdResetQueryPool(commandBuffer, occlusionPool, QueryIndex(slot, 0), passCount);
+		}
+	}
+
+	// right before vkCmdBeginRenderPass, pixels is the render area times the layers drawn
+	void BeginPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass, uint64_t pixels, VkSampleCountFlagBits samples) {
+		PassCounters& area = recordedAreas[QueryIndex(slot, pass)];
+		area.pixels = pixels;
+		area.sampleCount = static_cast<uint32_t>(samples);
+
+		if (HasStatistics()) {
+			vkCmdBeginQuery(commandBuffer, statisticsPool, QueryIndex(slot, pass), 0);
+		}
+		if (HasOcclusion()) {
+			vkCmdBeginQuery(commandBuffer, occlusionPool, QueryIndex(slot, pass), VK_QUERY_CONTROL_PRECISE_BIT);
+		}
+	}
+
+	// right after vkCmdEndRenderPass
+	void EndPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass) {
+		if (HasStatistics()) {
+			vkCmdEndQuery(commandBuffer, statisticsPool, QueryIndex(slot, pass));
+		}
+		if (HasOcclusion()) {
+			vkCmdEndQuery(commandBuffer, occlusionPool, QueryIndex(slot, pass));
+		}
+		writtenPasses[slot] |= 1u << pass;
+	}
+
+	const PassCounters& GetPassCounters(uint32_t pass) {
+		return passCounters[pass];
+	}
+
+	uint32_t QueryIndex(uint32_t slot, uint32_t pass) {
+		return slot * passCount + pass;
+	}
+};
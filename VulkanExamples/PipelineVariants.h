@@ -0,0 +1,96 @@
+/*
+	specialization constants and the key pipeline variants are cached under.
+
+	A shader feature that is known when the pipeline is built (a toggle, a mode, a count) is
+	declared as a specialization constant instead of a uniform branch or another shader file.
+	Every combination of values is its own pipeline, the driver folds the constants and drops
+	the dead code, and the combinations are only built when they are first used.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+// 32 bit constants, booleans are VkBool32 like the SPIR-V side expects
+struct SpecializationConstants {
+	// sorted by constant id, so equal sets compare and hash the same whatever the order of Set
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<uint32_t> values;
+
+	SpecializationConstants& Set(uint32_t constantId, uint32_t value) {
+		auto entry = std::lower_bound(entries.begin(), entries.end(), constantId,
+			[](const VkSpecializationMapEntry& existing, uint32_t id) { return existing.constantID < id; });
+		size_t index = static_cast<size_t>(entry - entries.begin());
+
+		if (entry != entries.end() && entry->constantID == constantId) {
+			values[index] = value;
+			return *this;
+		}
+
+		entries.insert(entry, { constantId, 0, sizeof(uint32_t) });
+		values.insert(values.begin() + index, value);
+
+		// offsets follow the position in values
+		for (size_t i = 0; i < entries.size(); i++) {
+			entries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+		}
+
+		return *this;
+	}
+
+	// points into this object, has to outlive the pipeline creation
+	VkSpecializationInfo GetInfo() const {
+		VkSpecializationInfo info = {};
+		info.mapEntryCount = static_cast<uint32_t>(entries.size());
+		info.pMapEntries = entries.data();
+		info.dataSize = values.size() * sizeof(uint32_t);
+		info.pData = values.data();
+		return info;
+	}
+
+	bool operator==(const SpecializationConstants& other) const {
+		if (entries.size() != other.entries.size() || values != other.values) {
+			return false;
+		}
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (entries[i].constantID != other.entries[i].constantID) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// which pipeline and which values of its constants
+struct PipelineKey {
+	uint32_t pipelineId = 0;
+	SpecializationConstants constants;
+
+	bool operator==(const PipelineKey& other) const {
+		return pipelineId == other.pipelineId && constants == other.constants;
+	}
+};
+
+// FNV-1a over the pipeline id and every constant id and value
+struct PipelineKeyHash {
+	size_t operator()(const PipelineKey& key) const {
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](uint32_t value) {
+			for (int i = 0; i < 4; i++) {
+				hash ^= (value >> (i * 8)) & 0xff;
+				hash *= 1099511628211ull;
+			}
+		};
+
+		add(key.pipelineId);
+		for (size_t i = 0; i < key.constants.entries.size(); i++) {
+			add(key.constants.entries[i].constantID);
+			add(key.constants.values[i]);
+		}
+
+		return static_cast<size_t>(hash);
+	}
+};
@@ -0,0 +1,227 @@
+/*
+	development mode that recompiles shaders while the example runs.
+
+	A background thread watches the GLSL sources (inotify on Linux, modification times
+	elsewhere) and runs glslc on every source that changed. The SPIR-V is written next to the
+	old one and renamed over it, so a failed compile leaves the previous binary in place. Each
+	successful compile is reported through onShaderCompiled, still on the watcher thread, the
+	owner decides which pipelines to rebuild from it.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+struct ShaderHotReloadSettings {
+	// glslc executable, empty looks in $VULKAN_SDK and then in the PATH
+	std::string compilerPath = "";
+	// how often modification times are checked where inotify isn't available
+	uint32_t pollIntervalMs = 250;
+	// editors write a file in several steps, changes are collected for this long before compiling
+	uint32_t settleMs = 50;
+};
+
+// a GLSL source and the SPIR-V file the pipelines load
+struct ShaderSource {
+	std::string sourcePath;
+	std::string spirvPath;
+	// extra compiler arguments, variants of the same source differ by their defines
+	std::string arguments = "";
+};
+
+class ShaderHotReload {
+public:
+	ShaderHotReloadSettings m_settings = {};
+	std::vector<ShaderSource> shaders;
+
+	// watcher thread, called with the spirvPath of every shader that compiled
+	std::function<void(const std::string&)> onShaderCompiled;
+
+	std::atomic<uint32_t> compiledShaders = { 0 };
+	std::atomic<uint32_t> failedCompiles = { 0 };
+
+	std::thread thread;
+	std::atomic<bool> running = { false };
+
+	ShaderHotReload(std::vector<ShaderSource> shaderSources, ShaderHotReloadSettings settings = {}) {
+		shaders = std::move(shaderSources);
+		m_settings = settings;
+
+		if (m_settings.compilerPath.empty()) {
+			m_settings.compilerPath = DefaultCompilerPath();
+		}
+	}
+	~ShaderHotReload() {
+		Stop();
+	}
+
+	static std::string DefaultCompilerPath() {
+		const char* sdk = std::getenv("VULKAN_SDK");
+		if (!sdk) {
+			return "glslc";
+		}
+
+#ifdef _WIN32
+		return std::string(sdk) + "/Bin/glslc.exe";
+#else
+		return std::string(sdk) + "/bin/glslc";
+#endif
+	}
+
+	void Start() {
+		running = true;
+		thread = std::thread(&ShaderHotReload::Run, this);
+	}
+
+	void Stop() {
+		running = false;
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	// false keeps the old SPIR-V, glslc already printed the errors
+	bool Compile(const ShaderSource& shader) {
+		std::string temporaryPath = shader.spirvPath + ".tmp";
+		std::string command = "\"" + m_settings.compilerPath + "\" " + shader.arguments + " \"" + shader.sourcePath + "\" -o \"" + temporaryPath + "\"";
+#ifdef _WIN32
+		// cmd strips the outer quotes of the whole line
+		command = "\"" + command + "\"";
+#endif
+
+		if (std::system(command.c_str()) != 0) {
+			std::cout << "shader hot reload: " << shader.sourcePath << " failed to compile" << std::endl;
+			std::remove(temporaryPath.c_str());
+			failedCompiles++;
+			return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, shader.spirvPath, error);
+		if (error) {
+			std::cout << "shader hot reload: can't replace " << shader.spirvPath << ": " << error.message() << std::endl;
+			return false;
+		}
+
+		std::cout << "shader hot reload: compiled " << shader.sourcePath << std::endl;
+		compiledShaders++;
+
+		return true;
+	}
+
+	void CompileChanged(const std::vector<bool>& changed) {
+		for (size_t i = 0; i < shaders.size(); i++) {
+			if (changed[i] && Compile(shaders[i]) && onShaderCompiled) {
+				onShaderCompiled(shaders[i].spirvPath);
+			}
+		}
+	}
+
+#ifdef __linux__
+	void Run() {
+		int inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify < 0) {
+			std::cout << "shader hot reload: inotify unavailable, polling instead" << std::endl;
+			Poll();
+			return;
+		}
+
+		// editors often save by renaming a new file over the old one, so the directories are watched
+		std::vector<int> watches(shaders.size(), -1);
+		for (size_t i = 0; i < shaders.size(); i++) {
+			std::string directory = std::filesystem::path(shaders[i].sourcePath).parent_path().string();
+			watches[i] = inotify_add_watch(inotify, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		}
+
+		std::vector<bool> changed(shaders.size(), false);
+		alignas(inotify_event) char buffer[4096];
+
+		while (running) {
+			pollfd descriptor = { inotify, POLLIN, 0 };
+			if (poll(&descriptor, 1, static_cast<int>(m_settings.pollIntervalMs)) <= 0) {
+				continue;
+			}
+
+			// take everything that arrives while the editor is still writing
+			bool any = false;
+			std::chrono::steady_clock::time_point settleEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_settings.settleMs);
+			while (std::chrono::steady_clock::now() < settleEnd) {
+				ssize_t length = read(inotify, buffer, sizeof(buffer));
+				if (length <= 0) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+					continue;
+				}
+
+				for (char* cursor = buffer; cursor < buffer + length; ) {
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+					if (event->len > 0) {
+						for (size_t i = 0; i < shaders.size(); i++) {
+							if (watches[i] == event->wd && std::filesystem::path(shaders[i].sourcePath).filename() == event->name) {
+								changed[i] = true;
+								any = true;
+							}
+						}
+					}
+					cursor += sizeof(inotify_event) + event->len;
+				}
+			}
+
+			if (any) {
+				CompileChanged(changed);
+				changed.assign(shaders.size(), false);
+			}
+		}
+
+		close(inotify);
+	}
+#else
+	void Run() {
+		Poll();
+	}
+#endif
+
+	void Poll() {
+		std::vector<std::filesystem::file_time_type> writeTimes(shaders.size());
+		for (size_t i = 0; i < shaders.size(); i++) {
+			std::error_code error;
+			writeTimes[i] = std::filesystem::last_write_time(shaders[i].sourcePath, error);
+		}
+
+		std::vector<bool> changed(shaders.size(), false);
+		while (running) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_settings.pollIntervalMs));
+
+			bool any = false;
+			for (size_t i = 0; i < shaders.size(); i++) {
+				std::error_code error;
+				std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(shaders[i].sourcePath, error);
+				if (!error && writeTime != writeTimes[i]) {
+					writeTimes[i] = writeTime;
+					changed[i] = true;
+					any = true;
+				}
+			}
+
+			if (any) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(m_settings.settleMs));
+				CompileChanged(changed);
+				changed.assign(shaders.size(), false);
+			}
+		}
+	}
+};
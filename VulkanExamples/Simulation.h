@@ -0,0 +1,192 @@
+/*
+	game logic running at a fixed tick on its own thread.
+
+	Every tick ends by publishing an immutable snapshot of everything the renderer needs. The
+	render thread picks the latest one when it starts a frame, so a slow GPU frame never
+	stretches a tick and a long tick never holds a frame back.
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include "TripleBuffer.h"
+
+#include <glm/glm.hpp>
+
+// what the renderer needs from a tick, copied by value
+struct FrameSnapshot {
+	uint64_t tick = 0;
+	double time = 0.0;
+
+	glm::vec4 clearColor = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+
+	// changes whenever the content to render changes
+	uint64_t sceneGeneration = 0;
+
+	// most recent input applied by the simulation, used to measure latency
+	uint64_t inputSequence = 0;
+	std::chrono::steady_clock::time_point inputTime = {};
+};
+
+struct SimulationInput {
+	enum Type {
+		// switches the animated background on and off
+		ToggleAnimation,
+		// anything else, only counts for latency
+		Other
+	};
+
+	Type type = Other;
+	std::chrono::steady_clock::time_point time = {};
+};
+
+struct SimulationSettings {
+	float ticksPerSecond = 60.0f;
+	// after a stall the simulation skips ahead instead of running this many ticks back to back
+	uint32_t maxCatchUpTicks = 5;
+	bool printStats = false;
+};
+
+class Simulation {
+public:
+	SimulationSettings m_settings = {};
+
+	TripleBuffer<FrameSnapshot> snapshots;
+
+	// inputs from the event thread, bounded single producer single consumer ring
+	static const size_t inputCapacity = 256;
+	SimulationInput inputs[inputCapacity] = {};
+	std::atomic<size_t> inputHead = { 0 };
+	std::atomic<size_t> inputTail = { 0 };
+
+	// called from the simulation thread whenever the scene generation changes
+	std::function<void()> onSceneChanged;
+
+	// simulation thread only
+	FrameSnapshot state = {};
+	bool animating = false;
+
+	std::atomic<uint64_t> ticks = { 0 };
+	std::atomic<uint64_t> skippedTicks = { 0 };
+	std::atomic<uint64_t> droppedInputs = { 0 };
+
+	std::thread thread;
+	std::atomic<bool> running = { false };
+
+	Simulation(SimulationSettings settings = {}) {
+		m_settings = settings;
+		m_settings.ticksPerSecond = std::max(m_settings.ticksPerSecond, 1.0f);
+
+		snapshots.WriteBuffer() = state;
+		snapshots.Publish();
+	}
+	~Simulation() {
+		Stop();
+	}
+
+	void Start() {
+		running = true;
+		thread = std::thread(&Simulation::Run, this);
+	}
+
+	void Stop() {
+		running = false;
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	// event thread, never blocks
+	bool PushInput(const SimulationInput& input) {
+		size_t head = inputHead.load(std::memory_order_relaxed);
+		if (head - inputTail.load(std::memory_order_acquire) == inputCapacity) {
+			droppedInputs.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		inputs[head % inputCapacity] = input;
+		inputHead.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	void Run() {
+		std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / m_settings.ticksPerSecond));
+		std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
+
+		std::chrono::steady_clock::time_point statsStart = nextTick;
+		uint64_t statsTicks = 0;
+
+		while (running) {
+			std::this_thread::sleep_until(nextTick);
+
+			// a stall (debugger, suspended process) would otherwise be replayed as a burst of ticks
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now - nextTick > period * m_settings.maxCatchUpTicks) {
+				uint64_t behind = static_cast<uint64_t>((now - nextTick) / period);
+				skippedTicks += behind;
+				nextTick += period * behind;
+			}
+
+			Tick(std::chrono::duration<double>(period).count());
+			statsTicks++;
+			nextTick += period;
+
+			if (m_settings.printStats && now - statsStart >= std::chrono::seconds(1)) {
+				double elapsedSeconds = std::chrono::duration<double>(now - statsStart).count();
+				std::cout << "simulation: " << statsTicks / elapsedSeconds << " ticks/s"
+					<< " | skipped ticks: " << skippedTicks
+					<< " | dropped inputs: " << droppedInputs << std::endl;
+
+				statsStart = now;
+				statsTicks = 0;
+			}
+		}
+	}
+
+	void Tick(double deltaSeconds) {
+		uint64_t previousGeneration = state.sceneGeneration;
+
+		size_t tail = inputTail.load(std::memory_order_relaxed);
+		size_t head = inputHead.load(std::memory_order_acquire);
+		for (; tail != head; tail++) {
+			const SimulationInput& input = inputs[tail % inputCapacity];
+
+			if (input.type == SimulationInput::ToggleAnimation) {
+				animating = !animating;
+			}
+
+			state.inputSequence++;
+			state.inputTime = input.time;
+		}
+		inputTail.store(tail, std::memory_order_release);
+
+		state.tick++;
+		state.time += deltaSeconds;
+
+		if (animating) {
+			float phase = static_cast<float>(state.time);
+			state.clearColor = glm::vec4(
+				0.5f + 0.5f * std::sin(phase),
+				0.5f + 0.5f * std::sin(phase + 2.094f),
+				0.5f + 0.5f * std::sin(phase + 4.189f),
+				1.0f);
+			state.sceneGeneration++;
+		}
+
+		snapshots.WriteBuffer() = state;
+		snapshots.Publish();
+		ticks++;
+
+		if (state.sceneGeneration != previousGeneration && onSceneChanged) {
+			onSceneChanged();
+		}
+	}
+};
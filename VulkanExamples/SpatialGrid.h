@@ -0,0 +1,266 @@
+/*
+	loose uniform grid over 2D bounding boxes, for culling against a camera rectangle on the CPU.
+
+	An entity lives in the cell holding the center of its box, whatever its size, so moving it
+	only changes cells when the center crosses a border and most updates are four stores in
+	place. Queries grow the rectangle by the largest half size inserted so far to catch the boxes
+	reaching out of their cell.
+
+	Each cell keeps the bounds of its entities as separate arrays of min x, min y, max x and
+	max y. The overlap test then runs on 8 boxes at a time with AVX or 4 with SSE, straight
+	from those arrays, and the ids of the hits are pulled out of the comparison mask.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPATIAL_GRID_SSE
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+struct Aabb {
+	float minX = 0.0f;
+	float minY = 0.0f;
+	float maxX = 0.0f;
+	float maxY = 0.0f;
+};
+
+class SpatialGrid {
+public:
+	static const uint32_t invalidCell = UINT32_MAX;
+
+	struct Cell {
+		std::vector<float> minX;
+		std::vector<float> minY;
+		std::vector<float> maxX;
+		std::vector<float> maxY;
+		std::vector<uint32_t> ids;
+	};
+
+	// where an entity is stored, indexed by its id
+	struct Location {
+		uint32_t cell = invalidCell;
+		uint32_t slot = 0;
+	};
+
+	Aabb worldBounds = {};
+	float cellSize = 1.0f;
+	uint32_t cellsX = 1;
+	uint32_t cellsY = 1;
+	std::vector<Cell> cells;
+	std::vector<Location> locations;
+
+	// biggest half size of any box inserted, never shrinks
+	float looseX = 0.0f;
+	float looseY = 0.0f;
+
+	uint32_t entityCount = 0;
+
+	SpatialGrid() = default;
+	// entities outside of the world are kept in the border cells, they are still found
+	SpatialGrid(const Aabb& world, float gridCellSize) {
+		worldBounds = world;
+		cellSize = gridCellSize;
+		cellsX = std::max(1u, static_cast<uint32_t>(std::ceil((world.maxX - world.minX) / cellSize)));
+		cellsY = std::max(1u, static_cast<uint32_t>(std::ceil((world.maxY - world.minY) / cellSize)));
+		cells.resize(static_cast<size_t>(cellsX) * cellsY);
+	}
+
+	// ids are indices, dense ones keep the locations small
+	void Insert(uint32_t id, const Aabb& box) {
+		if (id >= locations.size()) {
+			locations.resize(id + 1);
+		}
+		if (locations[id].cell != invalidCell) {
+			Update(id, box);
+			return;
+		}
+
+		GrowLoose(box);
+		Append(id, GetCell(box), box);
+		entityCount++;
+	}
+
+	void Update(uint32_t id, const Aabb& box) {
+		Location& location = locations[id];
+		uint32_t cell = GetCell(box);
+		GrowLoose(box);
+
+		if (cell == location.cell) {
+			Cell& current = cells[cell];
+			current.minX[location.slot] = box.minX;
+			current.minY[location.slot] = box.minY;
+			current.maxX[location.slot] = box.maxX;
+			current.maxY[location.slot] = box.maxY;
+			return;
+		}
+
+		RemoveFromCell(id);
+		Append(id, cell, box);
+	}
+
+	void Remove(uint32_t id) {
+		if (id >= locations.size() || locations[id].cell == invalidCell) {
+			return;
+		}
+
+		RemoveFromCell(id);
+		locations[id].cell = invalidCell;
+		entityCount--;
+	}
+
+	// appends the ids of the boxes overlapping the rectangle, edges touching count
+	void Query(const Aabb& rectangle, std::vector<uint32_t>& results) const {
+		uint32_t firstX = ClampCellX(rectangle.minX - looseX);
+		uint32_t lastX = ClampCellX(rectangle.maxX + looseX);
+		uint32_t firstY = ClampCellY(rectangle.minY - looseY);
+		uint32_t lastY = ClampCellY(rectangle.maxY + looseY);
+
+		for (uint32_t y = firstY; y <= lastY; y++) {
+			for (uint32_t x = firstX; x <= lastX; x++) {
+				const Cell& cell = cells[static_cast<size_t>(y) * cellsX + x];
+				QueryBoxes(cell.minX.data(), cell.minY.data(), cell.maxX.data(), cell.maxY.data(), cell.ids.data(),
+					static_cast<uint32_t>(cell.ids.size()), rectangle, results);
+			}
+		}
+	}
+
+	// the overlap test over arrays of bounds, appends ids[i] of every hit
+	static void QueryBoxes(const float* minX, const float* minY, const float* maxX, const float* maxY, const uint32_t* ids,
+		uint32_t count, const Aabb& rectangle, std::vector<uint32_t>& results) {
+		uint32_t i = 0;
+
+#if defined(__AVX__)
+		__m256 queryMinX = _mm256_set1_ps(rectangle.minX);
+		__m256 queryMinY = _mm256_set1_ps(rectangle.minY);
+		__m256 queryMaxX = _mm256_set1_ps(rectangle.maxX);
+		__m256 queryMaxY = _mm256_set1_ps(rectangle.maxY);
+
+		for (; i + 8 <= count; i += 8) {
+			__m256 overlapX = _mm256_and_ps(
+				_mm256_cmp_ps(_mm256_loadu_ps(minX + i), queryMaxX, _CMP_LE_OQ),
+				_mm256_cmp_ps(_mm256_loadu_ps(maxX + i), queryMinX, _CMP_GE_OQ));
+			__m256 overlapY = _mm256_and_ps(
+				_mm256_cmp_ps(_mm256_loadu_ps(minY + i), queryMaxY, _CMP_LE_OQ),
+				_mm256_cmp_ps(_mm256_loadu_ps(maxY + i), queryMinY, _CMP_GE_OQ));
+
+			AppendHits(static_cast<uint32_t>(_mm256_movemask_ps(_mm256_and_ps(overlapX, overlapY))), ids + i, results);
+		}
+#elif defined(SPATIAL_GRID_SSE)
+		__m128 queryMinX = _mm_set1_ps(rectangle.minX);
+		__m128 queryMinY = _mm_set1_ps(rectangle.minY);
+		__m128 queryMaxX = _mm_set1_ps(rectangle.maxX);
+		__m128 queryMaxY = _mm_set1_ps(rectangle.maxY);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 overlapX = _mm_and_ps(
+				_mm_cmple_ps(_mm_loadu_ps(minX + i), queryMaxX),
+				_mm_cmpge_ps(_mm_loadu_ps(maxX + i), queryMinX));
+			__m128 overlapY = _mm_and_ps(
+				_mm_cmple_ps(_mm_loadu_ps(minY + i), queryMaxY),
+				_mm_cmpge_ps(_mm_loadu_ps(maxY + i), queryMinY));
+
+			AppendHits(static_cast<uint32_t>(_mm_movemask_ps(_mm_and_ps(overlapX, overlapY))), ids + i, results);
+		}
+#endif
+
+		// the tail, or everything without SIMD
+		for (; i < count; i++) {
+			if (minX[i] <= rectangle.maxX && maxX[i] >= rectangle.minX && minY[i] <= rectangle.maxY && maxY[i] >= rectangle.minY) {
+				results.push_back(ids[i]);
+			}
+		}
+	}
+
+	static const char* InstructionSet() {
+#if defined(__AVX__)
+		return "AVX";
+#elif defined(SPATIAL_GRID_SSE)
+		return "SSE";
+#else
+		return "scalar";
+#endif
+	}
+
+private:
+	static void AppendHits(uint32_t mask, const uint32_t* ids, std::vector<uint32_t>& results) {
+		while (mask) {
+			results.push_back(ids[CountTrailingZeros(mask)]);
+			mask &= mask - 1;
+		}
+	}
+
+	static uint32_t CountTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+		unsigned long index = 0;
+		_BitScanForward(&index, mask);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+	}
+
+	uint32_t ClampCellX(float x) const {
+		float cell = std::floor((x - worldBounds.minX) / cellSize);
+		return static_cast<uint32_t>(std::clamp(cell, 0.0f, static_cast<float>(cellsX - 1)));
+	}
+
+	uint32_t ClampCellY(float y) const {
+		float cell = std::floor((y - worldBounds.minY) / cellSize);
+		return static_cast<uint32_t>(std::clamp(cell, 0.0f, static_cast<float>(cellsY - 1)));
+	}
+
+	uint32_t GetCell(const Aabb& box) const {
+		float centerX = (box.minX + box.maxX) * 0.5f;
+		float centerY = (box.minY + box.maxY) * 0.5f;
+		return ClampCellY(centerY) * cellsX + ClampCellX(centerX);
+	}
+
+	void GrowLoose(const Aabb& box) {
+		looseX = std::max(looseX, (box.maxX - box.minX) * 0.5f);
+		looseY = std::max(looseY, (box.maxY - box.minY) * 0.5f);
+	}
+
+	void Append(uint32_t id, uint32_t cellIndex, const Aabb& box) {
+		Cell& cell = cells[cellIndex];
+		locations[id] = { cellIndex, static_cast<uint32_t>(cell.ids.size()) };
+
+		cell.minX.push_back(box.minX);
+		cell.minY.push_back(box.minY);
+		cell.maxX.push_back(box.maxX);
+		cell.maxY.push_back(box.maxY);
+		cell.ids.push_back(id);
+	}
+
+	// the last entity of the cell takes the free slot
+	void RemoveFromCell(uint32_t id) {
+		Location location = locations[id];
+		Cell& cell = cells[location.cell];
+		uint32_t last = static_cast<uint32_t>(cell.ids.size()) - 1;
+
+		if (location.slot != last) {
+			cell.minX[location.slot] = cell.minX[last];
+			cell.minY[location.slot] = cell.minY[last];
+			cell.maxX[location.slot] = cell.maxX[last];
+			cell.maxY[location.slot] = cell.maxY[last];
+			cell.ids[location.slot] = cell.ids[last];
+			locations[cell.ids[last]].slot = location.slot;
+		}
+
+		cell.minX.pop_back();
+		cell.minY.pop_back();
+		cell.maxX.pop_back();
+		cell.maxY.pop_back();
+		cell.ids.pop_back();
+	}
+};
@@ -0,0 +1,1036 @@
+/*
+	streams textures from disk without blocking the render loop.
+
+	Files are read and decoded on the job system, including a CPU generated mip chain. The
+	render thread copies the decoded levels through a persistently mapped staging ring,
+	never more than the upload budget per frame, starting from the smallest mip so a blurry
+	version shows up almost immediately and sharpens as the bigger levels arrive. Large levels
+	are split by rows over several frames.
+
+	Every texture owns a slot of a combined image sampler array. Slots start out pointing to a
+	white placeholder and are switched to the texture view as soon as its first mip is
+	resident. There is a descriptor set per frame in flight, so a set is only rewritten once the
+	frames using it are done, and replaced views are destroyed through a deletion queue keyed
+	by frame number.
+
+	KTX2 files keep their block compressed format when the device can sample it, their levels
+	go to the GPU exactly as stored and take a fraction of the memory. When the device lacks
+	the format the levels are transcoded to RGBA8 on the job thread instead.
+
+	Files found in the asset pack are decoded from the mapping. Levels stored in a format the
+	device can sample are never copied on the heap, they go from the pack to the staging ring.
+
+	Textures carry a priority and the last frame they were used in. When the heap holding them
+	gets close to its budget the least valuable ones not used for a while give their memory back,
+	lowest priority first and the longest unused among equals. An evicted texture shows the
+	placeholder and is streamed in again the next time it is used.
+*/
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "VulkanInitializer.h"
+#include "Helpers.cpp"
+#include "JobSystem.h"
+#include "Ktx2.h"
+#include "AssetPack.h"
+
+struct TextureStreamerSettings {
+	// bytes copied into the staging ring per frame, what doesn't fit waits for the next frame
+	VkDeviceSize uploadBudgetBytes = 4 * 1024 * 1024;
+	// shared by the frames in flight, should hold a few frames worth of budget
+	VkDeviceSize stagingSize = 16 * 1024 * 1024;
+	// size of the texture array, has to match the array declared in the shaders
+	uint32_t maxTextures = 64;
+	// textures start being evicted once their heap uses this share of its budget
+	uint32_t evictionBudgetPercent = 90;
+	// frames a texture has to go unused before it can be evicted
+	uint64_t evictionUnusedFrames = 60;
+};
+
+class TextureStreamer {
+public:
+	VulkanInitializer* m_vulkanInitializer;
+	JobSystem* m_jobSystem;
+	// optional, has to outlive the streamer
+	const AssetPack* m_assetPack;
+	TextureStreamerSettings m_settings = {};
+
+	// slot 0 is the placeholder, always valid
+	static const uint32_t placeholderTexture = 0;
+
+	// format of the placeholder and of decoded images
+	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	static const uint32_t bytesPerPixel = 4;
+
+	enum TextureState {
+		TextureDecoding,
+		TextureUploading,
+		TextureResident,
+		TextureFailed,
+		// memory given back over the budget, decoded again once used
+		TextureEvicted,
+	};
+
+	struct MipLevel {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		size_t offset = 0;
+	};
+
+	struct DecodedTexture {
+		// format of the data, as it goes to the GPU
+		const TextureTranscoder::FormatInfo* format = nullptr;
+		// format of the file, differs from format when the device needed a transcode
+		const TextureTranscoder::FormatInfo* sourceFormat = nullptr;
+
+		// what the levels are uploaded from, points into pixels or into the asset pack
+		ByteSpan data;
+		// decoded or loaded bytes, empty when data is in the asset pack
+		std::vector<uint8_t> pixels;
+		// level 0 first, offsets are relative to data
+		std::vector<MipLevel> mips;
+	};
+
+	struct Texture {
+		std::string path;
+		// tells a late decode of a released texture apart from the texture now using the slot
+		uint64_t requestId = 0;
+		TextureState state = TextureDecoding;
+
+		// higher stays resident longer under memory pressure
+		float priority = 1.0f;
+		uint64_t lastUsedFrame = 0;
+
+		std::unique_ptr<DecodedTexture> decoded;
+		const TextureTranscoder::FormatInfo* format = nullptr;
+		// size of all levels on the GPU, and what they would take as RGBA8
+		VkDeviceSize gpuBytes = 0;
+		VkDeviceSize rgba8Bytes = 0;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t mipLevels = 0;
+
+		// level being uploaded, going down to 0, and its next row
+		uint32_t uploadMip = 0;
+		uint32_t uploadRow = 0;
+		// smallest level index the view covers, mipLevels while nothing is resident
+		uint32_t residentMip = 0;
+	};
+
+	// render thread only
+	std::vector<std::unique_ptr<Texture>> textures;
+
+	// finished decodes, filled by the jobs
+	struct DecodeResult {
+		uint32_t slot = 0;
+		uint64_t requestId = 0;
+		// null when the file couldn't be loaded
+		std::unique_ptr<DecodedTexture> decoded;
+	};
+
+	std::mutex decodedMutex;
+	std::vector<DecodeResult> decodedTextures;
+	JobCounter decodeJobs;
+	uint64_t nextRequestId = 1;
+
+	VkImage placeholderImage = VK_NULL_HANDLE;
+	VkDeviceMemory placeholderMemory = VK_NULL_HANDLE;
+	VkImageView placeholderView = VK_NULL_HANDLE;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	// one set per frame in flight and the view each of its slots points to
+	std::vector<VkDescriptorSet> descriptorSets;
+	std::vector<std::vector<VkImageView>> boundViews;
+	// bumped whenever a set is rewritten, command buffers recorded with it have to be recorded again
+	uint64_t descriptorWrites = 0;
+
+	// staging ring
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+	uint8_t* stagingMapped = nullptr;
+	VkDeviceSize stagingHead = 0;
+	VkDeviceSize stagingTail = 0;
+	bool stagingAllocatedThisFrame = false;
+
+	// end of the ring space used by each frame, released once the frame is done
+	struct StagingRegion {
+		uint64_t frameNumber = 0;
+		VkDeviceSize end = 0;
+	};
+	std::deque<StagingRegion> stagingRegions;
+
+	// destruction of resources the GPU might still use, run once the frame is done
+	std::deque<std::pair<uint64_t, std::function<void()>>> deletionQueue;
+
+	uint32_t framesInFlight = 1;
+
+	uint64_t uploadedBytes = 0;
+
+	// memory of evicted textures waiting for the frames in flight before it is freed, per heap
+	std::vector<VkDeviceSize> evictingBytes = {};
+	uint64_t evictedTextures = 0;
+	uint64_t evictedBytes = 0;
+
+	TextureStreamer(VulkanInitializer* vulkanInitializer, JobSystem* jobSystem, const AssetPack* assetPack, uint32_t frameCount, TextureStreamerSettings settings = {}) {
+		m_vulkanInitializer = vulkanInitializer;
+		m_jobSystem = jobSystem;
+		m_assetPack = assetPack;
+		m_settings = settings;
+		m_settings.maxTextures = std::max(m_settings.maxTextures, 1u);
+		framesInFlight = std::max(frameCount, 1u);
+		evictingBytes.resize(m_vulkanInitializer->memoryProperties.memoryHeapCount, 0);
+
+		CreateStagingBuffer();
+		CreatePlaceholder();
+		CreateSampler();
+		CreateDescriptors();
+
+		textures.resize(1);
+	}
+	~TextureStreamer() {
+		// decode jobs hold a pointer to us
+		m_jobSystem->Wait(decodeJobs);
+
+		// the owner waited for the device, everything can go now
+		for (auto& deletion : deletionQueue) {
+			deletion.second();
+		}
+
+		for (auto& texture : textures) {
+			if (texture) {
+				DestroyTexture(*texture);
+			}
+		}
+
+		vkDestroyDescriptorPool(m_vulkanInitializer->device, descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(m_vulkanInitializer->device, descriptorSetLayout, nullptr);
+		vkDestroySampler(m_vulkanInitializer->device, sampler, nullptr);
+
+		vkDestroyImageView(m_vulkanInitializer->device, placeholderView, nullptr);
+		vkDestroyImage(m_vulkanInitializer->device, placeholderImage, nullptr);
+		m_vulkanInitializer->FreeMemory(placeholderMemory);
+
+		vkUnmapMemory(m_vulkanInitializer->device, stagingMemory);
+		vkDestroyBuffer(m_vulkanInitializer->device, stagingBuffer, nullptr);
+		m_vulkanInitializer->FreeMemory(stagingMemory);
+	}
+
+	void CreateStagingBuffer() {
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = m_settings.stagingSize;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		ASSERT(vkCreateBuffer(m_vulkanInitializer->device, &bufferInfo, nullptr, &stagingBuffer), "failed to create staging buffer.");
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_vulkanInitializer->device, stagingBuffer, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = m_vulkanInitializer->FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memRequirements.size);
+
+		ASSERT(m_vulkanInitializer->AllocateMemory(&allocInfo, &stagingMemory), "failed to allocate staging memory!");
+		ASSERT(vkBindBufferMemory(m_vulkanInitializer->device, stagingBuffer, stagingMemory, 0));
+
+		void* mapped = nullptr;
+		ASSERT(vkMapMemory(m_vulkanInitializer->device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped));
+		stagingMapped = static_cast<uint8_t*>(mapped);
+	}
+
+	void CreateImage(VkFormat imageFormat, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory) {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = imageFormat;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = mipLevels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		ASSERT(vkCreateImage(m_vulkanInitializer->device, &imageInfo, nullptr, &image), "failed to create texture image.");
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_vulkanInitializer->device, image, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = m_vulkanInitializer->FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memRequirements.size);
+
+		ASSERT(m_vulkanInitializer->AllocateMemory(&allocInfo, &memory), "failed to allocate texture memory!");
+		ASSERT(vkBindImageMemory(m_vulkanInitializer->device, image, memory, 0));
+	}
+
+	VkImageView CreateView(VkImage image, VkFormat viewFormat, uint32_t baseMipLevel, uint32_t levelCount) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = viewFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+		viewInfo.subresourceRange.levelCount = levelCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		VkImageView view = VK_NULL_HANDLE;
+		ASSERT(vkCreateImageView(m_vulkanInitializer->device, &viewInfo, nullptr, &view), "failed to create texture image view.");
+
+		return view;
+	}
+
+	static void TransitionLevels(VkCommandBuffer commandBuffer, VkImage image, uint32_t baseMipLevel, uint32_t levelCount,
+		VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+		VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = baseMipLevel;
+		barrier.subresourceRange.levelCount = levelCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstAccessMask = dstAccessMask;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// 1x1 white, so an unloaded texture doesn't change the color it is multiplied with
+	void CreatePlaceholder() {
+		CreateImage(format, 1, 1, 1, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, placeholderImage, placeholderMemory);
+		placeholderView = CreateView(placeholderImage, format, 0, 1);
+
+		VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+		commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		commandPoolCreateInfo.queueFamilyIndex = m_vulkanInitializer->getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT);
+		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		ASSERT(vkCreateCommandPool(m_vulkanInitializer->device, &commandPoolCreateInfo, nullptr, &commandPool), "failed to create command pool.");
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		BeginOneTimeCommandBuffer(m_vulkanInitializer->device, commandPool, commandBuffer);
+
+		TransitionLevels(commandBuffer, placeholderImage, 0, 1,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		VkClearColorValue white = { { 1.0f, 1.0f, 1.0f, 1.0f } };
+		VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdClearColorImage(commandBuffer, placeholderImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &white, 1, &range);
+
+		TransitionLevels(commandBuffer, placeholderImage, 0, 1,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		EndOneTimeCommandBuffer(m_vulkanInitializer->device, m_vulkanInitializer->queue, commandPool, commandBuffer);
+
+		vkDestroyCommandPool(m_vulkanInitializer->device, commandPool, nullptr);
+	}
+
+	void CreateSampler() {
+		VkSamplerCreateInfo samplerInfo = {};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.minLod = 0.0f;
+		// the views decide which levels exist
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+		ASSERT(vkCreateSampler(m_vulkanInitializer->device, &samplerInfo, nullptr, &sampler), "failed to create texture sampler!");
+	}
+
+	void CreateDescriptors() {
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = m_settings.maxTextures;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+
+		ASSERT(vkCreateDescriptorSetLayout(m_vulkanInitializer->device, &layoutInfo, nullptr, &descriptorSetLayout), "failed to create descriptor set layout!");
+
+		VkDescriptorPoolSize poolSize = {};
+		poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSize.descriptorCount = m_settings.maxTextures * framesInFlight;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = framesInFlight;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		ASSERT(vkCreateDescriptorPool(m_vulkanInitializer->device, &poolInfo, nullptr, &descriptorPool), "failed to create descriptor pool!");
+
+		std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = framesInFlight;
+		allocInfo.pSetLayouts = layouts.data();
+
+		descriptorSets.resize(framesInFlight);
+		ASSERT(vkAllocateDescriptorSets(m_vulkanInitializer->device, &allocInfo, descriptorSets.data()), "failed to allocate descriptor sets!");
+
+		// every slot starts on the placeholder
+		std::vector<VkDescriptorImageInfo> imageInfos(m_settings.maxTextures);
+		for (auto& imageInfo : imageInfos) {
+			imageInfo.sampler = sampler;
+			imageInfo.imageView = placeholderView;
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+
+		std::vector<VkWriteDescriptorSet> writes(framesInFlight);
+		for (uint32_t i = 0; i < framesInFlight; i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSets[i];
+			writes[i].dstBinding = 0;
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[i].descriptorCount = m_settings.maxTextures;
+			writes[i].pImageInfo = imageInfos.data();
+		}
+
+		vkUpdateDescriptorSets(m_vulkanInitializer->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		boundViews.assign(framesInFlight, std::vector<VkImageView>(m_settings.maxTextures, placeholderView));
+	}
+
+	/*
+		queues a texture, returns its slot in the texture array right away. The slot shows the
+		placeholder until the texture arrives, and keeps it when the file can't be loaded.
+		Render thread only
+	*/
+	uint32_t Request(const std::string& path, float priority = 1.0f) {
+		uint32_t slot = 0;
+		for (uint32_t i = 1; i < textures.size(); i++) {
+			if (!textures[i]) {
+				slot = i;
+				break;
+			}
+		}
+		if (slot == 0) {
+			if (textures.size() >= m_settings.maxTextures) {
+				std::cout << "texture streamer: no free slot for " << path << std::endl;
+				return placeholderTexture;
+			}
+
+			slot = static_cast<uint32_t>(textures.size());
+			textures.emplace_back();
+		}
+
+		textures[slot] = std::make_unique<Texture>();
+		textures[slot]->path = path;
+		textures[slot]->priority = priority;
+		StartDecode(slot);
+
+		return slot;
+	}
+
+	// the texture is drawn in this frame, an evicted one is streamed in again
+	void Touch(uint32_t slot, uint64_t frameNumber) {
+		if (slot == placeholderTexture || slot >= textures.size() || !textures[slot]) {
+			return;
+		}
+
+		textures[slot]->lastUsedFrame = frameNumber;
+		if (textures[slot]->state == TextureEvicted) {
+			StartDecode(slot);
+		}
+	}
+
+	void StartDecode(uint32_t slot) {
+		uint64_t requestId = nextRequestId++;
+		const std::string& path = textures[slot]->path;
+		textures[slot]->requestId = requestId;
+		textures[slot]->state = TextureDecoding;
+
+		VkPhysicalDevice physicalDevice = m_vulkanInitializer->physicalDevice;
+		m_jobSystem->Run([this, slot, requestId, path, physicalDevice] {
+			DecodeResult result;
+			result.slot = slot;
+			result.requestId = requestId;
+			result.decoded = Decode(path, m_assetPack, physicalDevice);
+
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			decodedTextures.push_back(std::move(result));
+		}, &decodeJobs);
+	}
+
+	// the slot goes back to the placeholder, the image lives until the frames using it are done
+	void Release(uint32_t slot, uint64_t frameNumber) {
+		if (slot == placeholderTexture || slot >= textures.size() || !textures[slot]) {
+			return;
+		}
+
+		// a decode still running is thrown away when it arrives
+		std::shared_ptr<Texture> texture(std::move(textures[slot]));
+		deletionQueue.emplace_back(frameNumber + framesInFlight, [this, texture] { DestroyTexture(*texture); });
+	}
+
+	void DestroyTexture(Texture& texture) {
+		if (texture.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(m_vulkanInitializer->device, texture.view, nullptr);
+		}
+		if (texture.image != VK_NULL_HANDLE) {
+			vkDestroyImage(m_vulkanInitializer->device, texture.image, nullptr);
+			m_vulkanInitializer->FreeMemory(texture.memory);
+		}
+
+		texture.view = VK_NULL_HANDLE;
+		texture.image = VK_NULL_HANDLE;
+		texture.memory = VK_NULL_HANDLE;
+	}
+
+	// job thread, nullptr when the file can't be used
+	static std::unique_ptr<DecodedTexture> Decode(const std::string& path, const AssetPack* assetPack, VkPhysicalDevice physicalDevice) {
+		ByteSpan file;
+		if (assetPack) {
+			file = assetPack->Find(path);
+		}
+
+		std::vector<uint8_t> fileData;
+		if (file.Empty()) {
+			std::ifstream input(path, std::ios::ate | std::ios::binary);
+			if (!input.is_open()) {
+				return nullptr;
+			}
+
+			fileData.resize(static_cast<size_t>(input.tellg()));
+			input.seekg(0);
+			input.read(reinterpret_cast<char*>(fileData.data()), fileData.size());
+			if (!input) {
+				return nullptr;
+			}
+
+			file = ByteSpan{ fileData.data(), fileData.size() };
+		}
+
+		if (Ktx2::IsKtx2(file)) {
+			return DecodeKtx2(path, file, std::move(fileData), physicalDevice);
+		}
+
+		return DecodeBmp(file);
+	}
+
+	// linear filtering is what the sampler needs, transfers are implied on Vulkan 1.0
+	static bool IsFormatSampleable(VkPhysicalDevice physicalDevice, VkFormat format) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		return (properties.optimalTilingFeatures & required) == required;
+	}
+
+	/*
+		the stored levels as they are, or transcoded to RGBA8 when the device can't sample the
+		format. fileData owns the file bytes when they don't come from the asset pack
+	*/
+	static std::unique_ptr<DecodedTexture> DecodeKtx2(const std::string& path, ByteSpan file, std::vector<uint8_t> fileData, VkPhysicalDevice physicalDevice) {
+		Ktx2Texture ktx;
+		std::string error;
+		if (!Ktx2::Parse(file, ktx, error)) {
+			std::cout << "texture streamer: " << path << ": " << error << std::endl;
+			return nullptr;
+		}
+
+		std::unique_ptr<DecodedTexture> decoded = std::make_unique<DecodedTexture>();
+		decoded->sourceFormat = ktx.format;
+		decoded->format = ktx.format;
+
+		if (!IsFormatSampleable(physicalDevice, ktx.format->format)) {
+			if (!ktx.format->decoder || !IsFormatSampleable(physicalDevice, ktx.format->fallbackFormat)) {
+				std::cout << "texture streamer: " << path << ": " << ktx.format->name << " is not supported by the device" << std::endl;
+				return nullptr;
+			}
+
+			decoded->format = TextureTranscoder::FindFormat(ktx.format->fallbackFormat);
+		}
+
+		if (decoded->format == decoded->sourceFormat) {
+			// uploaded straight from the file
+			for (const Ktx2Level& level : ktx.levels) {
+				decoded->mips.push_back({ level.width, level.height, static_cast<size_t>(level.data.data - file.data) });
+			}
+			decoded->pixels = std::move(fileData);
+			decoded->data = file;
+
+			return decoded;
+		}
+
+		size_t totalSize = 0;
+		for (const Ktx2Level& level : ktx.levels) {
+			decoded->mips.push_back({ level.width, level.height, totalSize });
+			totalSize += TextureTranscoder::LevelSize(*decoded->format, level.width, level.height);
+		}
+		decoded->pixels.resize(totalSize);
+		decoded->data = ByteSpan{ decoded->pixels.data(), decoded->pixels.size() };
+
+		for (size_t i = 0; i < ktx.levels.size(); i++) {
+			const Ktx2Level& level = ktx.levels[i];
+			TextureTranscoder::DecodeLevel(*ktx.format, level.data, level.width, level.height, decoded->pixels.data() + decoded->mips[i].offset);
+		}
+
+		return decoded;
+	}
+
+	// RGBA8 with the whole mip chain
+	static std::unique_ptr<DecodedTexture> DecodeBmp(ByteSpan file) {
+		SDL_Surface* loaded = SDL_LoadBMP_RW(SDL_RWFromConstMem(file.data, static_cast<int>(file.size)), 1);
+		if (!loaded) {
+			return nullptr;
+		}
+
+		// byte order R, G, B, A in memory
+		SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ABGR8888, 0);
+		SDL_FreeSurface(loaded);
+		if (!surface) {
+			return nullptr;
+		}
+
+		std::unique_ptr<DecodedTexture> decoded = std::make_unique<DecodedTexture>();
+		decoded->format = TextureTranscoder::FindFormat(VK_FORMAT_R8G8B8A8_UNORM);
+		decoded->sourceFormat = decoded->format;
+
+		uint32_t width = static_cast<uint32_t>(surface->w);
+		uint32_t height = static_cast<uint32_t>(surface->h);
+
+		// every level up to 1x1, each one sized half of the previous one
+		size_t totalSize = 0;
+		for (uint32_t levelWidth = width, levelHeight = height; ; levelWidth = std::max(1u, levelWidth / 2), levelHeight = std::max(1u, levelHeight / 2)) {
+			decoded->mips.push_back({ levelWidth, levelHeight, totalSize });
+			totalSize += static_cast<size_t>(levelWidth) * levelHeight * bytesPerPixel;
+
+			if (levelWidth == 1 && levelHeight == 1) {
+				break;
+			}
+		}
+		decoded->pixels.resize(totalSize);
+		decoded->data = ByteSpan{ decoded->pixels.data(), decoded->pixels.size() };
+
+		SDL_LockSurface(surface);
+		for (uint32_t y = 0; y < height; y++) {
+			const uint8_t* source = static_cast<const uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch;
+			std::copy(source, source + width * bytesPerPixel, decoded->pixels.begin() + static_cast<size_t>(y) * width * bytesPerPixel);
+		}
+		SDL_UnlockSurface(surface);
+		SDL_FreeSurface(surface);
+
+		for (size_t level = 1; level < decoded->mips.size(); level++) {
+			Downsample(*decoded, decoded->mips[level - 1], decoded->mips[level]);
+		}
+
+		return decoded;
+	}
+
+	// 2x2 box filter, the last row or column is repeated on odd sizes
+	static void Downsample(DecodedTexture& decoded, const MipLevel& source, const MipLevel& destination) {
+		const uint8_t* sourcePixels = decoded.pixels.data() + source.offset;
+		uint8_t* destinationPixels = decoded.pixels.data() + destination.offset;
+
+		for (uint32_t y = 0; y < destination.height; y++) {
+			uint32_t y0 = std::min(y * 2, source.height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+
+			for (uint32_t x = 0; x < destination.width; x++) {
+				uint32_t x0 = std::min(x * 2, source.width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+
+				for (uint32_t channel = 0; channel < bytesPerPixel; channel++) {
+					uint32_t sum =
+						sourcePixels[(static_cast<size_t>(y0) * source.width + x0) * bytesPerPixel + channel] +
+						sourcePixels[(static_cast<size_t>(y0) * source.width + x1) * bytesPerPixel + channel] +
+						sourcePixels[(static_cast<size_t>(y1) * source.width + x0) * bytesPerPixel + channel] +
+						sourcePixels[(static_cast<size_t>(y1) * source.width + x1) * bytesPerPixel + channel];
+
+					destinationPixels[(static_cast<size_t>(y) * destination.width + x) * bytesPerPixel + channel] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	// contiguous space in the ring, false when the frames in flight still use it
+	bool AllocateStaging(VkDeviceSize size, VkDeviceSize& offset) {
+		const VkDeviceSize alignment = 16;
+		VkDeviceSize start = (stagingHead + alignment - 1) / alignment * alignment;
+		bool empty = stagingRegions.empty() && !stagingAllocatedThisFrame;
+
+		if (empty || stagingHead > stagingTail) {
+			// free space is [head, end) and [0, tail)
+			if (start + size <= m_settings.stagingSize) {
+				offset = start;
+			}
+			else if (size <= (empty ? m_settings.stagingSize : stagingTail)) {
+				offset = 0;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (stagingHead < stagingTail && start + size <= stagingTail) {
+			offset = start;
+		}
+		else {
+			return false;
+		}
+
+		stagingHead = offset + size;
+		stagingAllocatedThisFrame = true;
+
+		return true;
+	}
+
+	void ReleaseFinishedFrames(uint64_t completedFrames) {
+		while (!stagingRegions.empty() && stagingRegions.front().frameNumber < completedFrames) {
+			stagingTail = stagingRegions.front().end;
+			stagingRegions.pop_front();
+		}
+		if (stagingRegions.empty()) {
+			stagingHead = 0;
+			stagingTail = 0;
+		}
+
+		while (!deletionQueue.empty() && deletionQueue.front().first < completedFrames) {
+			deletionQueue.front().second();
+			deletionQueue.pop_front();
+		}
+	}
+
+	// decoded textures get their image, every level waiting for the copies
+	void AcceptDecodedTextures(VkCommandBuffer commandBuffer) {
+		std::vector<DecodeResult> results;
+		{
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			std::swap(results, decodedTextures);
+		}
+
+		for (auto& result : results) {
+			Texture* texture = textures[result.slot].get();
+			// released while decoding
+			if (!texture || texture->requestId != result.requestId) {
+				continue;
+			}
+
+			if (!result.decoded) {
+				std::cout << "texture streamer: failed to load " << texture->path << std::endl;
+				texture->state = TextureFailed;
+				continue;
+			}
+
+			texture->decoded = std::move(result.decoded);
+			texture->format = texture->decoded->format;
+			texture->mipLevels = static_cast<uint32_t>(texture->decoded->mips.size());
+			texture->uploadMip = texture->mipLevels - 1;
+			texture->uploadRow = 0;
+			texture->residentMip = texture->mipLevels;
+
+			texture->gpuBytes = 0;
+			texture->rgba8Bytes = 0;
+			for (const MipLevel& mip : texture->decoded->mips) {
+				texture->gpuBytes += TextureTranscoder::LevelSize(*texture->format, mip.width, mip.height);
+				texture->rgba8Bytes += static_cast<VkDeviceSize>(mip.width) * mip.height * bytesPerPixel;
+			}
+
+			if (texture->decoded->sourceFormat != texture->decoded->format) {
+				std::cout << "texture streamer: " << texture->path << ": no device support for " << texture->decoded->sourceFormat->name
+					<< ", transcoded to " << texture->format->name << std::endl;
+			}
+			else if (texture->gpuBytes < texture->rgba8Bytes) {
+				std::cout << "texture streamer: " << texture->path << ": " << texture->format->name << " "
+					<< texture->gpuBytes / 1024 << " KiB instead of " << texture->rgba8Bytes / 1024 << " KiB as RGBA8, "
+					<< 100 - texture->gpuBytes * 100 / texture->rgba8Bytes << "% saved" << std::endl;
+			}
+
+			const MipLevel& base = texture->decoded->mips[0];
+			CreateImage(texture->format->format, base.width, base.height, texture->mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, texture->image, texture->memory);
+
+			TransitionLevels(commandBuffer, texture->image, 0, texture->mipLevels,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+			texture->state = TextureUploading;
+		}
+	}
+
+	/*
+		records this frame's uploads into commandBuffer, before any pass samples the textures.
+		completedFrames is the number of frames the GPU is done with
+	*/
+	void Update(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint64_t frameNumber, uint64_t completedFrames) {
+		ReleaseFinishedFrames(completedFrames);
+		AcceptDecodedTextures(commandBuffer);
+		EvictOverBudget(frameNumber);
+
+		VkDeviceSize budget = m_settings.uploadBudgetBytes;
+		stagingAllocatedThisFrame = false;
+
+		for (uint32_t slot = 1; slot < textures.size() && budget > 0; slot++) {
+			Texture* texture = textures[slot].get();
+			if (!texture || texture->state != TextureUploading) {
+				continue;
+			}
+
+			if (!UploadTexture(commandBuffer, *texture, budget, frameNumber)) {
+				// out of budget or staging space
+				break;
+			}
+		}
+
+		if (stagingAllocatedThisFrame) {
+			stagingRegions.push_back({ frameNumber, stagingHead });
+		}
+
+		UpdateDescriptors(frameIndex);
+	}
+
+	bool IsOverBudget(uint32_t heap) const {
+		VulkanInitializer::HeapBudget heapBudget = m_vulkanInitializer->GetHeapBudget(heap);
+		VkDeviceSize usage = heapBudget.usage - std::min(heapBudget.usage, evictingBytes[heap]);
+		return usage > heapBudget.budget / 100 * m_settings.evictionBudgetPercent;
+	}
+
+	// one texture at a time, what it frees counts right away even though it is freed frames later
+	void EvictOverBudget(uint64_t frameNumber) {
+		for (;;) {
+			Texture* victim = nullptr;
+			for (uint32_t slot = 1; slot < textures.size(); slot++) {
+				Texture* texture = textures[slot].get();
+				if (!texture || texture->memory == VK_NULL_HANDLE || texture->lastUsedFrame + m_settings.evictionUnusedFrames > frameNumber) {
+					continue;
+				}
+
+				uint32_t heap = m_vulkanInitializer->GetAllocation(texture->memory).heap;
+				if (heap == UINT32_MAX || !IsOverBudget(heap)) {
+					continue;
+				}
+
+				bool lessValuable = !victim || texture->priority < victim->priority
+					|| (texture->priority == victim->priority && texture->lastUsedFrame < victim->lastUsedFrame);
+				if (lessValuable) {
+					victim = texture;
+				}
+			}
+
+			if (!victim) {
+				return;
+			}
+
+			Evict(*victim, frameNumber);
+		}
+	}
+
+	// the slot goes back to the placeholder, the texture keeps its path and priority to come back
+	void Evict(Texture& texture, uint64_t frameNumber) {
+		VkImage image = texture.image;
+		VkDeviceMemory memory = texture.memory;
+		VkImageView view = texture.view;
+		VulkanInitializer::Allocation allocation = m_vulkanInitializer->GetAllocation(memory);
+
+		evictingBytes[allocation.heap] += allocation.size;
+		deletionQueue.emplace_back(frameNumber + framesInFlight, [this, image, memory, view, allocation] {
+			vkDestroyImageView(m_vulkanInitializer->device, view, nullptr);
+			vkDestroyImage(m_vulkanInitializer->device, image, nullptr);
+			m_vulkanInitializer->FreeMemory(memory);
+			evictingBytes[allocation.heap] -= allocation.size;
+		});
+
+		texture.image = VK_NULL_HANDLE;
+		texture.memory = VK_NULL_HANDLE;
+		texture.view = VK_NULL_HANDLE;
+		texture.decoded.reset();
+		texture.residentMip = texture.mipLevels;
+		texture.state = TextureEvicted;
+
+		evictedTextures++;
+		evictedBytes += texture.gpuBytes;
+	}
+
+	// returns false when the budget or the ring ran out before the texture was done
+	bool UploadTexture(VkCommandBuffer commandBuffer, Texture& texture, VkDeviceSize& budget, uint64_t frameNumber) {
+		const TextureTranscoder::FormatInfo& format = *texture.format;
+
+		while (texture.state == TextureUploading) {
+			// rows are rows of blocks, single pixels for uncompressed formats
+			const MipLevel& mip = texture.decoded->mips[texture.uploadMip];
+			uint32_t blockRows = (mip.height + format.blockHeight - 1) / format.blockHeight;
+			VkDeviceSize rowSize = static_cast<VkDeviceSize>((mip.width + format.blockWidth - 1) / format.blockWidth) * format.blockBytes;
+
+			// as many rows as the budget allows, a single row always goes through
+			uint32_t rows = static_cast<uint32_t>(std::min<VkDeviceSize>(blockRows - texture.uploadRow, std::max<VkDeviceSize>(budget / rowSize, 1)));
+			if (rowSize * rows > budget && budget < m_settings.uploadBudgetBytes) {
+				return false;
+			}
+
+			VkDeviceSize offset = 0;
+			if (!AllocateStaging(rowSize * rows, offset)) {
+				return false;
+			}
+
+			const uint8_t* source = texture.decoded->data.data + mip.offset + static_cast<size_t>(texture.uploadRow) * rowSize;
+			std::copy(source, source + rowSize * rows, stagingMapped + offset);
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = texture.uploadMip;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			// the last row of blocks may hang over the level, the extent stops at its edge
+			uint32_t y = texture.uploadRow * format.blockHeight;
+			region.imageOffset = { 0, static_cast<int32_t>(y), 0 };
+			region.imageExtent = { mip.width, std::min(rows * format.blockHeight, mip.height - y), 1 };
+
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+			budget -= std::min(budget, rowSize * rows);
+			uploadedBytes += rowSize * rows;
+			texture.uploadRow += rows;
+
+			if (texture.uploadRow < blockRows) {
+				continue;
+			}
+
+			// level complete, it can be sampled from now on
+			TransitionLevels(commandBuffer, texture.image, texture.uploadMip, 1,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+			texture.residentMip = texture.uploadMip;
+			texture.uploadRow = 0;
+
+			// the view grows to the new level, the old one is still bound by the frames in flight
+			if (texture.view != VK_NULL_HANDLE) {
+				VkImageView oldView = texture.view;
+				deletionQueue.emplace_back(frameNumber + framesInFlight, [this, oldView] {
+					vkDestroyImageView(m_vulkanInitializer->device, oldView, nullptr);
+				});
+			}
+			texture.view = CreateView(texture.image, format.format, texture.residentMip, texture.mipLevels - texture.residentMip);
+
+			if (texture.uploadMip == 0) {
+				texture.state = TextureResident;
+				texture.decoded.reset();
+			}
+			else {
+				texture.uploadMip--;
+			}
+
+			if (budget == 0) {
+				return texture.state == TextureResident;
+			}
+		}
+
+		return true;
+	}
+
+	// the set of this frame isn't used by the GPU anymore, it can take the new views
+	void UpdateDescriptors(uint32_t frameIndex) {
+		std::vector<VkDescriptorImageInfo> imageInfos;
+		std::vector<uint32_t> slots;
+
+		for (uint32_t slot = 0; slot < m_settings.maxTextures; slot++) {
+			VkImageView view = placeholderView;
+			if (slot < textures.size() && textures[slot] && textures[slot]->view != VK_NULL_HANDLE) {
+				view = textures[slot]->view;
+			}
+
+			if (boundViews[frameIndex][slot] == view) {
+				continue;
+			}
+
+			boundViews[frameIndex][slot] = view;
+
+			VkDescriptorImageInfo imageInfo{};
+			imageInfo.sampler = sampler;
+			imageInfo.imageView = view;
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			imageInfos.push_back(imageInfo);
+			slots.push_back(slot);
+		}
+
+		std::vector<VkWriteDescriptorSet> writes(slots.size());
+		for (size_t i = 0; i < slots.size(); i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSets[frameIndex];
+			writes[i].dstBinding = 0;
+			writes[i].dstArrayElement = slots[i];
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[i].descriptorCount = 1;
+			writes[i].pImageInfo = &imageInfos[i];
+		}
+
+		if (!writes.empty()) {
+			vkUpdateDescriptorSets(m_vulkanInitializer->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+			descriptorWrites++;
+		}
+	}
+
+	VkDescriptorSet GetDescriptorSet(uint32_t frameIndex) const {
+		return descriptorSets[frameIndex];
+	}
+
+	// memory the resident textures save over RGBA8
+	VkDeviceSize SavedBytes() const {
+		VkDeviceSize saved = 0;
+		for (const auto& texture : textures) {
+			if (texture && texture->state == TextureResident && texture->gpuBytes < texture->rgba8Bytes) {
+				saved += texture->rgba8Bytes - texture->gpuBytes;
+			}
+		}
+		return saved;
+	}
+
+	uint32_t CountTextures(TextureState state) const {
+		uint32_t count = 0;
+		for (const auto& texture : textures) {
+			if (texture && texture->state == state) {
+				count++;
+			}
+		}
+		return count;
+	}
+};
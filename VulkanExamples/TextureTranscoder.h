@@ -0,0 +1,561 @@
+/*
+	CPU decoders for block compressed formats, used when the device can't sample a format.
+
+	Every decoder writes one 4x4 block as 16 RGBA8 pixels, row by row. Single and two channel
+	formats fill the missing channels the way the GPU would sample them: 0 for green and
+	blue, 255 for alpha.
+
+	BC formats follow the Direct3D block layouts, ETC2 and EAC the Khronos data format spec.
+	The format table at the end lists every format the texture streamer accepts.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "ByteSpan.h"
+
+#include "vulkan/vulkan.h"
+
+namespace TextureTranscoder {
+
+	static inline uint8_t Clamp255(int32_t value) {
+		return static_cast<uint8_t>(std::min(255, std::max(0, value)));
+	}
+
+	static inline uint64_t ReadLittleEndian64(const uint8_t* bytes) {
+		uint64_t value = 0;
+		for (int i = 7; i >= 0; i--) {
+			value = (value << 8) | bytes[i];
+		}
+		return value;
+	}
+
+	// ETC blocks are stored big endian
+	static inline uint64_t ReadBigEndian64(const uint8_t* bytes) {
+		uint64_t value = 0;
+		for (int i = 0; i < 8; i++) {
+			value = (value << 8) | bytes[i];
+		}
+		return value;
+	}
+
+	static inline uint32_t Bits(uint64_t value, uint32_t high, uint32_t low) {
+		return static_cast<uint32_t>((value >> low) & ((uint64_t(1) << (high - low + 1)) - 1));
+	}
+
+	/*
+		BC1 to BC5
+	*/
+
+	static void Rgb565(uint16_t color, uint8_t* rgb) {
+		uint32_t r = (color >> 11) & 0x1f;
+		uint32_t g = (color >> 5) & 0x3f;
+		uint32_t b = color & 0x1f;
+
+		rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+		rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+		rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+	}
+
+	// color part of BC1, BC2 and BC3. BC2 and BC3 always use the four color mode
+	static void DecodeBc1Colors(const uint8_t* block, uint8_t* pixels, bool forceFourColors) {
+		uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+		uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+		uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+
+		uint8_t palette[4][4] = {};
+		Rgb565(color0, palette[0]);
+		Rgb565(color1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+		for (int channel = 0; channel < 3; channel++) {
+			if (color0 > color1 || forceFourColors) {
+				palette[2][channel] = static_cast<uint8_t>((2 * palette[0][channel] + palette[1][channel] + 1) / 3);
+				palette[3][channel] = static_cast<uint8_t>((palette[0][channel] + 2 * palette[1][channel] + 1) / 3);
+			}
+			else {
+				palette[2][channel] = static_cast<uint8_t>((palette[0][channel] + palette[1][channel] + 1) / 2);
+				palette[3][channel] = 0;
+			}
+		}
+		if (color0 <= color1 && !forceFourColors) {
+			// transparent black
+			palette[3][3] = 0;
+		}
+
+		for (uint32_t i = 0; i < 16; i++) {
+			std::memcpy(pixels + i * 4, palette[(indices >> (i * 2)) & 0x3], 4);
+		}
+	}
+
+	static void DecodeBc1(const uint8_t* block, uint8_t* pixels) {
+		DecodeBc1Colors(block, pixels, false);
+	}
+
+	// BC4 style channel, 8 interpolated values from two endpoints
+	static void DecodeBc4Channel(const uint8_t* block, uint8_t* pixels, uint32_t channel) {
+		uint32_t value0 = block[0];
+		uint32_t value1 = block[1];
+
+		uint8_t palette[8];
+		palette[0] = static_cast<uint8_t>(value0);
+		palette[1] = static_cast<uint8_t>(value1);
+		if (value0 > value1) {
+			for (uint32_t i = 1; i < 7; i++) {
+				palette[i + 1] = static_cast<uint8_t>(((7 - i) * value0 + i * value1 + 3) / 7);
+			}
+		}
+		else {
+			for (uint32_t i = 1; i < 5; i++) {
+				palette[i + 1] = static_cast<uint8_t>(((5 - i) * value0 + i * value1 + 2) / 5);
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = ReadLittleEndian64(block) >> 16;
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + channel] = palette[(indices >> (i * 3)) & 0x7];
+		}
+	}
+
+	// the RGB variant has no alpha, the transparent color of the three color mode is black
+	static void DecodeBc1Rgb(const uint8_t* block, uint8_t* pixels) {
+		DecodeBc1Colors(block, pixels, false);
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + 3] = 255;
+		}
+	}
+
+	static void DecodeBc2(const uint8_t* block, uint8_t* pixels) {
+		DecodeBc1Colors(block + 8, pixels, true);
+
+		uint64_t alphas = ReadLittleEndian64(block);
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + 3] = static_cast<uint8_t>(((alphas >> (i * 4)) & 0xf) * 17);
+		}
+	}
+
+	static void DecodeBc3(const uint8_t* block, uint8_t* pixels) {
+		DecodeBc1Colors(block + 8, pixels, true);
+		DecodeBc4Channel(block, pixels, 3);
+	}
+
+	static void DecodeBc4(const uint8_t* block, uint8_t* pixels) {
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + 1] = 0;
+			pixels[i * 4 + 2] = 0;
+			pixels[i * 4 + 3] = 255;
+		}
+		DecodeBc4Channel(block, pixels, 0);
+	}
+
+	static void DecodeBc5(const uint8_t* block, uint8_t* pixels) {
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + 2] = 0;
+			pixels[i * 4 + 3] = 255;
+		}
+		DecodeBc4Channel(block, pixels, 0);
+		DecodeBc4Channel(block + 8, pixels, 1);
+	}
+
+	/*
+		ETC2 and EAC
+	*/
+
+	static const int32_t etcModifiers[8][4] = {
+		{ 2, 8, -2, -8 },
+		{ 5, 17, -5, -17 },
+		{ 9, 29, -9, -29 },
+		{ 13, 42, -13, -42 },
+		{ 18, 60, -18, -60 },
+		{ 24, 80, -24, -80 },
+		{ 33, 106, -33, -106 },
+		{ 47, 183, -47, -183 },
+	};
+
+	static const int32_t etcDistances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+	static const int32_t eacModifiers[16][8] = {
+		{ -3, -6, -9, -15, 2, 5, 8, 14 },
+		{ -3, -7, -10, -13, 2, 6, 9, 12 },
+		{ -2, -5, -8, -13, 1, 4, 7, 12 },
+		{ -2, -4, -6, -13, 1, 3, 5, 12 },
+		{ -3, -6, -8, -12, 2, 5, 7, 11 },
+		{ -3, -7, -9, -11, 2, 6, 8, 10 },
+		{ -4, -7, -8, -11, 3, 6, 7, 10 },
+		{ -3, -5, -8, -11, 2, 4, 7, 10 },
+		{ -2, -6, -8, -10, 1, 5, 7, 9 },
+		{ -2, -5, -8, -10, 1, 4, 7, 9 },
+		{ -2, -4, -8, -10, 1, 3, 7, 9 },
+		{ -2, -5, -7, -10, 1, 4, 6, 9 },
+		{ -3, -4, -7, -10, 2, 3, 6, 9 },
+		{ -1, -2, -3, -10, 0, 1, 2, 9 },
+		{ -4, -6, -8, -9, 3, 5, 7, 8 },
+		{ -3, -5, -7, -9, 2, 4, 6, 8 },
+	};
+
+	static inline uint8_t Extend4(uint32_t value) {
+		return static_cast<uint8_t>((value << 4) | value);
+	}
+
+	static inline uint8_t Extend5(uint32_t value) {
+		return static_cast<uint8_t>((value << 3) | (value >> 2));
+	}
+
+	static inline uint8_t Extend6(uint32_t value) {
+		return static_cast<uint8_t>((value << 2) | (value >> 4));
+	}
+
+	static inline uint8_t Extend7(uint32_t value) {
+		return static_cast<uint8_t>((value << 1) | (value >> 6));
+	}
+
+	// index of the pixel at x, y in the ETC pixel index bits, the block is stored column by column
+	static inline uint32_t EtcPixelIndex(uint64_t block, uint32_t x, uint32_t y) {
+		uint32_t bit = x * 4 + y;
+		uint32_t msb = static_cast<uint32_t>((block >> (16 + bit)) & 1);
+		uint32_t lsb = static_cast<uint32_t>((block >> bit) & 1);
+		return (msb << 1) | lsb;
+	}
+
+	static inline void SetPixel(uint8_t* pixels, uint32_t x, uint32_t y, int32_t r, int32_t g, int32_t b, uint8_t a) {
+		uint8_t* pixel = pixels + (y * 4 + x) * 4;
+		pixel[0] = Clamp255(r);
+		pixel[1] = Clamp255(g);
+		pixel[2] = Clamp255(b);
+		pixel[3] = a;
+	}
+
+	/*
+		ETC2 RGB block, with punchThrough the diff bit becomes the opaque bit of the
+		RGB8A1 format and the individual mode doesn't exist
+	*/
+	static void DecodeEtc2Colors(const uint8_t* bytes, uint8_t* pixels, bool punchThrough) {
+		uint64_t block = ReadBigEndian64(bytes);
+
+		bool diffBit = Bits(block, 33, 33) != 0;
+		bool opaque = !punchThrough || diffBit;
+		bool differential = punchThrough || diffBit;
+
+		if (!differential) {
+			// individual mode, two 4 bit colors
+			int32_t base[2][3] = {
+				{ Extend4(Bits(block, 63, 60)), Extend4(Bits(block, 55, 52)), Extend4(Bits(block, 47, 44)) },
+				{ Extend4(Bits(block, 59, 56)), Extend4(Bits(block, 51, 48)), Extend4(Bits(block, 43, 40)) },
+			};
+			uint32_t tables[2] = { Bits(block, 39, 37), Bits(block, 36, 34) };
+			bool flip = Bits(block, 32, 32) != 0;
+
+			for (uint32_t y = 0; y < 4; y++) {
+				for (uint32_t x = 0; x < 4; x++) {
+					uint32_t subblock = flip ? (y >= 2) : (x >= 2);
+					int32_t modifier = etcModifiers[tables[subblock]][EtcPixelIndex(block, x, y)];
+					SetPixel(pixels, x, y, base[subblock][0] + modifier, base[subblock][1] + modifier, base[subblock][2] + modifier, 255);
+				}
+			}
+			return;
+		}
+
+		int32_t r = Bits(block, 63, 59);
+		int32_t g = Bits(block, 55, 51);
+		int32_t b = Bits(block, 47, 43);
+		// 3 bit two's complement deltas
+		int32_t dr = static_cast<int32_t>(Bits(block, 58, 56) << 29) >> 29;
+		int32_t dg = static_cast<int32_t>(Bits(block, 50, 48) << 29) >> 29;
+		int32_t db = static_cast<int32_t>(Bits(block, 42, 40) << 29) >> 29;
+
+		if (r + dr < 0 || r + dr > 31) {
+			// T mode
+			int32_t color0[3] = {
+				Extend4((Bits(block, 60, 59) << 2) | Bits(block, 57, 56)),
+				Extend4(Bits(block, 55, 52)),
+				Extend4(Bits(block, 51, 48)),
+			};
+			int32_t color1[3] = { Extend4(Bits(block, 47, 44)), Extend4(Bits(block, 43, 40)), Extend4(Bits(block, 39, 36)) };
+			int32_t distance = etcDistances[(Bits(block, 35, 34) << 1) | Bits(block, 32, 32)];
+
+			int32_t paint[4][3];
+			for (int channel = 0; channel < 3; channel++) {
+				paint[0][channel] = color0[channel];
+				paint[1][channel] = color1[channel] + distance;
+				paint[2][channel] = color1[channel];
+				paint[3][channel] = color1[channel] - distance;
+			}
+
+			for (uint32_t y = 0; y < 4; y++) {
+				for (uint32_t x = 0; x < 4; x++) {
+					uint32_t index = EtcPixelIndex(block, x, y);
+					if (!opaque && index == 2) {
+						SetPixel(pixels, x, y, 0, 0, 0, 0);
+						continue;
+					}
+					SetPixel(pixels, x, y, paint[index][0], paint[index][1], paint[index][2], 255);
+				}
+			}
+			return;
+		}
+
+		if (g + dg < 0 || g + dg > 31) {
+			// H mode
+			uint32_t r0 = Bits(block, 62, 59);
+			uint32_t g0 = (Bits(block, 58, 56) << 1) | Bits(block, 52, 52);
+			uint32_t b0 = (Bits(block, 51, 51) << 3) | Bits(block, 49, 47);
+			uint32_t r1 = Bits(block, 46, 43);
+			uint32_t g1 = Bits(block, 42, 39);
+			uint32_t b1 = Bits(block, 38, 35);
+
+			// the order of the two colors holds the lowest bit of the distance index
+			uint32_t order = ((r0 << 8) | (g0 << 4) | b0) >= ((r1 << 8) | (g1 << 4) | b1) ? 1 : 0;
+			int32_t distance = etcDistances[(Bits(block, 34, 34) << 2) | (Bits(block, 32, 32) << 1) | order];
+
+			int32_t color0[3] = { Extend4(r0), Extend4(g0), Extend4(b0) };
+			int32_t color1[3] = { Extend4(r1), Extend4(g1), Extend4(b1) };
+
+			int32_t paint[4][3];
+			for (int channel = 0; channel < 3; channel++) {
+				paint[0][channel] = color0[channel] + distance;
+				paint[1][channel] = color0[channel] - distance;
+				paint[2][channel] = color1[channel] + distance;
+				paint[3][channel] = color1[channel] - distance;
+			}
+
+			for (uint32_t y = 0; y < 4; y++) {
+				for (uint32_t x = 0; x < 4; x++) {
+					uint32_t index = EtcPixelIndex(block, x, y);
+					if (!opaque && index == 2) {
+						SetPixel(pixels, x, y, 0, 0, 0, 0);
+						continue;
+					}
+					SetPixel(pixels, x, y, paint[index][0], paint[index][1], paint[index][2], 255);
+				}
+			}
+			return;
+		}
+
+		if (b + db < 0 || b + db > 31) {
+			// planar mode, three colors interpolated over the block, always opaque
+			int32_t origin[3] = {
+				Extend6(Bits(block, 62, 57)),
+				Extend7((Bits(block, 56, 56) << 6) | Bits(block, 54, 49)),
+				Extend6((Bits(block, 48, 48) << 5) | (Bits(block, 44, 43) << 3) | Bits(block, 41, 39)),
+			};
+			int32_t horizontal[3] = {
+				Extend6((Bits(block, 38, 34) << 1) | Bits(block, 32, 32)),
+				Extend7(Bits(block, 31, 25)),
+				Extend6(Bits(block, 24, 19)),
+			};
+			int32_t vertical[3] = {
+				Extend6(Bits(block, 18, 13)),
+				Extend7(Bits(block, 12, 6)),
+				Extend6(Bits(block, 5, 0)),
+			};
+
+			for (uint32_t y = 0; y < 4; y++) {
+				for (uint32_t x = 0; x < 4; x++) {
+					int32_t color[3];
+					for (int channel = 0; channel < 3; channel++) {
+						color[channel] = (static_cast<int32_t>(x) * (horizontal[channel] - origin[channel]) +
+							static_cast<int32_t>(y) * (vertical[channel] - origin[channel]) +
+							4 * origin[channel] + 2) >> 2;
+					}
+					SetPixel(pixels, x, y, color[0], color[1], color[2], 255);
+				}
+			}
+			return;
+		}
+
+		// differential mode, 5 bit base color and a delta for the second subblock
+		int32_t base[2][3] = {
+			{ Extend5(r), Extend5(g), Extend5(b) },
+			{ Extend5(r + dr), Extend5(g + dg), Extend5(b + db) },
+		};
+		uint32_t tables[2] = { Bits(block, 39, 37), Bits(block, 36, 34) };
+		bool flip = Bits(block, 32, 32) != 0;
+
+		for (uint32_t y = 0; y < 4; y++) {
+			for (uint32_t x = 0; x < 4; x++) {
+				uint32_t subblock = flip ? (y >= 2) : (x >= 2);
+				uint32_t index = EtcPixelIndex(block, x, y);
+
+				if (!opaque && index == 2) {
+					SetPixel(pixels, x, y, 0, 0, 0, 0);
+					continue;
+				}
+
+				// without the opaque bit the small modifiers are zero
+				int32_t modifier = etcModifiers[tables[subblock]][index];
+				if (!opaque && (index & 1) == 0) {
+					modifier = 0;
+				}
+
+				SetPixel(pixels, x, y, base[subblock][0] + modifier, base[subblock][1] + modifier, base[subblock][2] + modifier, 255);
+			}
+		}
+	}
+
+	// 8 bit EAC channel, the alpha of ETC2 RGBA8
+	static void DecodeEacChannel8(const uint8_t* bytes, uint8_t* pixels, uint32_t channel) {
+		uint64_t block = ReadBigEndian64(bytes);
+
+		int32_t base = Bits(block, 63, 56);
+		int32_t multiplier = Bits(block, 55, 52);
+		const int32_t* modifiers = eacModifiers[Bits(block, 51, 48)];
+
+		for (uint32_t x = 0; x < 4; x++) {
+			for (uint32_t y = 0; y < 4; y++) {
+				uint32_t bit = 45 - (x * 4 + y) * 3;
+				int32_t value = base + modifiers[Bits(block, bit + 2, bit)] * multiplier;
+				pixels[(y * 4 + x) * 4 + channel] = Clamp255(value);
+			}
+		}
+	}
+
+	// 11 bit EAC channel, kept to its 8 most significant bits
+	static void DecodeEacChannel11(const uint8_t* bytes, uint8_t* pixels, uint32_t channel) {
+		uint64_t block = ReadBigEndian64(bytes);
+
+		int32_t base = Bits(block, 63, 56);
+		int32_t multiplier = Bits(block, 55, 52);
+		const int32_t* modifiers = eacModifiers[Bits(block, 51, 48)];
+
+		for (uint32_t x = 0; x < 4; x++) {
+			for (uint32_t y = 0; y < 4; y++) {
+				uint32_t bit = 45 - (x * 4 + y) * 3;
+				int32_t modifier = modifiers[Bits(block, bit + 2, bit)];
+				int32_t value = base * 8 + 4 + (multiplier != 0 ? modifier * multiplier * 8 : modifier);
+				value = std::min(2047, std::max(0, value));
+				pixels[(y * 4 + x) * 4 + channel] = static_cast<uint8_t>(value >> 3);
+			}
+		}
+	}
+
+	static void DecodeEtc2Rgb(const uint8_t* block, uint8_t* pixels) {
+		DecodeEtc2Colors(block, pixels, false);
+	}
+
+	static void DecodeEtc2Rgba1(const uint8_t* block, uint8_t* pixels) {
+		DecodeEtc2Colors(block, pixels, true);
+	}
+
+	static void DecodeEtc2Rgba8(const uint8_t* block, uint8_t* pixels) {
+		DecodeEtc2Colors(block + 8, pixels, false);
+		DecodeEacChannel8(block, pixels, 3);
+	}
+
+	static void DecodeEacR11(const uint8_t* block, uint8_t* pixels) {
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + 1] = 0;
+			pixels[i * 4 + 2] = 0;
+			pixels[i * 4 + 3] = 255;
+		}
+		DecodeEacChannel11(block, pixels, 0);
+	}
+
+	static void DecodeEacRg11(const uint8_t* block, uint8_t* pixels) {
+		for (uint32_t i = 0; i < 16; i++) {
+			pixels[i * 4 + 2] = 0;
+			pixels[i * 4 + 3] = 255;
+		}
+		DecodeEacChannel11(block, pixels, 0);
+		DecodeEacChannel11(block + 8, pixels, 1);
+	}
+
+	typedef void (*BlockDecoder)(const uint8_t* block, uint8_t* pixels);
+
+	// block layout of a format and how to get it to RGBA8 when the device can't sample it
+	struct FormatInfo {
+		VkFormat format;
+		const char* name;
+		uint32_t blockWidth;
+		uint32_t blockHeight;
+		uint32_t blockBytes;
+		// null when there is no CPU fallback
+		BlockDecoder decoder;
+		VkFormat fallbackFormat;
+	};
+
+	static const FormatInfo formats[] = {
+		{ VK_FORMAT_R8G8B8A8_UNORM, "RGBA8", 1, 1, 4, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_R8G8B8A8_SRGB, "RGBA8 sRGB", 1, 1, 4, nullptr, VK_FORMAT_UNDEFINED },
+
+		{ VK_FORMAT_BC1_RGB_UNORM_BLOCK, "BC1 RGB", 4, 4, 8, DecodeBc1Rgb, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_BC1_RGB_SRGB_BLOCK, "BC1 RGB sRGB", 4, 4, 8, DecodeBc1Rgb, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_BC1_RGBA_UNORM_BLOCK, "BC1 RGBA", 4, 4, 8, DecodeBc1, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_BC1_RGBA_SRGB_BLOCK, "BC1 RGBA sRGB", 4, 4, 8, DecodeBc1, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_BC2_UNORM_BLOCK, "BC2", 4, 4, 16, DecodeBc2, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_BC2_SRGB_BLOCK, "BC2 sRGB", 4, 4, 16, DecodeBc2, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_BC3_UNORM_BLOCK, "BC3", 4, 4, 16, DecodeBc3, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_BC3_SRGB_BLOCK, "BC3 sRGB", 4, 4, 16, DecodeBc3, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_BC4_UNORM_BLOCK, "BC4", 4, 4, 8, DecodeBc4, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_BC5_UNORM_BLOCK, "BC5", 4, 4, 16, DecodeBc5, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_BC7_UNORM_BLOCK, "BC7", 4, 4, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_BC7_SRGB_BLOCK, "BC7 sRGB", 4, 4, 16, nullptr, VK_FORMAT_UNDEFINED },
+
+		{ VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, "ETC2 RGB", 4, 4, 8, DecodeEtc2Rgb, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, "ETC2 RGB sRGB", 4, 4, 8, DecodeEtc2Rgb, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK, "ETC2 RGB A1", 4, 4, 8, DecodeEtc2Rgba1, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK, "ETC2 RGB A1 sRGB", 4, 4, 8, DecodeEtc2Rgba1, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, "ETC2 RGBA", 4, 4, 16, DecodeEtc2Rgba8, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, "ETC2 RGBA sRGB", 4, 4, 16, DecodeEtc2Rgba8, VK_FORMAT_R8G8B8A8_SRGB },
+		{ VK_FORMAT_EAC_R11_UNORM_BLOCK, "EAC R11", 4, 4, 8, DecodeEacR11, VK_FORMAT_R8G8B8A8_UNORM },
+		{ VK_FORMAT_EAC_R11G11_UNORM_BLOCK, "EAC RG11", 4, 4, 16, DecodeEacRg11, VK_FORMAT_R8G8B8A8_UNORM },
+
+		// ASTC has to be supported by the device, its decoder is far too big to carry around as a fallback
+		{ VK_FORMAT_ASTC_4x4_UNORM_BLOCK, "ASTC 4x4", 4, 4, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_4x4_SRGB_BLOCK, "ASTC 4x4 sRGB", 4, 4, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_5x5_UNORM_BLOCK, "ASTC 5x5", 5, 5, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_5x5_SRGB_BLOCK, "ASTC 5x5 sRGB", 5, 5, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_6x6_UNORM_BLOCK, "ASTC 6x6", 6, 6, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_6x6_SRGB_BLOCK, "ASTC 6x6 sRGB", 6, 6, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_8x8_UNORM_BLOCK, "ASTC 8x8", 8, 8, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_8x8_SRGB_BLOCK, "ASTC 8x8 sRGB", 8, 8, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_10x10_UNORM_BLOCK, "ASTC 10x10", 10, 10, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_10x10_SRGB_BLOCK, "ASTC 10x10 sRGB", 10, 10, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_12x12_UNORM_BLOCK, "ASTC 12x12", 12, 12, 16, nullptr, VK_FORMAT_UNDEFINED },
+		{ VK_FORMAT_ASTC_12x12_SRGB_BLOCK, "ASTC 12x12 sRGB", 12, 12, 16, nullptr, VK_FORMAT_UNDEFINED },
+	};
+
+	// null for formats the streamer doesn't know
+	static const FormatInfo* FindFormat(VkFormat format) {
+		for (const FormatInfo& info : formats) {
+			if (info.format == format) {
+				return &info;
+			}
+		}
+		return nullptr;
+	}
+
+	static size_t LevelSize(const FormatInfo& info, uint32_t width, uint32_t height) {
+		size_t blocksWide = (width + info.blockWidth - 1) / info.blockWidth;
+		size_t blocksHigh = (height + info.blockHeight - 1) / info.blockHeight;
+		return blocksWide * blocksHigh * info.blockBytes;
+	}
+
+	// decodes a whole level into tightly packed RGBA8, false when the data is too short
+	static bool DecodeLevel(const FormatInfo& info, ByteSpan data, uint32_t width, uint32_t height, uint8_t* output) {
+		if (!info.decoder || data.size < LevelSize(info, width, height)) {
+			return false;
+		}
+
+		uint32_t blocksWide = (width + 3) / 4;
+		uint32_t blocksHigh = (height + 3) / 4;
+
+		uint8_t pixels[16 * 4];
+		for (uint32_t blockY = 0; blockY < blocksHigh; blockY++) {
+			for (uint32_t blockX = 0; blockX < blocksWide; blockX++) {
+				info.decoder(data.data + (static_cast<size_t>(blockY) * blocksWide + blockX) * info.blockBytes, pixels);
+
+				// blocks on the right and bottom edges hang over the level
+				for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+					uint32_t columns = std::min(4u, width - blockX * 4);
+					std::memcpy(output + ((static_cast<size_t>(blockY) * 4 + y) * width + blockX * 4) * 4, pixels + y * 16, columns * 4);
+				}
+			}
+		}
+
+		return true;
+	}
+}
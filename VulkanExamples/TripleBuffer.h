@@ -0,0 +1,54 @@
+/*
+	lock-free handoff of the latest value from one writer thread to one reader thread.
+
+	Writer and reader each own a buffer, the third one sits in between. Publishing swaps the
+	written buffer with the middle one and reading swaps the middle one with the read buffer,
+	so neither side ever waits for the other and the reader always gets the newest value.
+	Values published while the reader was busy are simply overwritten.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer {
+public:
+	// set in the shared index when the middle buffer holds a value the reader hasn't taken
+	static const uint8_t freshBit = 0x4;
+	static const uint8_t indexMask = 0x3;
+
+	T buffers[3] = {};
+	std::atomic<uint8_t> shared = { 1 };
+
+	// owned by the writer
+	uint8_t writeIndex = 0;
+	// owned by the reader
+	uint8_t readIndex = 2;
+
+	// writer side, fill it completely before publishing
+	T& WriteBuffer() {
+		return buffers[writeIndex];
+	}
+
+	void Publish() {
+		uint8_t previous = shared.exchange(writeIndex | freshBit, std::memory_order_acq_rel);
+		writeIndex = previous & indexMask;
+	}
+
+	// reader side, returns true when a newer value replaced the read buffer
+	bool Update() {
+		if ((shared.load(std::memory_order_relaxed) & freshBit) == 0) {
+			return false;
+		}
+
+		uint8_t previous = shared.exchange(readIndex, std::memory_order_acq_rel);
+		readIndex = previous & indexMask;
+
+		return true;
+	}
+
+	const T& ReadBuffer() const {
+		return buffers[readIndex];
+	}
+};
@@ -0,0 +1,233 @@
+/*
+	vertex input descriptions generated at compile time from the members of a vertex struct.
+
+	A layout lists the members of the vertex once, with VERTEX_ATTRIBUTE(Vertex, member). The
+	format comes from the type of the member, the offset from offsetof and the locations are
+	counted up from the first one, so there is no offset or format to keep in sync by hand. A
+	member left out of the layout, or padding between members, fails to compile.
+
+	Packed member types, the shaders still read floats, the input assembler converts:
+		Half2, Half4   16 bit floats, positions              R16G16_SFLOAT, R16G16B16A16_SFLOAT
+		Rgba8          colors, 0..1 in 8 bits                R8G8B8A8_UNORM
+		Snorm8x4       normals and tangents, -1..1 in 8 bits R8G8B8A8_SNORM
+		Snorm16x2      texture coordinates, -1..1            R16G16_SNORM
+		Unorm16x2      texture coordinates, 0..1             R16G16_UNORM
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "vulkan/vulkan.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// rounds to the nearest even, too big becomes infinity and too small a subnormal or zero
+static uint16_t FloatToHalf(float value) {
+	uint32_t bits = 0;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t exponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// infinity stays infinity, NaN stays a quiet NaN
+	if (exponent == 0xff) {
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+
+	int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+	if (halfExponent >= 0x1f) {
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+
+	uint32_t shift = 13;
+	uint32_t half = (static_cast<uint32_t>(std::max(halfExponent, 0)) << 10) | (mantissa >> 13);
+	if (halfExponent <= 0) {
+		// subnormal, the implicit bit becomes part of the mantissa
+		if (halfExponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x800000;
+		shift = static_cast<uint32_t>(14 - halfExponent);
+		half = mantissa >> shift;
+	}
+
+	// a carry out of the mantissa moves into the exponent, which is the right result
+	uint32_t remainder = mantissa & ((1u << shift) - 1);
+	uint32_t halfway = 1u << (shift - 1);
+	if (remainder > halfway || (remainder == halfway && (half & 1))) {
+		half++;
+	}
+
+	return static_cast<uint16_t>(sign | half);
+}
+
+static float HalfToFloat(uint16_t half) {
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+
+	if (exponent == 0) {
+		float value = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign ? -value : value;
+	}
+
+	uint32_t bits = sign | (mantissa << 13);
+	bits |= exponent == 0x1f ? 0x7f800000 : (exponent - 15 + 127) << 23;
+
+	float value = 0.0f;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+template <typename Integer>
+static Integer PackNormalized(float value, float low, float scale) {
+	return static_cast<Integer>(std::lround(std::clamp(value, low, 1.0f) * scale));
+}
+
+struct Half2 {
+	uint16_t x = 0;
+	uint16_t y = 0;
+
+	Half2() = default;
+	Half2(float valueX, float valueY) : x(FloatToHalf(valueX)), y(FloatToHalf(valueY)) {}
+	Half2(const glm::vec2& value) : Half2(value.x, value.y) {}
+
+	glm::vec2 Unpack() const {
+		return glm::vec2(HalfToFloat(x), HalfToFloat(y));
+	}
+};
+
+struct Half4 {
+	uint16_t x = 0;
+	uint16_t y = 0;
+	uint16_t z = 0;
+	uint16_t w = 0;
+
+	Half4() = default;
+	Half4(float valueX, float valueY, float valueZ, float valueW)
+		: x(FloatToHalf(valueX)), y(FloatToHalf(valueY)), z(FloatToHalf(valueZ)), w(FloatToHalf(valueW)) {}
+	Half4(const glm::vec4& value) : Half4(value.x, value.y, value.z, value.w) {}
+
+	glm::vec4 Unpack() const {
+		return glm::vec4(HalfToFloat(x), HalfToFloat(y), HalfToFloat(z), HalfToFloat(w));
+	}
+};
+
+struct Rgba8 {
+	uint8_t r = 0;
+	uint8_t g = 0;
+	uint8_t b = 0;
+	uint8_t a = 255;
+
+	Rgba8() = default;
+	Rgba8(float red, float green, float blue, float alpha = 1.0f)
+		: r(PackNormalized<uint8_t>(red, 0.0f, 255.0f)), g(PackNormalized<uint8_t>(green, 0.0f, 255.0f)),
+		b(PackNormalized<uint8_t>(blue, 0.0f, 255.0f)), a(PackNormalized<uint8_t>(alpha, 0.0f, 255.0f)) {}
+	Rgba8(const glm::vec3& color) : Rgba8(color.r, color.g, color.b) {}
+	Rgba8(const glm::vec4& color) : Rgba8(color.r, color.g, color.b, color.a) {}
+
+	glm::vec4 Unpack() const {
+		return glm::vec4(r, g, b, a) / 255.0f;
+	}
+};
+
+struct Snorm8x4 {
+	int8_t x = 0;
+	int8_t y = 0;
+	int8_t z = 0;
+	int8_t w = 0;
+
+	Snorm8x4() = default;
+	Snorm8x4(float valueX, float valueY, float valueZ, float valueW = 0.0f)
+		: x(PackNormalized<int8_t>(valueX, -1.0f, 127.0f)), y(PackNormalized<int8_t>(valueY, -1.0f, 127.0f)),
+		z(PackNormalized<int8_t>(valueZ, -1.0f, 127.0f)), w(PackNormalized<int8_t>(valueW, -1.0f, 127.0f)) {}
+	Snorm8x4(const glm::vec3& value) : Snorm8x4(value.x, value.y, value.z) {}
+	Snorm8x4(const glm::vec4& value) : Snorm8x4(value.x, value.y, value.z, value.w) {}
+
+	// -128 reads as -1 like -127 does
+	glm::vec4 Unpack() const {
+		return glm::max(glm::vec4(x, y, z, w) / 127.0f, glm::vec4(-1.0f));
+	}
+};
+
+struct Snorm16x2 {
+	int16_t x = 0;
+	int16_t y = 0;
+
+	Snorm16x2() = default;
+	Snorm16x2(float valueX, float valueY)
+		: x(PackNormalized<int16_t>(valueX, -1.0f, 32767.0f)), y(PackNormalized<int16_t>(valueY, -1.0f, 32767.0f)) {}
+	Snorm16x2(const glm::vec2& value) : Snorm16x2(value.x, value.y) {}
+
+	glm::vec2 Unpack() const {
+		return glm::max(glm::vec2(x, y) / 32767.0f, glm::vec2(-1.0f));
+	}
+};
+
+struct Unorm16x2 {
+	uint16_t x = 0;
+	uint16_t y = 0;
+
+	Unorm16x2() = default;
+	Unorm16x2(float valueX, float valueY)
+		: x(PackNormalized<uint16_t>(valueX, 0.0f, 65535.0f)), y(PackNormalized<uint16_t>(valueY, 0.0f, 65535.0f)) {}
+	Unorm16x2(const glm::vec2& value) : Unorm16x2(value.x, value.y) {}
+
+	glm::vec2 Unpack() const {
+		return glm::vec2(x, y) / 65535.0f;
+	}
+};
+
+// the format a member type is read with, a type without one doesn't compile as an attribute
+template <typename Type>
+struct VertexFormat;
+
+template <> struct VertexFormat<float> { static constexpr VkFormat format = VK_FORMAT_R32_SFLOAT; };
+template <> struct VertexFormat<glm::vec2> { static constexpr VkFormat format = VK_FORMAT_R32G32_SFLOAT; };
+template <> struct VertexFormat<glm::vec3> { static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT; };
+template <> struct VertexFormat<glm::vec4> { static constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template <> struct VertexFormat<uint32_t> { static constexpr VkFormat format = VK_FORMAT_R32_UINT; };
+template <> struct VertexFormat<Half2> { static constexpr VkFormat format = VK_FORMAT_R16G16_SFLOAT; };
+template <> struct VertexFormat<Half4> { static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT; };
+template <> struct VertexFormat<Rgba8> { static constexpr VkFormat format = VK_FORMAT_R8G8B8A8_UNORM; };
+template <> struct VertexFormat<Snorm8x4> { static constexpr VkFormat format = VK_FORMAT_R8G8B8A8_SNORM; };
+template <> struct VertexFormat<Snorm16x2> { static constexpr VkFormat format = VK_FORMAT_R16G16_SNORM; };
+template <> struct VertexFormat<Unorm16x2> { static constexpr VkFormat format = VK_FORMAT_R16G16_UNORM; };
+
+template <typename Member, uint32_t Offset>
+struct VertexAttribute {
+	static constexpr VkFormat format = VertexFormat<Member>::format;
+	static constexpr uint32_t offset = Offset;
+	static constexpr uint32_t size = static_cast<uint32_t>(sizeof(Member));
+};
+
+// the type and offset of a member, straight from the struct
+#define VERTEX_ATTRIBUTE(Vertex, member) VertexAttribute<decltype(Vertex::member), static_cast<uint32_t>(offsetof(Vertex, member))>
+
+// one binding, its attributes take the locations from FirstLocation on in the order they are listed
+template <typename Vertex, uint32_t Binding, VkVertexInputRate InputRate, uint32_t FirstLocation, typename... Attributes>
+struct VertexLayout {
+	static_assert(std::is_standard_layout<Vertex>::value, "offsetof needs a standard layout vertex");
+	static_assert((Attributes::size + ... + 0) == sizeof(Vertex), "every member of the vertex has to be an attribute, without padding in between");
+
+	static constexpr uint32_t binding = Binding;
+	static constexpr uint32_t stride = static_cast<uint32_t>(sizeof(Vertex));
+	static constexpr uint32_t attributeCount = static_cast<uint32_t>(sizeof...(Attributes));
+
+	static constexpr VkVertexInputBindingDescription GetBindingDescription() {
+		return { Binding, stride, InputRate };
+	}
+
+	static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> GetAttributeDescriptions() {
+		uint32_t location = FirstLocation;
+		return { VkVertexInputAttributeDescription{ location++, Binding, Attributes::format, Attributes::offset }... };
+	}
+};
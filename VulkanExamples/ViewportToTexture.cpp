@@ -2,23 +2,126 @@
 /*
 	render the viewport into a texture to be used in the scene
 */
+#pragma once
+
 #include "VulkanInitializer.h"
 #include "Helpers.cpp"
+#include "GpuProfiler.h"
+#include "PassStatistics.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "FramePacer.h"
+#include "Simulation.h"
+#include "JobSystem.h"
+#include "TextureStreamer.h"
+#include "ShaderHotReload.h"
+#include "PipelineVariants.h"
+#include "DamageTracker.h"
+#include "GpuCulling.h"
+#include "DrawQueue.h"
+#include "SpatialGrid.h"
+#include "ParticleSystem.h"
+#include "LightCulling.h"
+#include "VertexLayout.h"
+
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+// options that have to be known before the example builds its resources
+struct ViewportToTextureSettings {
+	// downsample the offscreen texture into a full mip chain after it is rendered
+	bool generateOffscreenMips = false;
+
+	// scale the offscreen render area to stay within a GPU frame time budget
+	DynamicResolutionSettings dynamicResolution = {};
+
+	// samples of the offscreen pass, lowered to the highest count supported by the device
+	VkSampleCountFlagBits offscreenSampleCount = VK_SAMPLE_COUNT_1_BIT;
+
+	// stream the offscreen image to a file
+	FrameCaptureSettings capture = {};
+
+	// present mode is picked from the policy, falling back to what the surface supports
+	PresentPolicy presentPolicy = PresentPolicy::LowestLatency;
+
+	// frames recorded ahead of the GPU, lower means less input latency
+	uint32_t maxFramesInFlight = 2;
+
+	// textures streamed in the background, the first one is drawn on the scene quad
+	std::vector<std::string> texturePaths = {};
+	TextureStreamerSettings textureStreaming = {};
+
+	// shaders and textures are taken from this pack when it has them, the rest comes from disk
+	std::string assetPackPath = "";
+
+	// tonemap the composited image, a specialization constant of the present shader
+	bool tonemap = false;
+
+	// recompile shaders when their sources change and swap the pipelines while running
+	bool shaderHotReload = false;
+	ShaderHotReloadSettings hotReload = {};
+
+	// record the present pass once per swapchain image and submit it again until the pipeline or
+	// the render extent change
+	bool reuseCommandBuffers = false;
+
+	// skip the offscreen pass while nothing it draws from has changed, the last image is presented again
+	bool lazyOffscreen = false;
+
+	// redraw only the parts of the window that changed, and hand them to the compositor when the
+	// device has VK_KHR_incremental_present
+	bool damageTracking = false;
+
+	// cameras rendered into the layers of the offscreen target in a single pass, shown side by side.
+	// Multiview when the device has it, one instance per layer otherwise
+	uint32_t viewCount = 1;
+
+	// copies of the quad in the scene, the extra ones are laid out on a grid reaching past the screen
+	uint32_t sceneObjects = 1;
+
+	// cull the objects in a compute pass and draw them from the indirect buffers it writes,
+	// otherwise the CPU culls and records a draw per object
+	bool gpuCulling = false;
+
+	// particles simulated and drawn on the GPU on top of the scene, off while the capacity is 0
+	ParticleSystemSettings particles = {};
+
+	// moving point lights over the scene objects, culled per screen tile in a compute pass
+	LightCullingSettings lights = {};
+
+	// count shader invocations and samples passed in each render pass, reported next to the timings
+	bool passStatistics = false;
+
+	// worker threads of the job system, 0 picks one per core
+	uint32_t workerThreads = 0;
+
+	// print frame timings to the console once per second
+	bool printStats = false;
+};
+
 class ViewportToTexture {
 public:
 	VulkanInitializer* m_vulkanInitializer;
 	SDL_Window* m_Window = nullptr;
+	ViewportToTextureSettings m_settings = {};
 
 	VkFormat desiredFormat = VK_FORMAT_B8G8R8A8_UNORM;
 	VkFormat desiredExhibitionFormat = VK_FORMAT_R8G8B8A8_SRGB;
 	VkColorSpaceKHR desiredColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-	VkPresentModeKHR desiredPresentation = VK_PRESENT_MODE_MAILBOX_KHR;
 
 	VkSurfaceFormatKHR surfaceFormat = {};
 	VkExtent2D extent2D = {};
@@ -34,11 +137,36 @@ public:
 	/*
 		offscreen related
 	*/
+	// variant used by the current frame, owned by pipelineVariants
 	VkPipeline offscreenPipeline = VK_NULL_HANDLE;
 	VkRenderPass offscreenRenderpass = VK_NULL_HANDLE;
 	VkImage offscreenTextureImage;
 	VkDeviceMemory offscreenTextureImageMemory = VK_NULL_HANDLE;
 	VkImageView offscreenImageView = VK_NULL_HANDLE;
+	// the framebuffer can only reference a single mip level, so it gets its own view over level 0
+	VkImageView offscreenAttachmentView = VK_NULL_HANDLE;
+	uint32_t offscreenMipLevels = 1;
+	// size of the offscreen image and the part of it rendered in the current frame
+	VkExtent2D offscreenExtent = {};
+	VkExtent2D renderExtent = {};
+	DynamicResolution dynamicResolution = {};
+
+	// how the views reach their layers, Single when there is only one
+	enum class OffscreenViewMode {
+		Single,
+		// the render pass broadcasts every draw to all the layers, gl_ViewIndex picks the camera
+		Multiview,
+		// layered framebuffer, one instance per view writes gl_Layer from the vertex shader
+		Layered,
+	};
+	OffscreenViewMode offscreenViewMode = OffscreenViewMode::Single;
+	uint32_t viewCount = 1;
+
+	// multisampled color attachment. It only lives in tile memory, the subpass resolves it into offscreenTextureImage
+	VkSampleCountFlagBits offscreenSamples = VK_SAMPLE_COUNT_1_BIT;
+	VkImage offscreenMsaaImage = VK_NULL_HANDLE;
+	VkDeviceMemory offscreenMsaaImageMemory = VK_NULL_HANDLE;
+	VkImageView offscreenMsaaImageView = VK_NULL_HANDLE;
 	VkSampler offscreenSampler = VK_NULL_HANDLE;
 	VkFramebuffer offscreenFramebuffer = VK_NULL_HANDLE;
 	VkDescriptorSetLayout offscreenDescriptorSetLayout = VK_NULL_HANDLE;
@@ -46,24 +174,212 @@ public:
 	VkDescriptorSet offscreenDescriptorSet = VK_NULL_HANDLE;
 	VkPipelineLayout offscreenPipelineLayout = VK_NULL_HANDLE;
 
-	// descritors
-	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView textureImageView;
-
 	VkRenderPass renderPass = VK_NULL_HANDLE;
 
 	VkCommandPool commandPool = VK_NULL_HANDLE;
 	std::vector<VkCommandBuffer> commandBuffers = {};
 
+	/*
+		reusable command buffers
+	*/
+	// present pass, one per swapchain image and frame in flight at image * framesInFlight + frame.
+	// The fence of the frame is waited before the buffer is submitted again
+	std::vector<VkCommandBuffer> recordedCommandBuffers = {};
+	std::vector<uint64_t> recordedGenerations = {};
+	// uploads and the offscreen pass, recorded every frame and submitted ahead of the present pass
+	std::vector<VkCommandBuffer> frameCommandBuffers = {};
+	// bumped whenever something the recorded present pass depends on changes
+	uint64_t commandBuffersGeneration = 1;
+	uint32_t commandBuffersRecorded = 0;
+
+	// what the recorded present pass was built from, compared at every frame
+	struct PresentInputs {
+		VkExtent2D renderExtent = {};
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
+	PresentInputs recordedPresentInputs = {};
+
+	/*
+		lazy offscreen pass
+	*/
+	// everything the offscreen image is drawn from, the pass only runs when one of them changed
+	struct OffscreenInputs {
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		// swapped by the shader hot reload
+		VkPipeline cullingPipeline = VK_NULL_HANDLE;
+		glm::vec4 clearColor = glm::vec4(0.0f);
+		uint32_t sceneTexture = 0;
+		VkExtent2D renderExtent = {};
+		// a streamed texture got a new level
+		uint64_t descriptorWrites = 0;
+	};
+	OffscreenInputs renderedOffscreenInputs = {};
+	// the image is undefined until the pass ran once
+	bool offscreenValid = false;
+	uint64_t offscreenPassesRendered = 0;
+	uint64_t offscreenPassesSkipped = 0;
+
+	/*
+		damage tracking
+	*/
+	// loads the swapchain image instead of clearing it, compatible with the framebuffers of renderPass
+	VkRenderPass incrementalRenderPass = VK_NULL_HANDLE;
+	DamageTracker damageTracker;
+	// parts of the current image redrawn when it isn't drawn whole
+	std::vector<VkRect2D> frameDamage;
+	bool incrementalPresent = false;
+	uint64_t redrawnPixels = 0;
+	uint64_t presentedPixels = 0;
+
+	// variant used by the current frame, owned by pipelineVariants
 	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 	VkPipeline pipeline = VK_NULL_HANDLE;
 
 	std::vector<VkSemaphore> swapchainProcessImageSemaphores = {};
 	std::vector<VkSemaphore> swapchainReadyToPresentSemaphores = {};
 	std::vector<VkFence> swapchainFrameFance = {};
+	// fence of the last submission that used each swapchain image command buffer
+	std::vector<VkFence> imagesInFlight = {};
 
 	uint32_t currentFrame = 0;
+	// sync objects in rotation, bounded by the swapchain image count
+	uint32_t framesInFlight = 2;
+	// frames drawn since the start
+	uint64_t frameNumber = 0;
+
+	std::unique_ptr<FrameCapture> frameCapture;
+
+	std::unique_ptr<JobSystem> jobSystem;
+
+	// mapped for the whole run, spans into it are handed to shaders and texture uploads
+	std::unique_ptr<AssetPack> assetPack;
+
+	std::unique_ptr<TextureStreamer> textureStreamer;
+	// slot of the texture drawn on the scene quad
+	uint32_t sceneTexture = TextureStreamer::placeholderTexture;
+
+	// has to match the views array of the offscreen shaders
+	static const uint32_t maxViews = 4;
+
+	struct OffscreenPushConstants {
+		// scale in xy and offset in zw of every view
+		glm::vec4 views[maxViews];
+		uint32_t textureIndex;
+		uint32_t viewCount;
+		// light tiles in a row of the render area, and the lights looped over without tiles
+		uint32_t tileCountX;
+		uint32_t lightCount;
+	};
+
+	// simulation state the current frame is drawn from
+	FrameSnapshot snapshot = {};
+
+	/*
+		pipeline variants
+	*/
+	enum PipelineId {
+		PipelineOffscreen,
+		PipelinePresent,
+		// owned by the modules, one pipeline each and no variants
+		PipelineCulling,
+		PipelineLightCulling,
+		PipelineParticleSimulation,
+		PipelineParticleDraw,
+		PipelineCount
+	};
+
+	// specialization constant ids, they have to match the constant_id in the shaders
+	enum OffscreenConstant {
+		// sample the scene texture, off until a texture is requested
+		OffscreenConstantTextured = 0,
+		// the lit shader only loops over the lights of its tile
+		OffscreenConstantTiledLights = 1,
+	};
+	enum PresentConstant {
+		PresentConstantTonemap = 0,
+		// layers of the offscreen texture composited side by side
+		PresentConstantViewCount = 1,
+	};
+
+	struct PipelineVariant {
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
+
+	// every variant built so far, created the first time a frame needs it
+	std::unordered_map<PipelineKey, PipelineVariant, PipelineKeyHash> pipelineVariants;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	uint32_t pipelineVariantsCreated = 0;
+
+	// variants a frame asked for that are being built by a job, the frames keep the variant they had
+	struct PendingVariant {
+		// requestedPipelines when the build started, a shader compiled since makes the result stale
+		uint64_t generation = 0;
+		// stays pending until a shader of the pipeline compiles again
+		bool failed = false;
+	};
+	std::unordered_map<PipelineKey, PendingVariant, PipelineKeyHash> pendingVariants;
+	// finished builds, a null pipeline when the build failed
+	std::vector<std::pair<PipelineKey, PipelineVariant>> builtVariants;
+
+	/*
+		shader hot reload
+	*/
+	std::unique_ptr<ShaderHotReload> shaderHotReload;
+
+	// variants of one pipeline built by a job, waiting for the next frame boundary
+	struct RebuiltVariants {
+		PipelineId id = PipelineOffscreen;
+		uint64_t generation = 0;
+		std::vector<std::pair<PipelineKey, PipelineVariant>> variants;
+	};
+	std::mutex rebuiltPipelinesMutex;
+	std::vector<RebuiltVariants> rebuiltPipelines;
+	JobCounter pipelineRebuilds;
+	// bumped by every compile, a rebuild only replaces the variants when it is newer than the ones in use
+	std::atomic<uint64_t> requestedPipelines[PipelineCount] = {};
+	uint64_t launchedPipelines[PipelineCount] = {};
+	uint64_t appliedPipelines[PipelineCount] = {};
+	uint32_t pipelineSwaps = 0;
+
+	// any thread, a shader changed or rebuilt variants are ready, so an idle loop draws a frame to pick them up
+	std::function<void()> onPipelinesChanged;
+
+	// replaced resources, destroyed once the frames in flight are done with them
+	std::deque<std::pair<uint64_t, std::function<void()>>> retiredResources;
+
+	/*
+		timings
+	*/
+	enum GpuScope {
+		GpuScopeFrame,
+		GpuScopeOffscreen,
+		GpuScopePresent,
+		GpuScopeParticles,
+		GpuScopeLights,
+		GpuScopeCount
+	};
+	std::unique_ptr<GpuProfiler> gpuProfiler;
+
+	// what the render passes did, only with the pass statistics enabled
+	enum RenderPassQuery {
+		RenderPassQueryOffscreen,
+		RenderPassQueryPresent,
+		RenderPassQueryCount
+	};
+	std::unique_ptr<PassStatistics> passStatistics;
+
+	std::chrono::steady_clock::time_point statsStart = std::chrono::steady_clock::now();
+	uint32_t statsFrameCount = 0;
+
+	// compensates the presentation UVs for the part of the offscreen image actually rendered
+	struct PresentPushConstants {
+		glm::vec2 uvScale;
+		// the fragment shader keeps every mip level it samples inside of it
+		glm::vec2 renderExtent;
+	};
 
 	struct Buffer {
 		VkBuffer buffer = VK_NULL_HANDLE;
@@ -75,35 +391,43 @@ public:
 	Buffer indexBuffer = {};
 	VkDeviceSize indexBufferSize = sizeof(uint16_t) * 6;
 
-	struct Vertex {
-		glm::vec2 pos;
-		glm::vec3 color;
-
-		static VkVertexInputBindingDescription getBindingDescription() {
-			VkVertexInputBindingDescription bindingDescription{};
-			bindingDescription.binding = 0;
-			bindingDescription.stride = static_cast<uint32_t>(sizeof(Vertex));
-			bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-			return bindingDescription;
-		}
-
-		static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
-			std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
-
-			attributeDescriptions[0].location = 0;
-			attributeDescriptions[0].binding = 0;
-			attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-			attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-			attributeDescriptions[1].location = 1;
-			attributeDescriptions[1].binding = 0;
-			attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-			attributeDescriptions[1].offset = offsetof(Vertex, color);
+	// per instance vertex data of the objects: scale in xy and offset in zw. Stays in floats, the
+	// culling shader writes it as a vec4
+	struct ObjectInstance {
+		glm::vec4 transform;
+	};
+	using ObjectInstanceLayout = VertexLayout<ObjectInstance, 1, VK_VERTEX_INPUT_RATE_INSTANCE, 2,
+		VERTEX_ATTRIBUTE(ObjectInstance, transform)>;
 
-			return attributeDescriptions;
-		}
+	/*
+		scene objects, every one of them draws the quad. Each object is drawn once per view in the
+		layered mode, so its instances start at a multiple of instancesPerObject
+	*/
+	std::vector<CullObject> sceneObjects;
+	uint32_t instancesPerObject = 1;
+	// min in xy and max in zw of every object together
+	glm::vec4 sceneBounds = {};
+	// transforms of every object in order, the CPU path draws from it
+	Buffer objectInstanceBuffer = {};
+	std::unique_ptr<GpuCulling> gpuCulling;
+	// objects drawn by the last frame the CPU recorded, the GPU path reads its count back
+	uint32_t cpuDrawnObjects = 0;
+	// draws of the CPU path, sorted by state before they are recorded
+	DrawQueue drawQueue;
+	// the CPU path only tests the objects in the cells the views can see
+	SpatialGrid sceneGrid;
+	std::vector<uint32_t> gridResults;
+	std::unique_ptr<ParticleSystem> particleSystem;
+	// the offscreen pipeline takes its lights as set 1
+	std::unique_ptr<LightCulling> lightCulling;
+
+	// 8 bytes a vertex, the positions of the quad are exact in half floats
+	struct Vertex {
+		Half2 pos;
+		Rgba8 color;
 	};
+	using VertexInputLayout = VertexLayout<Vertex, 0, VK_VERTEX_INPUT_RATE_VERTEX, 0,
+		VERTEX_ATTRIBUTE(Vertex, pos), VERTEX_ATTRIBUTE(Vertex, color)>;
 
 	std::vector<Vertex> vertices = {
 		{{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
@@ -116,15 +440,36 @@ public:
 		0, 1, 2, 2, 3, 0
 	};
 
-	ViewportToTexture(SDL_Window* window, VulkanInitializer* vulkanInitializer) {
+	ViewportToTexture(SDL_Window* window, VulkanInitializer* vulkanInitializer, ViewportToTextureSettings settings = {}) {
 		m_Window = window;
 		m_vulkanInitializer = vulkanInitializer;
+		m_settings = settings;
+
+		jobSystem = std::make_unique<JobSystem>(m_settings.workerThreads);
+		drawQueue = DrawQueue(jobSystem.get());
+
+		if (!m_settings.assetPackPath.empty()) {
+			assetPack = std::make_unique<AssetPack>();
+			if (!assetPack->Open(m_settings.assetPackPath)) {
+				assetPack.reset();
+			}
+		}
 
 		// swapchain related
 		CreateSwapchain();
 		CreateSwapchainImageViews();
 
+		framesInFlight = std::clamp(m_settings.maxFramesInFlight, 1u, swapchainImageCount);
+
+		// the offscreen target is sized for the biggest render scale allowed
+		dynamicResolution = DynamicResolution(m_settings.dynamicResolution);
+		offscreenExtent = dynamicResolution.GetTargetExtent(extent2D);
+		renderExtent = dynamicResolution.GetRenderExtent(extent2D);
+
 		// offscreen related
+		SelectOffscreenSampleCount();
+		SelectOffscreenViewMode();
+		CreateSceneObjects();
 		CreateOffscreenTextureResources();
 		CreateOffscreenRenderPass();
 		CreateOffscreenFramebuffer();
@@ -133,26 +478,54 @@ public:
 		CreateRenderPass();
 		CreateFrameBuffers();
 
+		// every image starts out drawn whole
+		damageTracker = DamageTracker(swapchainImageCount, extent2D);
+		incrementalPresent = m_settings.damageTracking && m_vulkanInitializer->IsDeviceExtensionEnabled(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+
 		CreateCommandPool();
 		CreateCommandBuffers();
 
-		// offscreen
-		std::vector<char> vertShaderCode = readShaderFile("../Shaders/vert_offscreen.spv");
-		std::vector<char> fragShaderCode = readShaderFile("../Shaders/frag_offscreen.spv");
+		gpuProfiler = std::make_unique<GpuProfiler>(m_vulkanInitializer, swapchainImageCount, GpuScopeCount);
+		if (m_settings.passStatistics) {
+			passStatistics = std::make_unique<PassStatistics>(m_vulkanInitializer, swapchainImageCount, RenderPassQueryCount);
+		}
 
-		VkShaderModule vertShaderModule = createShaderModule(m_vulkanInitializer->device, vertShaderCode);
-		VkShaderModule fragShaderModule = createShaderModule(m_vulkanInitializer->device, fragShaderCode);
+		if (m_settings.capture.enabled) {
+			frameCapture = std::make_unique<FrameCapture>(m_vulkanInitializer, surfaceFormat.format, offscreenExtent, m_settings.capture);
+		}
+
+		// the offscreen pipeline layout takes the streamed texture array
+		textureStreamer = std::make_unique<TextureStreamer>(m_vulkanInitializer, jobSystem.get(), assetPack.get(), framesInFlight, m_settings.textureStreaming);
+		for (const std::string& path : m_settings.texturePaths) {
+			uint32_t slot = textureStreamer->Request(path);
+			if (sceneTexture == TextureStreamer::placeholderTexture) {
+				sceneTexture = slot;
+			}
+		}
 
-		CreateGraphicsPipeline(vertShaderModule, fragShaderModule, offscreenPipelineLayout, offscreenPipeline, offscreenRenderpass);
+		if (m_settings.lights.lightCount > 0) {
+			lightCulling = std::make_unique<LightCulling>(m_vulkanInitializer, ShaderPack(), framesInFlight, offscreenExtent, sceneBounds, m_settings.lights);
+		}
+
+		CreatePipelineCache();
 
-		// presentation
-		vertShaderCode = readShaderFile("../Shaders/vert.spv");
-		fragShaderCode = readShaderFile("../Shaders/frag.spv");
+		// both pipelines compile at the same time, pipeline creation is the slowest part of the startup
+		PipelineKey offscreenKey = GetOffscreenPipelineKey();
+		PipelineKey presentKey = GetPresentPipelineKey();
+		PipelineVariant offscreenVariant, presentVariant;
 
-		vertShaderModule = createShaderModule(m_vulkanInitializer->device, vertShaderCode);
-		fragShaderModule = createShaderModule(m_vulkanInitializer->device, fragShaderCode);
+		JobCounter pipelinesCreated;
+		jobSystem->Run([&] { CreatePipelineVariant(offscreenKey, offscreenVariant); }, &pipelinesCreated);
+		jobSystem->Run([&] { CreatePipelineVariant(presentKey, presentVariant); }, &pipelinesCreated);
+		jobSystem->Wait(pipelinesCreated);
 
-		CreateGraphicsPipeline(vertShaderModule, fragShaderModule, pipelineLayout, pipeline, renderPass, offscreenDescriptorSetLayout);
+		pipelineVariants[offscreenKey] = offscreenVariant;
+		pipelineVariants[presentKey] = presentVariant;
+		SelectPipelineVariants();
+
+		if (m_settings.shaderHotReload) {
+			StartShaderHotReload();
+		}
 
 		// continue offscreen stuff
 		CreateDescriptorPool();
@@ -162,26 +535,65 @@ public:
 
 		CreateVertexBuffer();
 		CreateIndexBuffer();
+		CreateObjectInstanceBuffer();
+
+		if (m_settings.gpuCulling) {
+			if (GpuCulling::IsSupported(m_vulkanInitializer)) {
+				gpuCulling = std::make_unique<GpuCulling>(m_vulkanInitializer, ShaderPack(), sceneObjects, instancesPerObject, framesInFlight);
+			}
+			else {
+				std::cout << "gpu culling needs drawIndirectFirstInstance, the CPU culls instead" << std::endl;
+			}
+		}
+
+		if (m_settings.particles.capacity > 0) {
+			particleSystem = std::make_unique<ParticleSystem>(m_vulkanInitializer, ShaderPack(), offscreenRenderpass, offscreenSampleCount, framesInFlight, m_settings.particles);
+		}
 	}
 	~ViewportToTexture() {
 		vkDeviceWaitIdle(m_vulkanInitializer->device);
 
-		vkDestroyBuffer(m_vulkanInitializer->device, vertexBuffer.buffer, nullptr);
-		vkFreeMemory(m_vulkanInitializer->device, vertexBuffer.bufferMemory, nullptr);
-		vkDestroyBuffer(m_vulkanInitializer->device, indexBuffer.buffer, nullptr);
-		vkFreeMemory(m_vulkanInitializer->device, indexBuffer.bufferMemory, nullptr);
+		// no compile or rebuild can start anymore, the ones running finish first
+		shaderHotReload.reset();
+		jobSystem->Wait(pipelineRebuilds);
+		for (auto& rebuilt : rebuiltPipelines) {
+			for (auto& variant : rebuilt.variants) {
+				DestroyPipelineVariant(variant.second);
+			}
+		}
+		for (auto& variant : builtVariants) {
+			DestroyPipelineVariant(variant.second);
+		}
+		for (auto& retired : retiredResources) {
+			retired.second();
+		}
 
-		for (int i = 0; i < swapchainImageCount; i++) {
+		// no job can touch the resources below anymore
+		particleSystem.reset();
+		lightCulling.reset();
+		gpuCulling.reset();
+		textureStreamer.reset();
+		jobSystem.reset();
+		assetPack.reset();
+		gpuProfiler.reset();
+		passStatistics.reset();
+		frameCapture.reset();
+
+		m_vulkanInitializer->DestroyBuffer(vertexBuffer.buffer, vertexBuffer.bufferMemory);
+		m_vulkanInitializer->DestroyBuffer(indexBuffer.buffer, indexBuffer.bufferMemory);
+		m_vulkanInitializer->DestroyBuffer(objectInstanceBuffer.buffer, objectInstanceBuffer.bufferMemory);
+
+		for (uint32_t i = 0; i < framesInFlight; i++) {
 			vkDestroySemaphore(m_vulkanInitializer->device, swapchainProcessImageSemaphores[i], nullptr);
 			vkDestroySemaphore(m_vulkanInitializer->device, swapchainReadyToPresentSemaphores[i], nullptr);
 			vkDestroyFence(m_vulkanInitializer->device, swapchainFrameFance[i], nullptr);
 		}
 
-		vkDestroyPipelineLayout(m_vulkanInitializer->device, offscreenPipelineLayout, nullptr);
-		vkDestroyPipeline(m_vulkanInitializer->device, offscreenPipeline, nullptr);
-
-		vkDestroyPipelineLayout(m_vulkanInitializer->device, pipelineLayout, nullptr);
-		vkDestroyPipeline(m_vulkanInitializer->device, pipeline, nullptr);
+		// the pipelines in use are among the variants
+		for (auto& variant : pipelineVariants) {
+			DestroyPipelineVariant(variant.second);
+		}
+		vkDestroyPipelineCache(m_vulkanInitializer->device, pipelineCache, nullptr);
 
 		vkDestroyCommandPool(m_vulkanInitializer->device, commandPool, nullptr);
 
@@ -199,16 +611,17 @@ public:
 		vkDestroyRenderPass(m_vulkanInitializer->device, offscreenRenderpass, nullptr);
 
 		vkDestroyRenderPass(m_vulkanInitializer->device, renderPass, nullptr);
+		vkDestroyRenderPass(m_vulkanInitializer->device, incrementalRenderPass, nullptr);
 
 		vkDestroyImage(m_vulkanInitializer->device, offscreenTextureImage, nullptr);
-		vkFreeMemory(m_vulkanInitializer->device, offscreenTextureImageMemory, nullptr);
+		m_vulkanInitializer->FreeMemory(offscreenTextureImageMemory);
 		vkDestroyImageView(m_vulkanInitializer->device, offscreenImageView, nullptr);
+		vkDestroyImageView(m_vulkanInitializer->device, offscreenAttachmentView, nullptr);
+		vkDestroyImage(m_vulkanInitializer->device, offscreenMsaaImage, nullptr);
+		m_vulkanInitializer->FreeMemory(offscreenMsaaImageMemory);
+		vkDestroyImageView(m_vulkanInitializer->device, offscreenMsaaImageView, nullptr);
 		vkDestroySampler(m_vulkanInitializer->device, offscreenSampler, nullptr);
 
-		vkDestroyImage(m_vulkanInitializer->device, textureImage, nullptr);
-		vkFreeMemory(m_vulkanInitializer->device, textureImageMemory, nullptr);
-		vkDestroyImageView(m_vulkanInitializer->device, textureImageView, nullptr);
-
 		for (auto& imageView : imageViews) {
 			vkDestroyImageView(m_vulkanInitializer->device, imageView, nullptr);
 		}
@@ -257,14 +670,20 @@ public:
 		presentModes.resize(presentModeCount);
 		vkGetPhysicalDeviceSurfacePresentModesKHR(m_vulkanInitializer->physicalDevice, m_vulkanInitializer->surface, &presentModeCount, presentModes.data());
 
-		VkPresentModeKHR presentModeKHR = {};
-		for (const auto& availablePresentMode : presentModes) {
-			if (availablePresentMode == desiredPresentation) {
-				presentationMode = availablePresentMode;
+		// first mode of the policy the surface supports, FIFO is required by the spec so it always ends the list
+		presentationMode = VK_PRESENT_MODE_FIFO_KHR;
+		for (VkPresentModeKHR preferredMode : PresentModePreferences(m_settings.presentPolicy)) {
+			if (std::find(presentModes.begin(), presentModes.end(), preferredMode) != presentModes.end()) {
+				presentationMode = preferredMode;
+				break;
 			}
 		}
-		if (!presentationMode) {
-			throw std::runtime_error("presentation mode not available");
+
+		// mailbox needs a spare image to replace queued frames without blocking
+		swapchainImageCount = presentationMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+		swapchainImageCount = std::max(swapchainImageCount, surfaceCapabilitiesKHR.minImageCount);
+		if (surfaceCapabilitiesKHR.maxImageCount > 0) {
+			swapchainImageCount = std::min(swapchainImageCount, surfaceCapabilitiesKHR.maxImageCount);
 		}
 
 		// is surface compatible?
@@ -294,7 +713,8 @@ public:
 		swapchainCreateInfoKHR.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR; // possible flaw. If some problem with swapchain, see previous implementation
 		swapchainCreateInfoKHR.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		swapchainCreateInfoKHR.presentMode = presentationMode;
-		swapchainCreateInfoKHR.clipped = VK_TRUE;
+		// a partial redraw builds on the previous contents, including the pixels hidden by other windows
+		swapchainCreateInfoKHR.clipped = m_settings.damageTracking ? VK_FALSE : VK_TRUE;
 		swapchainCreateInfoKHR.oldSwapchain = VK_NULL_HANDLE;
 
 		VkResult res = vkCreateSwapchainKHR(m_vulkanInitializer->device, &swapchainCreateInfoKHR, nullptr, &swapchain);
@@ -331,7 +751,176 @@ public:
 		}
 	}
 
+	void SelectOffscreenSampleCount() {
+		VkPhysicalDeviceProperties physicalDeviceProperties = {};
+		vkGetPhysicalDeviceProperties(m_vulkanInitializer->physicalDevice, &physicalDeviceProperties);
+
+		VkSampleCountFlags supportedCounts = physicalDeviceProperties.limits.framebufferColorSampleCounts;
+
+		// highest supported count that doesn't go above the requested one
+		offscreenSamples = VK_SAMPLE_COUNT_1_BIT;
+		for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1) {
+			if (count <= static_cast<uint32_t>(m_settings.offscreenSampleCount) && (supportedCounts & count)) {
+				offscreenSamples = static_cast<VkSampleCountFlagBits>(count);
+				break;
+			}
+		}
+
+		if (offscreenSamples != m_settings.offscreenSampleCount) {
+			std::cout << "offscreen sample count " << m_settings.offscreenSampleCount << " not supported, using " << offscreenSamples << std::endl;
+		}
+	}
+
+	void SelectOffscreenViewMode() {
+		viewCount = std::clamp(m_settings.viewCount, 1u, maxViews);
+		offscreenViewMode = OffscreenViewMode::Single;
+		if (viewCount == 1) {
+			return;
+		}
+
+		VkPhysicalDeviceMultiviewProperties multiviewProperties = {};
+		multiviewProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 physicalDeviceProperties = {};
+		physicalDeviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		physicalDeviceProperties.pNext = &multiviewProperties;
+		vkGetPhysicalDeviceProperties2(m_vulkanInitializer->physicalDevice, &physicalDeviceProperties);
+
+		if (m_vulkanInitializer->multiviewFeatures.multiview && multiviewProperties.maxMultiviewViewCount >= viewCount) {
+			offscreenViewMode = OffscreenViewMode::Multiview;
+		}
+		else if (m_vulkanInitializer->IsDeviceExtensionEnabled(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME)
+			&& physicalDeviceProperties.properties.limits.maxFramebufferLayers >= viewCount) {
+			offscreenViewMode = OffscreenViewMode::Layered;
+		}
+		else {
+			std::cout << "neither multiview nor layered rendering is supported, drawing a single view" << std::endl;
+			viewCount = 1;
+		}
+
+		if (viewCount != m_settings.viewCount) {
+			std::cout << "view count " << m_settings.viewCount << " not supported, using " << viewCount << std::endl;
+		}
+	}
+
+	// view 0 is the main camera, the others look at the scene from further away
+	glm::vec4 GetViewTransform(uint32_t view) const {
+		float scale = 1.0f / (1.0f + 0.5f * static_cast<float>(view));
+		return glm::vec4(scale, scale, 0.0f, 0.0f);
+	}
+
+	/*
+		object 0 is the quad in the middle of the screen, the others are smaller quads on a grid twice
+		as wide as the screen, so about three quarters of them are culled. Cells touching the middle
+		quad stay empty, the culled draws come out in any order and must not overlap
+	*/
+	void CreateSceneObjects() {
+		glm::vec2 low = vertices[0].pos.Unpack();
+		glm::vec2 high = low;
+		for (const Vertex& vertex : vertices) {
+			low = glm::min(low, vertex.pos.Unpack());
+			high = glm::max(high, vertex.pos.Unpack());
+		}
+
+		CullObject quad = {};
+		quad.transform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+		quad.bounds = glm::vec4(low, high);
+		quad.firstIndex = 0;
+		quad.indexCount = static_cast<uint32_t>(indices.size());
+		quad.vertexOffset = 0;
+
+		uint32_t objectCount = std::max(m_settings.sceneObjects, 1u);
+		sceneObjects.clear();
+		sceneObjects.reserve(objectCount);
+		sceneObjects.push_back(quad);
+
+		// room for the cells left empty around the middle quad
+		uint32_t gridObjects = objectCount - 1;
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(gridObjects * 1.25f))) + 2;
+		float cell = 4.0f / side;
+		float scale = cell * 0.8f / std::max(high.x - low.x, high.y - low.y);
+
+		for (uint32_t y = 0; y < side && sceneObjects.size() < objectCount; y++) {
+			for (uint32_t x = 0; x < side && sceneObjects.size() < objectCount; x++) {
+				glm::vec2 center = glm::vec2(-2.0f + (x + 0.5f) * cell, -2.0f + (y + 0.5f) * cell);
+				glm::vec2 cellLow = center - cell * 0.5f;
+				glm::vec2 cellHigh = center + cell * 0.5f;
+				if (cellLow.x < high.x && cellHigh.x > low.x && cellLow.y < high.y && cellHigh.y > low.y) {
+					continue;
+				}
+
+				CullObject object = quad;
+				object.transform = glm::vec4(scale, scale, center);
+				sceneObjects.push_back(object);
+			}
+		}
+
+		sceneBounds = glm::vec4(low, high);
+		for (const CullObject& object : sceneObjects) {
+			glm::vec2 objectLow = glm::vec2(object.bounds) * glm::vec2(object.transform) + glm::vec2(object.transform.z, object.transform.w);
+			glm::vec2 objectHigh = glm::vec2(object.bounds.z, object.bounds.w) * glm::vec2(object.transform) + glm::vec2(object.transform.z, object.transform.w);
+			sceneBounds = glm::vec4(glm::min(glm::vec2(sceneBounds), objectLow), glm::max(glm::vec2(sceneBounds.z, sceneBounds.w), objectHigh));
+		}
+
+		// about four objects per cell
+		Aabb world = { sceneBounds.x, sceneBounds.y, sceneBounds.z, sceneBounds.w };
+		float worldSize = std::max(world.maxX - world.minX, world.maxY - world.minY);
+		float cellSize = worldSize / std::max(1.0f, std::sqrt(sceneObjects.size() / 4.0f));
+		sceneGrid = SpatialGrid(world, cellSize);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(sceneObjects.size()); i++) {
+			sceneGrid.Insert(i, GetObjectBounds(sceneObjects[i]));
+		}
+
+		instancesPerObject = offscreenViewMode == OffscreenViewMode::Layered ? viewCount : 1;
+	}
+
+	static Aabb GetObjectBounds(const CullObject& object) {
+		glm::vec2 a = glm::vec2(object.bounds) * glm::vec2(object.transform) + glm::vec2(object.transform.z, object.transform.w);
+		glm::vec2 b = glm::vec2(object.bounds.z, object.bounds.w) * glm::vec2(object.transform) + glm::vec2(object.transform.z, object.transform.w);
+		glm::vec2 low = glm::min(a, b);
+		glm::vec2 high = glm::max(a, b);
+		return { low.x, low.y, high.x, high.y };
+	}
+
+	// the part of the scene any view shows, the clip rectangle taken back through each view transform
+	Aabb GetVisibleSceneRect(const glm::vec4* views) const {
+		Aabb rectangle = {};
+		for (uint32_t view = 0; view < viewCount; view++) {
+			glm::vec2 scale = glm::vec2(views[view]);
+			glm::vec2 offset = glm::vec2(views[view].z, views[view].w);
+			glm::vec2 a = (glm::vec2(-1.0f) - offset) / scale;
+			glm::vec2 b = (glm::vec2(1.0f) - offset) / scale;
+			glm::vec2 low = glm::min(a, b);
+			glm::vec2 high = glm::max(a, b);
+
+			if (view == 0) {
+				rectangle = { low.x, low.y, high.x, high.y };
+			}
+			else {
+				rectangle = { std::min(rectangle.minX, low.x), std::min(rectangle.minY, low.y), std::max(rectangle.maxX, high.x), std::max(rectangle.maxY, high.y) };
+			}
+		}
+		return rectangle;
+	}
+
 	void CreateOffscreenTextureResources() {
+		/*
+			check if the mip chain can be generated with linear blits
+		*/
+		offscreenMipLevels = 1;
+		if (m_settings.generateOffscreenMips) {
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(m_vulkanInitializer->physicalDevice, surfaceFormat.format, &formatProperties);
+
+			VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			if ((formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures) {
+				offscreenMipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(offscreenExtent.width, offscreenExtent.height)))) + 1;
+			}
+			else {
+				std::cout << "offscreen format doesn't support linear blits, mip chain generation disabled" << std::endl;
+			}
+		}
+
 		/*
 			create offscreen image
 		*/
@@ -341,15 +930,24 @@ public:
 			image.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 			image.imageType = VK_IMAGE_TYPE_2D;
 			image.format = surfaceFormat.format;
-			image.extent.width = extent2D.width;
-			image.extent.height = extent2D.height;
+			image.extent.width = offscreenExtent.width;
+			image.extent.height = offscreenExtent.height;
 			image.extent.depth = 1;
-			image.mipLevels = 1;
-			image.arrayLayers = 1;
+			image.mipLevels = offscreenMipLevels;
+			// one layer per view
+			image.arrayLayers = viewCount;
 			image.samples = VK_SAMPLE_COUNT_1_BIT;
 			image.tiling = VK_IMAGE_TILING_OPTIMAL;
 			// We will sample directly from the color attachment
 			image.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			if (offscreenMipLevels > 1) {
+				// the mip chain is built by blitting each level into the next one
+				image.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			}
+			if (m_settings.capture.enabled) {
+				// read back by the frame capture
+				image.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			}
 			image.samples = VK_SAMPLE_COUNT_1_BIT;
 			image.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			image.initialLayout= VK_IMAGE_LAYOUT_UNDEFINED;
@@ -362,9 +960,9 @@ public:
 			vkGetImageMemoryRequirements(m_vulkanInitializer->device, offscreenTextureImage, &memReqs);
 			memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 			memAlloc.allocationSize = memReqs.size;
-			memAlloc.memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			memAlloc.memoryTypeIndex = m_vulkanInitializer->FindMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memReqs.size);
 
-			ASSERT(vkAllocateMemory(m_vulkanInitializer->device, &memAlloc, nullptr, &offscreenTextureImageMemory));
+			ASSERT(m_vulkanInitializer->AllocateMemory(&memAlloc, &offscreenTextureImageMemory));
 			ASSERT(vkBindImageMemory(m_vulkanInitializer->device, offscreenTextureImage, offscreenTextureImageMemory, 0));
 		}
 
@@ -374,7 +972,8 @@ public:
 		{
 			VkImageViewCreateInfo colorImageView = {};
 			colorImageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			// an array even with a single view, the present shader always samples a sampler2DArray
+			colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
 			colorImageView.format = surfaceFormat.format;
 			colorImageView.components.r = VK_COMPONENT_SWIZZLE_R;
 			colorImageView.components.g = VK_COMPONENT_SWIZZLE_G;
@@ -383,12 +982,70 @@ public:
 			colorImageView.subresourceRange = {};
 			colorImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			colorImageView.subresourceRange.baseMipLevel = 0;
-			colorImageView.subresourceRange.levelCount = 1;
+			colorImageView.subresourceRange.levelCount = offscreenMipLevels;
 			colorImageView.subresourceRange.baseArrayLayer = 0;
-			colorImageView.subresourceRange.layerCount = 1;
+			colorImageView.subresourceRange.layerCount = viewCount;
 			colorImageView.image = offscreenTextureImage;
 
 			ASSERT(vkCreateImageView(m_vulkanInitializer->device, &colorImageView, nullptr, &offscreenImageView));
+
+			// view used as render target
+			colorImageView.subresourceRange.levelCount = 1;
+
+			ASSERT(vkCreateImageView(m_vulkanInitializer->device, &colorImageView, nullptr, &offscreenAttachmentView));
+		}
+
+		/*
+			create multisampled attachment
+		*/
+		if (offscreenSamples != VK_SAMPLE_COUNT_1_BIT) {
+			VkImageCreateInfo image = {};
+			image.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image.imageType = VK_IMAGE_TYPE_2D;
+			image.format = surfaceFormat.format;
+			image.extent.width = offscreenExtent.width;
+			image.extent.height = offscreenExtent.height;
+			image.extent.depth = 1;
+			image.mipLevels = 1;
+			image.arrayLayers = viewCount;
+			image.samples = offscreenSamples;
+			image.tiling = VK_IMAGE_TILING_OPTIMAL;
+			// never loaded nor stored, the driver doesn't need to back it with real memory
+			image.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			image.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			image.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			ASSERT(vkCreateImage(m_vulkanInitializer->device, &image, nullptr, &offscreenMsaaImage));
+
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(m_vulkanInitializer->device, offscreenMsaaImage, &memReqs);
+
+			// lazily allocated memory is only available on tilers, desktop GPUs use regular device memory
+			uint32_t memoryTypeIndex = m_vulkanInitializer->TryFindMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, memReqs.size);
+			if (memoryTypeIndex == UINT32_MAX) {
+				memoryTypeIndex = m_vulkanInitializer->FindMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memReqs.size);
+			}
+
+			VkMemoryAllocateInfo memAlloc = {};
+			memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = memoryTypeIndex;
+
+			ASSERT(m_vulkanInitializer->AllocateMemory(&memAlloc, &offscreenMsaaImageMemory));
+			ASSERT(vkBindImageMemory(m_vulkanInitializer->device, offscreenMsaaImage, offscreenMsaaImageMemory, 0));
+
+			VkImageViewCreateInfo msaaImageView = {};
+			msaaImageView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			msaaImageView.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			msaaImageView.format = surfaceFormat.format;
+			msaaImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			msaaImageView.subresourceRange.baseMipLevel = 0;
+			msaaImageView.subresourceRange.levelCount = 1;
+			msaaImageView.subresourceRange.baseArrayLayer = 0;
+			msaaImageView.subresourceRange.layerCount = viewCount;
+			msaaImageView.image = offscreenMsaaImage;
+
+			ASSERT(vkCreateImageView(m_vulkanInitializer->device, &msaaImageView, nullptr, &offscreenMsaaImageView));
 		}
 
 		/*
@@ -409,7 +1066,7 @@ public:
 			samplerInfo.mipLodBias = 0.0f;
 			samplerInfo.maxAnisotropy = 1.0f;
 			samplerInfo.minLod = 0.0f;
-			samplerInfo.maxLod = 1.0f;
+			samplerInfo.maxLod = static_cast<float>(offscreenMipLevels);
 			samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 			// addition
 			//samplerInfo.anisotropyEnable = VK_TRUE;
@@ -427,7 +1084,8 @@ public:
 		attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		// with mips the level 0 is read by the blits before being sampled
+		attachmentDescription.finalLayout = offscreenMipLevels > 1 ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentReference = {};
 		colorAttachmentReference.attachment = 0;
@@ -438,6 +1096,26 @@ public:
 		subpassDescription.colorAttachmentCount = 1;
 		subpassDescription.pColorAttachments = &colorAttachmentReference;
 
+		std::vector<VkAttachmentDescription> attachmentDescriptions = { attachmentDescription };
+
+		// with MSAA the samples are resolved into the texture at the end of the subpass
+		VkAttachmentReference resolveAttachmentReference = {};
+		if (offscreenSamples != VK_SAMPLE_COUNT_1_BIT) {
+			VkAttachmentDescription msaaAttachmentDescription = attachmentDescription;
+			msaaAttachmentDescription.samples = offscreenSamples;
+			msaaAttachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			msaaAttachmentDescription.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+			VkAttachmentDescription resolveAttachmentDescription = attachmentDescription;
+			resolveAttachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+			attachmentDescriptions = { msaaAttachmentDescription, resolveAttachmentDescription };
+
+			resolveAttachmentReference.attachment = 1;
+			resolveAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			subpassDescription.pResolveAttachments = &resolveAttachmentReference;
+		}
+
 		std::array<VkSubpassDependency, 2> subpassDependency = {};
 		subpassDependency[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 		subpassDependency[0].dstSubpass = 0;
@@ -450,35 +1128,51 @@ public:
 		subpassDependency[1].srcSubpass = 0;
 		subpassDependency[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 		subpassDependency[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		subpassDependency[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		subpassDependency[1].dstStageMask = offscreenMipLevels > 1 ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 		subpassDependency[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		subpassDependency[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		subpassDependency[1].dstAccessMask = offscreenMipLevels > 1 ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
 		subpassDependency[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 		VkRenderPassCreateInfo renderPassCreateInfo = {};
 		renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassCreateInfo.attachmentCount = 1;
-		renderPassCreateInfo.pAttachments = &attachmentDescription;
+		renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size());
+		renderPassCreateInfo.pAttachments = attachmentDescriptions.data();
 		renderPassCreateInfo.subpassCount = 1;
 		renderPassCreateInfo.pSubpasses = &subpassDescription;
 		renderPassCreateInfo.dependencyCount = subpassDependency.size();
 		renderPassCreateInfo.pDependencies = subpassDependency.data();
 
+		// every view is rendered by the same subpass, the views are close so they are also correlated
+		uint32_t viewMask = (1u << viewCount) - 1;
+		VkRenderPassMultiviewCreateInfo multiviewCreateInfo = {};
+		multiviewCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+		multiviewCreateInfo.subpassCount = 1;
+		multiviewCreateInfo.pViewMasks = &viewMask;
+		multiviewCreateInfo.correlationMaskCount = 1;
+		multiviewCreateInfo.pCorrelationMasks = &viewMask;
+		if (offscreenViewMode == OffscreenViewMode::Multiview) {
+			renderPassCreateInfo.pNext = &multiviewCreateInfo;
+		}
+
 		VkResult res = vkCreateRenderPass(m_vulkanInitializer->device, &renderPassCreateInfo, nullptr, &offscreenRenderpass);
 		ASSERT(res, "failed to create render pass");
 	}
 
 	void CreateOffscreenFramebuffer() {
-		VkImageView attachments = offscreenImageView;
+		std::vector<VkImageView> attachments = { offscreenAttachmentView };
+		if (offscreenSamples != VK_SAMPLE_COUNT_1_BIT) {
+			attachments = { offscreenMsaaImageView, offscreenAttachmentView };
+		}
 
 		VkFramebufferCreateInfo fbufCreateInfo = {};
 		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		fbufCreateInfo.renderPass = offscreenRenderpass;
-		fbufCreateInfo.attachmentCount = 1;
-		fbufCreateInfo.pAttachments = &attachments;
-		fbufCreateInfo.width = extent2D.width;
-		fbufCreateInfo.height = extent2D.height;
-		fbufCreateInfo.layers = 1;
+		fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		fbufCreateInfo.pAttachments = attachments.data();
+		fbufCreateInfo.width = offscreenExtent.width;
+		fbufCreateInfo.height = offscreenExtent.height;
+		// multiview takes the layers from the view mask, the framebuffer itself has a single one
+		fbufCreateInfo.layers = offscreenViewMode == OffscreenViewMode::Layered ? viewCount : 1;
 
 		ASSERT(vkCreateFramebuffer(m_vulkanInitializer->device, &fbufCreateInfo, nullptr, &offscreenFramebuffer));
 	}
@@ -552,14 +1246,23 @@ public:
 	}
 
 	void CreateRenderPass() {
+		CreatePresentRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, renderPass);
+
+		// partial redraws keep what the image showed the last time it was presented
+		if (m_settings.damageTracking) {
+			CreatePresentRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, incrementalRenderPass);
+		}
+	}
+
+	void CreatePresentRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkRenderPass& newRenderPass) {
 		VkAttachmentDescription attachmentDescription = {};
 		attachmentDescription.format = surfaceFormat.format;
 		attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-		attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachmentDescription.loadOp = loadOp;
 		attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachmentDescription.initialLayout = initialLayout;
 		attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 		VkAttachmentReference colorAttachmentReference = {};
@@ -578,6 +1281,9 @@ public:
 		subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		subpassDependency.srcAccessMask = 0;
 		subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		if (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+			subpassDependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		}
 
 		VkRenderPassCreateInfo renderPassCreateInfo = {};
 		renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -588,7 +1294,7 @@ public:
 		renderPassCreateInfo.dependencyCount = 1;
 		renderPassCreateInfo.pDependencies = &subpassDependency;
 
-		VkResult res = vkCreateRenderPass(m_vulkanInitializer->device, &renderPassCreateInfo, nullptr, &renderPass);
+		VkResult res = vkCreateRenderPass(m_vulkanInitializer->device, &renderPassCreateInfo, nullptr, &newRenderPass);
 		ASSERT(res, "failed to create render pass");
 	}
 
@@ -628,58 +1334,613 @@ public:
 
 		commandBuffers.resize(swapchainImageCount);
 		ASSERT(vkAllocateCommandBuffers(m_vulkanInitializer->device, &allocInfo, commandBuffers.data()));
-	}
 
-	void CreateGraphicsPipeline(
-		VkShaderModule& vertShaderModule,
-		VkShaderModule& fragShaderModule,
-		VkPipelineLayout& pipelineLayout,
-		VkPipeline& pipeline,
-		VkRenderPass& renderPass,
-		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE) {
-		
+		if (!m_settings.reuseCommandBuffers) {
+			return;
+		}
 
-		// vertex pipeline creation
-		VkPipelineShaderStageCreateInfo pipelineVertShaderStageCreateInfo = {};
-		pipelineVertShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		pipelineVertShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		pipelineVertShaderStageCreateInfo.module = vertShaderModule;
-		pipelineVertShaderStageCreateInfo.pName = "main";
+		allocInfo.commandBufferCount = swapchainImageCount * framesInFlight;
+		recordedCommandBuffers.resize(allocInfo.commandBufferCount);
+		recordedGenerations.assign(allocInfo.commandBufferCount, 0);
+		ASSERT(vkAllocateCommandBuffers(m_vulkanInitializer->device, &allocInfo, recordedCommandBuffers.data()));
 
-		// fragment pipeline creation
-		VkPipelineShaderStageCreateInfo pipelineFragShaderStageCreateInfo = {};
-		pipelineFragShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		pipelineFragShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		pipelineFragShaderStageCreateInfo.module = fragShaderModule;
-		pipelineFragShaderStageCreateInfo.pName = "main";
+		allocInfo.commandBufferCount = framesInFlight;
+		frameCommandBuffers.resize(framesInFlight);
+		ASSERT(vkAllocateCommandBuffers(m_vulkanInitializer->device, &allocInfo, frameCommandBuffers.data()));
+	}
 
-		// creating stages for shaders
-		std::vector<VkPipelineShaderStageCreateInfo> shaderStages{ pipelineVertShaderStageCreateInfo , pipelineFragShaderStageCreateInfo };
+	// every recorded buffer is recorded again before its next submission
+	void InvalidateCommandBuffers() {
+		commandBuffersGeneration++;
+	}
 
-		// vertex input
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	// frame boundary, after the pipeline selection of the frame
+	void TrackCommandBufferInputs() {
+		PresentInputs inputs = {};
+		inputs.renderExtent = renderExtent;
+		inputs.pipeline = pipeline;
+
+		if (inputs.renderExtent.width != recordedPresentInputs.renderExtent.width
+			|| inputs.renderExtent.height != recordedPresentInputs.renderExtent.height
+			|| inputs.pipeline != recordedPresentInputs.pipeline) {
+			recordedPresentInputs = inputs;
+			InvalidateCommandBuffers();
+			damageTracker.AddFull();
+		}
+	}
 
-		VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
-		pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-		pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &bindingDescription;
-		pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+	// normalized device coordinates to pixels of the window, rounded outwards
+	VkRect2D GetWindowRect(glm::vec2 low, glm::vec2 high) const {
+		glm::vec2 size = glm::vec2(extent2D.width, extent2D.height);
+		glm::vec2 topLeft = glm::floor((low * 0.5f + 0.5f) * size);
+		glm::vec2 bottomRight = glm::ceil((high * 0.5f + 0.5f) * size);
 
-		VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
-		pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		pipelineInputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		pipelineInputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+		VkRect2D rect = {};
+		rect.offset = { static_cast<int32_t>(topLeft.x), static_cast<int32_t>(topLeft.y) };
+		rect.extent = { static_cast<uint32_t>(bottomRight.x - topLeft.x), static_cast<uint32_t>(bottomRight.y - topLeft.y) };
+		return rect;
+	}
 
-		// viewport
-		VkViewport viewport = {};
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = extent2D.width;
-		viewport.height = extent2D.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+	// normalized device coordinates of the present quad
+	void GetPresentQuadBounds(glm::vec2& low, glm::vec2& high) const {
+		low = vertices[0].pos.Unpack();
+		high = low;
+		for (const Vertex& vertex : vertices) {
+			low = glm::min(low, vertex.pos.Unpack());
+			high = glm::max(high, vertex.pos.Unpack());
+		}
+	}
+
+	// pixels of the window covered by the present quad, what a new offscreen image changes
+	VkRect2D GetPresentQuadRect() const {
+		glm::vec2 low, high;
+		GetPresentQuadBounds(low, high);
+		return GetWindowRect(low, high);
+	}
+
+	/*
+		pixels of the window the scene objects are shown on, for changes that only reach them.
+		The present quad shows the views side by side, each in its own column of the quad, and
+		its texture coordinates run the rows of the offscreen image up from the bottom of the quad
+	*/
+	VkRect2D GetSceneRect() const {
+		glm::vec2 quadLow, quadHigh;
+		GetPresentQuadBounds(quadLow, quadHigh);
+		glm::vec2 quadSize = quadHigh - quadLow;
+		float columnWidth = quadSize.x / static_cast<float>(viewCount);
+
+		VkRect2D rect = {};
+		for (uint32_t view = 0; view < viewCount; view++) {
+			glm::vec4 transform = GetViewTransform(view);
+			glm::vec2 viewLow = glm::vec2(sceneBounds) * glm::vec2(transform) + glm::vec2(transform.z, transform.w);
+			glm::vec2 viewHigh = glm::vec2(sceneBounds.z, sceneBounds.w) * glm::vec2(transform) + glm::vec2(transform.z, transform.w);
+
+			// 0..1 across the view, the rendered area fills the column whatever the render scale
+			glm::vec2 low = glm::clamp(viewLow * 0.5f + 0.5f, 0.0f, 1.0f);
+			glm::vec2 high = glm::clamp(viewHigh * 0.5f + 0.5f, 0.0f, 1.0f);
+
+			glm::vec2 windowLow = glm::vec2(quadLow.x + columnWidth * (view + low.x), quadHigh.y - quadSize.y * high.y);
+			glm::vec2 windowHigh = glm::vec2(quadLow.x + columnWidth * (view + high.x), quadHigh.y - quadSize.y * low.y);
+
+			// a pixel more on every side, the linear filter reaches into the neighbours
+			VkRect2D viewRect = GetWindowRect(windowLow, windowHigh);
+			viewRect.offset.x -= 1;
+			viewRect.offset.y -= 1;
+			viewRect.extent.width += 2;
+			viewRect.extent.height += 2;
+
+			rect = view == 0 ? viewRect : DamageTracker::Union(rect, viewRect);
+		}
+		return rect;
+	}
+
+	// frame boundary, after the offscreen pass. False when the current image has to be drawn whole
+	bool TakeDamage() {
+		uint64_t imagePixels = static_cast<uint64_t>(extent2D.width) * extent2D.height;
+		presentedPixels += imagePixels;
+
+		if (!m_settings.damageTracking || !damageTracker.Take(swapchainCurrentImageIndex, frameDamage)) {
+			redrawnPixels += imagePixels;
+			return false;
+		}
+
+		redrawnPixels += DamageTracker::Area(frameDamage);
+		return true;
+	}
+
+	// frame boundary, after the uploads of the frame. False when the offscreen image already holds what the pass would draw
+	bool NeedsOffscreenPass() {
+		OffscreenInputs inputs = {};
+		inputs.vertexBuffer = vertexBuffer.buffer;
+		inputs.indexBuffer = indexBuffer.buffer;
+		inputs.pipeline = offscreenPipeline;
+		inputs.cullingPipeline = gpuCulling ? gpuCulling->pipeline : VK_NULL_HANDLE;
+		inputs.clearColor = snapshot.clearColor;
+		inputs.sceneTexture = sceneTexture;
+		inputs.renderExtent = renderExtent;
+		inputs.descriptorWrites = textureStreamer->descriptorWrites;
+
+		bool changed = !offscreenValid
+			|| inputs.vertexBuffer != renderedOffscreenInputs.vertexBuffer
+			|| inputs.indexBuffer != renderedOffscreenInputs.indexBuffer
+			|| inputs.pipeline != renderedOffscreenInputs.pipeline
+			|| inputs.cullingPipeline != renderedOffscreenInputs.cullingPipeline
+			|| inputs.clearColor != renderedOffscreenInputs.clearColor
+			|| inputs.sceneTexture != renderedOffscreenInputs.sceneTexture
+			|| inputs.renderExtent.width != renderedOffscreenInputs.renderExtent.width
+			|| inputs.renderExtent.height != renderedOffscreenInputs.renderExtent.height
+			|| inputs.descriptorWrites != renderedOffscreenInputs.descriptorWrites;
+
+		if (changed) {
+			damageTracker.Add(GetPresentQuadRect());
+		}
+
+		// the lights move every frame, they only show on the scene
+		if (lightCulling && !changed) {
+			changed = true;
+			damageTracker.Add(GetSceneRect());
+		}
+
+		// the particles move every frame and can be anywhere
+		if (particleSystem) {
+			changed = true;
+			damageTracker.AddFull();
+		}
+
+		if (!changed && m_settings.lazyOffscreen) {
+			offscreenPassesSkipped++;
+			return false;
+		}
+
+		renderedOffscreenInputs = inputs;
+		offscreenValid = true;
+		offscreenPassesRendered++;
+
+		return true;
+	}
+
+	// shaders being edited come from disk, the pack would hide the new versions
+	const AssetPack* ShaderPack() const {
+		return m_settings.shaderHotReload ? nullptr : assetPack.get();
+	}
+
+	void CreateOffscreenPipeline(VkPipelineLayout& layout, VkPipeline& newPipeline, const SpecializationConstants& constants) {
+		std::vector<char> vertShaderStorage, fragShaderStorage;
+		const char* vertShaderPath = "../Shaders/vert_offscreen.spv";
+		if (offscreenViewMode == OffscreenViewMode::Multiview) {
+			vertShaderPath = "../Shaders/vert_offscreen_multiview.spv";
+		}
+		else if (offscreenViewMode == OffscreenViewMode::Layered) {
+			vertShaderPath = "../Shaders/vert_offscreen_layered.spv";
+		}
+		ByteSpan vertShaderCode = loadShaderCode(ShaderPack(), vertShaderPath, vertShaderStorage);
+		ByteSpan fragShaderCode = loadShaderCode(ShaderPack(), lightCulling ? "../Shaders/frag_offscreen_lit.spv" : "../Shaders/frag_offscreen.spv", fragShaderStorage);
+
+		VkShaderModule vertShaderModule = createShaderModule(m_vulkanInitializer->device, vertShaderCode);
+		VkShaderModule fragShaderModule = createShaderModule(m_vulkanInitializer->device, fragShaderCode);
+
+		VkPushConstantRange offscreenPushConstantRange = {};
+		offscreenPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		offscreenPushConstantRange.offset = 0;
+		offscreenPushConstantRange.size = sizeof(OffscreenPushConstants);
+
+		// the lit shader reads the lights of the frame from set 1
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { textureStreamer->descriptorSetLayout };
+		if (lightCulling) {
+			descriptorSetLayouts.push_back(lightCulling->descriptorSetLayout);
+		}
+
+		VkSpecializationInfo specializationInfo = constants.GetInfo();
+		CreateGraphicsPipeline(vertShaderModule, fragShaderModule, layout, newPipeline, offscreenRenderpass, descriptorSetLayouts, { offscreenPushConstantRange }, offscreenSamples, &specializationInfo, true);
+	}
+
+	void CreatePresentPipeline(VkPipelineLayout& layout, VkPipeline& newPipeline, const SpecializationConstants& constants) {
+		std::vector<char> vertShaderStorage, fragShaderStorage;
+		ByteSpan vertShaderCode = loadShaderCode(ShaderPack(), "../Shaders/vert.spv", vertShaderStorage);
+		ByteSpan fragShaderCode = loadShaderCode(ShaderPack(), "../Shaders/frag.spv", fragShaderStorage);
+
+		VkShaderModule vertShaderModule = createShaderModule(m_vulkanInitializer->device, vertShaderCode);
+		VkShaderModule fragShaderModule = createShaderModule(m_vulkanInitializer->device, fragShaderCode);
+
+		VkPushConstantRange presentPushConstantRange = {};
+		presentPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		presentPushConstantRange.offset = 0;
+		presentPushConstantRange.size = sizeof(PresentPushConstants);
+
+		VkSpecializationInfo specializationInfo = constants.GetInfo();
+		CreateGraphicsPipeline(vertShaderModule, fragShaderModule, layout, newPipeline, renderPass, { offscreenDescriptorSetLayout }, { presentPushConstantRange }, VK_SAMPLE_COUNT_1_BIT, &specializationInfo);
+	}
+
+	// shared by every pipeline creation, variants of the same shaders compile much faster through it
+	void CreatePipelineCache() {
+		VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+		ASSERT(vkCreatePipelineCache(m_vulkanInitializer->device, &pipelineCacheCreateInfo, nullptr, &pipelineCache), "failed to create pipeline cache.");
+	}
+
+	PipelineKey GetOffscreenPipelineKey() const {
+		PipelineKey key;
+		key.pipelineId = PipelineOffscreen;
+		key.constants.Set(OffscreenConstantTextured, sceneTexture != TextureStreamer::placeholderTexture ? VK_TRUE : VK_FALSE);
+		if (lightCulling) {
+			key.constants.Set(OffscreenConstantTiledLights, m_settings.lights.tiled ? VK_TRUE : VK_FALSE);
+		}
+		return key;
+	}
+
+	PipelineKey GetPresentPipelineKey() const {
+		PipelineKey key;
+		key.pipelineId = PipelinePresent;
+		key.constants.Set(PresentConstantTonemap, m_settings.tonemap ? VK_TRUE : VK_FALSE);
+		key.constants.Set(PresentConstantViewCount, viewCount);
+		return key;
+	}
+
+	// any thread
+	void CreatePipelineVariant(const PipelineKey& key, PipelineVariant& variant) {
+		if (key.pipelineId == PipelineOffscreen) {
+			CreateOffscreenPipeline(variant.layout, variant.pipeline, key.constants);
+		}
+		else {
+			CreatePresentPipeline(variant.layout, variant.pipeline, key.constants);
+		}
+	}
+
+	void DestroyPipelineVariant(const PipelineVariant& variant) {
+		vkDestroyPipeline(m_vulkanInitializer->device, variant.pipeline, nullptr);
+		vkDestroyPipelineLayout(m_vulkanInitializer->device, variant.layout, nullptr);
+	}
+
+	// the pipelines a module draws or dispatches with, empty when the module isn't in use
+	std::vector<VkPipeline*> GetModulePipelines(PipelineId id) {
+		std::vector<VkPipeline*> pipelines;
+		if (id == PipelineCulling && gpuCulling) {
+			pipelines.push_back(&gpuCulling->pipeline);
+		}
+		else if (id == PipelineLightCulling && lightCulling) {
+			pipelines.push_back(&lightCulling->pipeline);
+		}
+		else if (id == PipelineParticleSimulation && particleSystem) {
+			for (VkPipeline& computePipeline : particleSystem->computePipelines) {
+				pipelines.push_back(&computePipeline);
+			}
+		}
+		else if (id == PipelineParticleDraw && particleSystem) {
+			pipelines.push_back(&particleSystem->drawPipeline);
+		}
+		return pipelines;
+	}
+
+	// any thread, new pipelines in the order of GetModulePipelines. The layouts stay with the module
+	std::vector<VkPipeline> CreateModulePipelines(PipelineId id) {
+		std::vector<VkPipeline> pipelines;
+		if (id == PipelineCulling) {
+			pipelines.push_back(gpuCulling->CreatePipeline(ShaderPack()));
+		}
+		else if (id == PipelineLightCulling) {
+			pipelines.push_back(lightCulling->CreatePipeline(ShaderPack()));
+		}
+		else if (id == PipelineParticleSimulation) {
+			auto computePipelines = particleSystem->CreateComputePipelines(ShaderPack());
+			pipelines.assign(computePipelines.begin(), computePipelines.end());
+		}
+		else if (id == PipelineParticleDraw) {
+			pipelines.push_back(particleSystem->CreateDrawPipeline(ShaderPack()));
+		}
+		return pipelines;
+	}
+
+	/*
+		render thread. A variant nobody asked for yet is built by a job and null is returned
+		until UpdatePipelineVariants picks it up, pipeline creation can take longer than a frame
+	*/
+	const PipelineVariant* GetPipelineVariant(const PipelineKey& key) {
+		auto found = pipelineVariants.find(key);
+		if (found != pipelineVariants.end()) {
+			return &found->second;
+		}
+
+		uint64_t generation = requestedPipelines[key.pipelineId];
+		auto pending = pendingVariants.find(key);
+		if (pending != pendingVariants.end() && !(pending->second.failed && pending->second.generation != generation)) {
+			return nullptr;
+		}
+
+		PendingVariant& pendingVariant = pendingVariants[key];
+		pendingVariant.generation = generation;
+		pendingVariant.failed = false;
+
+		jobSystem->Run([this, key] {
+			PipelineVariant variant;
+			try {
+				CreatePipelineVariant(key, variant);
+			}
+			catch (const std::exception& exception) {
+				std::cout << "pipeline variant build failed: " << exception.what() << std::endl;
+				DestroyPipelineVariant(variant);
+				variant = {};
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(rebuiltPipelinesMutex);
+				builtVariants.emplace_back(key, variant);
+			}
+
+			if (onPipelinesChanged) {
+				onPipelinesChanged();
+			}
+		}, &pipelineRebuilds);
+
+		return nullptr;
+	}
+
+	// frame boundary, picks the variants matching the current state, the ones still being built keep the current
+	void SelectPipelineVariants() {
+		const PipelineVariant* offscreenVariant = GetPipelineVariant(GetOffscreenPipelineKey());
+		if (offscreenVariant) {
+			offscreenPipeline = offscreenVariant->pipeline;
+			offscreenPipelineLayout = offscreenVariant->layout;
+		}
+
+		const PipelineVariant* presentVariant = GetPipelineVariant(GetPresentPipelineKey());
+		if (presentVariant) {
+			pipeline = presentVariant->pipeline;
+			pipelineLayout = presentVariant->layout;
+		}
+	}
+
+	void StartShaderHotReload() {
+		shaderHotReload = std::make_unique<ShaderHotReload>(std::vector<ShaderSource>{
+			{ "../Shaders/shader.vert", "../Shaders/vert.spv" },
+			{ "../Shaders/shader.frag", "../Shaders/frag.spv" },
+			{ "../Shaders/shader_offscreen.vert", "../Shaders/vert_offscreen.spv" },
+			{ "../Shaders/shader_offscreen.vert", "../Shaders/vert_offscreen_multiview.spv", "-DMULTIVIEW" },
+			{ "../Shaders/shader_offscreen.vert", "../Shaders/vert_offscreen_layered.spv", "-DLAYERED" },
+			{ "../Shaders/shader_offscreen.frag", "../Shaders/frag_offscreen.spv" },
+			{ "../Shaders/shader_offscreen.frag", "../Shaders/frag_offscreen_lit.spv", "-DLIT" },
+			{ "../Shaders/cull.comp", "../Shaders/cull.spv" },
+			{ "../Shaders/lights.comp", "../Shaders/lights.spv" },
+			{ "../Shaders/particles.comp", "../Shaders/particles.spv" },
+			{ "../Shaders/particle.vert", "../Shaders/vert_particle.spv" },
+			{ "../Shaders/particle.frag", "../Shaders/frag_particle.spv" },
+		}, m_settings.hotReload);
+
+		shaderHotReload->onShaderCompiled = [this](const std::string& spirvPath) {
+			RequestPipelineRebuild(GetShaderPipeline(spirvPath));
+		};
+		shaderHotReload->Start();
+	}
+
+	static PipelineId GetShaderPipeline(const std::string& spirvPath) {
+		if (spirvPath.find("cull.spv") != std::string::npos) {
+			return PipelineCulling;
+		}
+		if (spirvPath.find("lights.spv") != std::string::npos) {
+			return PipelineLightCulling;
+		}
+		if (spirvPath.find("particles.spv") != std::string::npos) {
+			return PipelineParticleSimulation;
+		}
+		if (spirvPath.find("_particle") != std::string::npos) {
+			return PipelineParticleDraw;
+		}
+		return spirvPath.find("_offscreen") != std::string::npos ? PipelineOffscreen : PipelinePresent;
+	}
+
+	// any thread, the render thread starts the rebuild at its next frame
+	void RequestPipelineRebuild(PipelineId id) {
+		requestedPipelines[id]++;
+
+		if (onPipelinesChanged) {
+			onPipelinesChanged();
+		}
+	}
+
+	/*
+		frame boundary. Swaps in the variants rebuilt since the last frame and starts a job
+		rebuilding every variant built so far of the pipelines whose shaders changed. The
+		pipelines of the modules go the same way, swapped in place of the ones the module holds
+	*/
+	void UpdatePipelineVariants() {
+		std::vector<RebuiltVariants> rebuilt;
+		std::vector<std::pair<PipelineKey, PipelineVariant>> built;
+		{
+			std::lock_guard<std::mutex> lock(rebuiltPipelinesMutex);
+			std::swap(rebuilt, rebuiltPipelines);
+			std::swap(built, builtVariants);
+		}
+
+		VkDevice device = m_vulkanInitializer->device;
+		for (RebuiltVariants& candidate : rebuilt) {
+			// an older rebuild finishing late was never used
+			if (candidate.generation <= appliedPipelines[candidate.id]) {
+				for (auto& variant : candidate.variants) {
+					DestroyPipelineVariant(variant.second);
+				}
+				continue;
+			}
+			appliedPipelines[candidate.id] = candidate.generation;
+
+			// every old variant goes, including ones built on demand since the rebuild started.
+			// The frames in flight still draw with them
+			std::vector<PipelineVariant> retired;
+			std::vector<VkPipeline*> modulePipelines = GetModulePipelines(candidate.id);
+			for (size_t i = 0; i < modulePipelines.size(); i++) {
+				retired.push_back({ VK_NULL_HANDLE, *modulePipelines[i] });
+				*modulePipelines[i] = candidate.variants[i].second.pipeline;
+			}
+			for (auto variant = pipelineVariants.begin(); variant != pipelineVariants.end(); ) {
+				if (variant->first.pipelineId == static_cast<uint32_t>(candidate.id)) {
+					retired.push_back(variant->second);
+					variant = pipelineVariants.erase(variant);
+				}
+				else {
+					++variant;
+				}
+			}
+			retiredResources.emplace_back(frameNumber + framesInFlight, [device, retired] {
+				for (const PipelineVariant& variant : retired) {
+					vkDestroyPipeline(device, variant.pipeline, nullptr);
+					vkDestroyPipelineLayout(device, variant.layout, nullptr);
+				}
+			});
+
+			if (modulePipelines.empty()) {
+				for (auto& variant : candidate.variants) {
+					pipelineVariants[variant.first] = variant.second;
+				}
+			}
+			pipelineSwaps++;
+		}
+
+		// variants built on demand, unless a shader compiled while they were built
+		for (auto& variant : built) {
+			PendingVariant& pending = pendingVariants[variant.first];
+			if (variant.second.pipeline == VK_NULL_HANDLE) {
+				pending.failed = true;
+				continue;
+			}
+			if (pending.generation != requestedPipelines[variant.first.pipelineId]) {
+				DestroyPipelineVariant(variant.second);
+				pendingVariants.erase(variant.first);
+				continue;
+			}
+
+			pendingVariants.erase(variant.first);
+			pipelineVariants.emplace(variant.first, variant.second);
+			pipelineVariantsCreated++;
+		}
+
+		for (uint32_t id = 0; id < PipelineCount; id++) {
+			uint64_t requested = requestedPipelines[id];
+			if (requested == launchedPipelines[id]) {
+				continue;
+			}
+			launchedPipelines[id] = requested;
+
+			std::vector<PipelineKey> keys;
+			for (const auto& variant : pipelineVariants) {
+				if (variant.first.pipelineId == id) {
+					keys.push_back(variant.first);
+				}
+			}
+
+			bool isModule = id >= PipelineCulling;
+			if (isModule && GetModulePipelines(static_cast<PipelineId>(id)).empty()) {
+				continue;
+			}
+
+			jobSystem->Run([this, id, requested, keys, isModule] {
+				RebuiltVariants rebuiltVariants;
+				rebuiltVariants.id = static_cast<PipelineId>(id);
+				rebuiltVariants.generation = requested;
+
+				try {
+					for (const PipelineKey& key : keys) {
+						PipelineVariant variant;
+						CreatePipelineVariant(key, variant);
+						rebuiltVariants.variants.emplace_back(key, variant);
+					}
+
+					if (isModule) {
+						PipelineKey key;
+						key.pipelineId = id;
+						for (VkPipeline modulePipeline : CreateModulePipelines(rebuiltVariants.id)) {
+							rebuiltVariants.variants.emplace_back(key, PipelineVariant{ VK_NULL_HANDLE, modulePipeline });
+						}
+					}
+				}
+				catch (const std::exception& exception) {
+					// the running variants stay
+					std::cout << "shader hot reload: pipeline rebuild failed: " << exception.what() << std::endl;
+					for (auto& variant : rebuiltVariants.variants) {
+						DestroyPipelineVariant(variant.second);
+					}
+					return;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(rebuiltPipelinesMutex);
+					rebuiltPipelines.push_back(std::move(rebuiltVariants));
+				}
+
+				if (onPipelinesChanged) {
+					onPipelinesChanged();
+				}
+			}, &pipelineRebuilds);
+		}
+	}
+
+	void ReleaseRetiredResources(uint64_t completedFrames) {
+		while (!retiredResources.empty() && retiredResources.front().first < completedFrames) {
+			retiredResources.front().second();
+			retiredResources.pop_front();
+		}
+	}
+
+	void CreateGraphicsPipeline(
+		VkShaderModule& vertShaderModule,
+		VkShaderModule& fragShaderModule,
+		VkPipelineLayout& pipelineLayout,
+		VkPipeline& pipeline,
+		VkRenderPass& renderPass,
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts = {},
+		std::vector<VkPushConstantRange> pushConstantRanges = {},
+		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+		const VkSpecializationInfo* specializationInfo = nullptr,
+		bool objectInstances = false) {
+		
+
+		// vertex pipeline creation
+		VkPipelineShaderStageCreateInfo pipelineVertShaderStageCreateInfo = {};
+		pipelineVertShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineVertShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		pipelineVertShaderStageCreateInfo.module = vertShaderModule;
+		pipelineVertShaderStageCreateInfo.pName = "main";
+		pipelineVertShaderStageCreateInfo.pSpecializationInfo = specializationInfo;
+
+		// fragment pipeline creation
+		VkPipelineShaderStageCreateInfo pipelineFragShaderStageCreateInfo = {};
+		pipelineFragShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineFragShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		pipelineFragShaderStageCreateInfo.module = fragShaderModule;
+		pipelineFragShaderStageCreateInfo.pName = "main";
+		pipelineFragShaderStageCreateInfo.pSpecializationInfo = specializationInfo;
+
+		// creating stages for shaders
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages{ pipelineVertShaderStageCreateInfo , pipelineFragShaderStageCreateInfo };
+
+		// vertex input, the scene objects add their transform per instance
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions = { VertexInputLayout::GetBindingDescription() };
+		auto vertexAttributeDescriptions = VertexInputLayout::GetAttributeDescriptions();
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributeDescriptions.begin(), vertexAttributeDescriptions.end());
+		if (objectInstances) {
+			auto instanceAttributeDescriptions = ObjectInstanceLayout::GetAttributeDescriptions();
+			bindingDescriptions.push_back(ObjectInstanceLayout::GetBindingDescription());
+			attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+		}
+
+		VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
+		pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+		pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+		pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+		VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
+		pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		pipelineInputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		pipelineInputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+		// viewport
+		VkViewport viewport = {};
+		viewport.x = 0;
+		viewport.y = 0;
+		viewport.width = extent2D.width;
+		viewport.height = extent2D.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
 
 		// scissor
 		VkRect2D rect2D = {};
@@ -694,6 +1955,14 @@ public:
 		pipelineViewportStateCreateInfo.scissorCount = 1;
 		pipelineViewportStateCreateInfo.pScissors = &rect2D;
 
+		// viewport and scissor are set while recording since the render area can change every frame
+		std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo = {};
+		pipelineDynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		pipelineDynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		pipelineDynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
+
 		// rasterizer
 		VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {};
 		pipelineRasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -710,7 +1979,7 @@ public:
 		VkPipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {};
 		pipelineMultisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 		pipelineMultisampleStateCreateInfo.pNext = nullptr;
-		pipelineMultisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		pipelineMultisampleStateCreateInfo.rasterizationSamples = rasterizationSamples;
 		pipelineMultisampleStateCreateInfo.sampleShadingEnable = VK_FALSE;
 
 		// color blend stuff
@@ -735,14 +2004,10 @@ public:
 		// pipeline layout
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
 		pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		if (descriptorSetLayout) {
-			pipelineLayoutCreateInfo.setLayoutCount = 1;
-			pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
-		}
-		else {
-			pipelineLayoutCreateInfo.setLayoutCount = 0;
-			pipelineLayoutCreateInfo.pSetLayouts = nullptr;
-		}
+		pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+		pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
+		pipelineLayoutCreateInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+		pipelineLayoutCreateInfo.pPushConstantRanges = pushConstantRanges.data();
 
 		ASSERT(vkCreatePipelineLayout(m_vulkanInitializer->device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout), "failed to create pipeline layout.");
 
@@ -757,10 +2022,11 @@ public:
 		graphicsPipelineCreateInfo.pRasterizationState = &pipelineRasterizationStateCreateInfo;
 		graphicsPipelineCreateInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
 		graphicsPipelineCreateInfo.pColorBlendState = &pipelineColorBlendStateCreateInfo;
+		graphicsPipelineCreateInfo.pDynamicState = &pipelineDynamicStateCreateInfo;
 		graphicsPipelineCreateInfo.layout = pipelineLayout;
 		graphicsPipelineCreateInfo.renderPass = renderPass;
 
-		ASSERT(vkCreateGraphicsPipelines(m_vulkanInitializer->device, nullptr, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline), "failed to create graphics pipeline.");
+		ASSERT(vkCreateGraphicsPipelines(m_vulkanInitializer->device, pipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline), "failed to create graphics pipeline.");
 
 		vkDestroyShaderModule(m_vulkanInitializer->device, vertShaderModule, nullptr);
 		vkDestroyShaderModule(m_vulkanInitializer->device, fragShaderModule, nullptr);
@@ -768,9 +2034,10 @@ public:
 
 	void CreateSynchObjects() {
 		// each of those objects will be retrieved per frame
-		swapchainProcessImageSemaphores.resize(swapchainImageCount);
-		swapchainReadyToPresentSemaphores.resize(swapchainImageCount);
-		swapchainFrameFance.resize(swapchainImageCount);
+		swapchainProcessImageSemaphores.resize(framesInFlight);
+		swapchainReadyToPresentSemaphores.resize(framesInFlight);
+		swapchainFrameFance.resize(framesInFlight);
+		imagesInFlight.resize(swapchainImageCount, VK_NULL_HANDLE);
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -779,51 +2046,15 @@ public:
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for (int i = 0; i < swapchainImageCount; i++) {
+		for (uint32_t i = 0; i < framesInFlight; i++) {
 			ASSERT(vkCreateSemaphore(m_vulkanInitializer->device, &semaphoreInfo, nullptr, &swapchainProcessImageSemaphores[i]), "error creating semaphore");
 			ASSERT(vkCreateSemaphore(m_vulkanInitializer->device, &semaphoreInfo, nullptr, &swapchainReadyToPresentSemaphores[i]), "error creating semaphore");
 			ASSERT(vkCreateFence(m_vulkanInitializer->device, &fenceInfo, nullptr, &swapchainFrameFance[i]), "error creating fence");
 		}
 	}
 
-	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(m_vulkanInitializer->physicalDevice, &memProperties);
-
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
-			}
-		}
-
-		throw std::runtime_error("failed to find suitable memory type!");
-	}
-
-	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-		VkBufferCreateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = size;
-		bufferInfo.usage = usage;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		bufferInfo.queueFamilyIndexCount = m_vulkanInitializer->getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT);
-
-		ASSERT(vkCreateBuffer(m_vulkanInitializer->device, &bufferInfo, nullptr, &buffer), "failed to create vertex buffer.");
-
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(m_vulkanInitializer->device, buffer, &memRequirements);
-
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-		ASSERT(vkAllocateMemory(m_vulkanInitializer->device, &allocInfo, nullptr, &bufferMemory), "failed to allocate vertex buffer memory!");
-
-		vkBindBufferMemory(m_vulkanInitializer->device, buffer, bufferMemory, 0);
-	}
-
 	void CreateVertexBuffer() {
-		CreateBuffer(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexBuffer.buffer, vertexBuffer.bufferMemory);
+		m_vulkanInitializer->CreateBuffer(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexBuffer.buffer, vertexBuffer.bufferMemory);
 
 		void* data;
 		vkMapMemory(m_vulkanInitializer->device, vertexBuffer.bufferMemory, 0, sizeof(vertices[0]) * vertices.size(), 0, &data);
@@ -832,7 +2063,7 @@ public:
 	}
 
 	void CreateIndexBuffer() {
-		CreateBuffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indexBuffer.buffer, indexBuffer.bufferMemory);
+		m_vulkanInitializer->CreateBuffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indexBuffer.buffer, indexBuffer.bufferMemory);
 
 		void* data;
 		vkMapMemory(m_vulkanInitializer->device, indexBuffer.bufferMemory, 0, sizeof(indices[0]) * indices.size(), 0, &data);
@@ -840,6 +2071,25 @@ public:
 		vkUnmapMemory(m_vulkanInitializer->device, indexBuffer.bufferMemory);
 	}
 
+	// the transform of every object repeated for each of its instances, in object order
+	void CreateObjectInstanceBuffer() {
+		std::vector<ObjectInstance> instances;
+		instances.reserve(sceneObjects.size() * instancesPerObject);
+		for (const CullObject& object : sceneObjects) {
+			for (uint32_t i = 0; i < instancesPerObject; i++) {
+				instances.push_back({ object.transform });
+			}
+		}
+
+		VkDeviceSize size = sizeof(ObjectInstance) * instances.size();
+		m_vulkanInitializer->CreateBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, objectInstanceBuffer.buffer, objectInstanceBuffer.bufferMemory);
+
+		void* data;
+		vkMapMemory(m_vulkanInitializer->device, objectInstanceBuffer.bufferMemory, 0, size, 0, &data);
+		memcpy(data, instances.data(), (size_t)size);
+		vkUnmapMemory(m_vulkanInitializer->device, objectInstanceBuffer.bufferMemory);
+	}
+
 	void ChangeLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
 		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
 		BeginOneTimeCommandBuffer(m_vulkanInitializer->device, commandPool, commandBuffer);
@@ -890,82 +2140,193 @@ public:
 		EndOneTimeCommandBuffer(m_vulkanInitializer->device, m_vulkanInitializer->queue, commandPool, commandBuffer);
 	}
 
+	void GenerateOffscreenMips(VkCommandBuffer commandBuffer) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = offscreenTextureImage;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = viewCount;
+
+		// the lower levels are fully overwritten, the previous frame content can be discarded
+		barrier.subresourceRange.baseMipLevel = 1;
+		barrier.subresourceRange.levelCount = offscreenMipLevels - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		// only the rendered area is downsampled, the UV scale of the presentation stays valid on every level
+		int32_t mipWidth = static_cast<int32_t>(renderExtent.width);
+		int32_t mipHeight = static_cast<int32_t>(renderExtent.height);
+
+		for (uint32_t i = 1; i < offscreenMipLevels; i++) {
+			int32_t nextWidth = std::max(mipWidth / 2, 1);
+			int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+			VkImageBlit blit{};
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = i - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = viewCount;
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = i;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = viewCount;
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+
+			vkCmdBlitImage(
+				commandBuffer,
+				offscreenTextureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				offscreenTextureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit,
+				VK_FILTER_LINEAR);
+
+			// the level just written is the source of the next blit
+			barrier.subresourceRange.baseMipLevel = i;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			mipWidth = nextWidth;
+			mipHeight = nextHeight;
+		}
+
+		// whole chain ready to be sampled by the presentation pass
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = offscreenMipLevels;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	void Draw(const FrameSnapshot& frameSnapshot) {
+		snapshot = frameSnapshot;
+		Draw();
+	}
+
 	void Draw() {
+		// the sync objects of this frame are free once its previous submission is done
+		vkWaitForFences(m_vulkanInitializer->device, 1, &swapchainFrameFance[currentFrame], VK_TRUE, UINT64_MAX);
+
+		uint64_t completedFrames = frameNumber + 1 >= framesInFlight ? frameNumber + 1 - framesInFlight : 0;
+		ReleaseRetiredResources(completedFrames);
+		// the texture evictions of this frame go by it
+		m_vulkanInitializer->UpdateMemoryBudget();
+		UpdatePipelineVariants();
+		SelectPipelineVariants();
+
 		// Startint the draw
 		ASSERT(vkAcquireNextImageKHR(m_vulkanInitializer->device, swapchain, UINT64_MAX, swapchainProcessImageSemaphores[currentFrame], VK_NULL_HANDLE, &swapchainCurrentImageIndex));
 
-		vkWaitForFences(m_vulkanInitializer->device, 1, &swapchainFrameFance[currentFrame], VK_TRUE, UINT16_MAX);
+		// the command buffer of the image might still be used by another frame
+		if (imagesInFlight[swapchainCurrentImageIndex] != VK_NULL_HANDLE) {
+			vkWaitForFences(m_vulkanInitializer->device, 1, &imagesInFlight[swapchainCurrentImageIndex], VK_TRUE, UINT64_MAX);
+		}
+		imagesInFlight[swapchainCurrentImageIndex] = swapchainFrameFance[currentFrame];
+
 		vkResetFences(m_vulkanInitializer->device, 1, &swapchainFrameFance[currentFrame]);
 
-		// start to write on command buffer
-		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		commandBufferBeginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-		ASSERT(vkBeginCommandBuffer(commandBuffers[swapchainCurrentImageIndex], &commandBufferBeginInfo), "couldn't start commandBuffer");
+		// previous submission of this command buffer is done, its timings are ready
+		gpuProfiler->CollectResults(swapchainCurrentImageIndex);
+		if (passStatistics) {
+			passStatistics->CollectResults(swapchainCurrentImageIndex);
+		}
 
-		/*
-			First renderPass: rendering scene into a texture
-		*/
-		{
-			VkClearValue clearColor = { 1.0f, 0.0f, 0.0f, 1.0f };
+		// new render scale applies to the frame being recorded
+		dynamicResolution.Update(gpuProfiler->GetScopeMilliseconds(GpuScopeFrame));
+		renderExtent = dynamicResolution.GetRenderExtent(extent2D);
 
-			VkRenderPassBeginInfo renderPassBeginInfo = {};
-			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBeginInfo.renderPass = offscreenRenderpass;
-			renderPassBeginInfo.framebuffer = offscreenFramebuffer;
-			renderPassBeginInfo.renderArea.extent.width = extent2D.width;
-			renderPassBeginInfo.renderArea.extent.height = extent2D.height;
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = &clearColor;
+		// a new present pipeline or render extent redraws the whole window
+		TrackCommandBufferInputs();
 
-			vkCmdBeginRenderPass(commandBuffers[swapchainCurrentImageIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// the presented image shows the scene texture even while the offscreen pass is skipped
+		textureStreamer->Touch(sceneTexture, frameNumber);
 
-			vkCmdBindPipeline(commandBuffers[swapchainCurrentImageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline);
-			VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers(commandBuffers[swapchainCurrentImageIndex], 0, 1, &vertexBuffer.buffer, &offset);
-			vkCmdBindIndexBuffer(commandBuffers[swapchainCurrentImageIndex], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		bool partialRedraw = false;
+		VkCommandBuffer submitted[2] = {};
+		uint32_t submittedCount = 0;
+		if (m_settings.reuseCommandBuffers) {
+			// uploads and the offscreen pass change from frame to frame, they get their own buffer
+			VkCommandBuffer frameCommandBuffer = frameCommandBuffers[currentFrame];
+			BeginCommandBuffer(frameCommandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+			gpuProfiler->BeginFrame(frameCommandBuffer, swapchainCurrentImageIndex);
+			if (passStatistics) {
+				passStatistics->BeginFrame(frameCommandBuffer, swapchainCurrentImageIndex);
+			}
+			gpuProfiler->BeginScope(frameCommandBuffer, swapchainCurrentImageIndex, GpuScopeFrame);
+
+			textureStreamer->Update(frameCommandBuffer, currentFrame, frameNumber, completedFrames);
+			if (NeedsOffscreenPass()) {
+				RecordOffscreenPass(frameCommandBuffer, swapchainCurrentImageIndex, currentFrame);
+			}
+
+			// only a whole image is worth a recorded buffer, the damaged parts differ every frame
+			partialRedraw = TakeDamage();
+			if (partialRedraw) {
+				RecordPresentPass(frameCommandBuffer, swapchainCurrentImageIndex, &frameDamage);
+				gpuProfiler->EndScope(frameCommandBuffer, swapchainCurrentImageIndex, GpuScopeFrame);
+			}
 
-			vkCmdDrawIndexed(commandBuffers[swapchainCurrentImageIndex], indices.size(), 1, 0, 0, 0);
-			//vkCmdDraw(commandBuffers[swapchainCurrentImageIndex], 3, 1, 0, 0);
+			ASSERT(vkEndCommandBuffer(frameCommandBuffer), "couldn't end commandBuffer");
+			submitted[submittedCount++] = frameCommandBuffer;
 
-			vkCmdEndRenderPass(commandBuffers[swapchainCurrentImageIndex]);
+			if (!partialRedraw) {
+				uint32_t recordedIndex = swapchainCurrentImageIndex * framesInFlight + currentFrame;
+				VkCommandBuffer recordedCommandBuffer = recordedCommandBuffers[recordedIndex];
+				if (recordedGenerations[recordedIndex] != commandBuffersGeneration) {
+					BeginCommandBuffer(recordedCommandBuffer, 0);
+					RecordPresentPass(recordedCommandBuffer, swapchainCurrentImageIndex);
+					gpuProfiler->EndScope(recordedCommandBuffer, swapchainCurrentImageIndex, GpuScopeFrame);
+					ASSERT(vkEndCommandBuffer(recordedCommandBuffer), "couldn't end commandBuffer");
+
+					recordedGenerations[recordedIndex] = commandBuffersGeneration;
+					commandBuffersRecorded++;
+				}
+
+				submitted[submittedCount++] = recordedCommandBuffer;
+			}
 		}
+		else {
+			VkCommandBuffer commandBuffer = commandBuffers[swapchainCurrentImageIndex];
+			BeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
+			gpuProfiler->BeginFrame(commandBuffer, swapchainCurrentImageIndex);
+			if (passStatistics) {
+				passStatistics->BeginFrame(commandBuffer, swapchainCurrentImageIndex);
+			}
+			gpuProfiler->BeginScope(commandBuffer, swapchainCurrentImageIndex, GpuScopeFrame);
 
-		/*
-			Second renderPass: rendering texture in main screen
-		*/
-		{
-			VkClearValue clearColor = { 0.0f, 1.0f, 0.0f, 1.0f };
+			// texture uploads of this frame, ahead of the passes sampling them
+			textureStreamer->Update(commandBuffer, currentFrame, frameNumber, completedFrames);
 
-			VkRenderPassBeginInfo renderPassBeginInfo = {};
-			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBeginInfo.renderPass = renderPass;
-			renderPassBeginInfo.framebuffer = frameBuffers[swapchainCurrentImageIndex];
-			renderPassBeginInfo.renderArea.extent.width = extent2D.width;
-			renderPassBeginInfo.renderArea.extent.height = extent2D.height;
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = &clearColor;
+			if (NeedsOffscreenPass()) {
+				RecordOffscreenPass(commandBuffer, swapchainCurrentImageIndex, currentFrame);
+			}
 
-			vkCmdBeginRenderPass(commandBuffers[swapchainCurrentImageIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			partialRedraw = TakeDamage();
+			RecordPresentPass(commandBuffer, swapchainCurrentImageIndex, partialRedraw ? &frameDamage : nullptr);
 
-			vkCmdBindPipeline(commandBuffers[swapchainCurrentImageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-			vkCmdBindDescriptorSets(
-				commandBuffers[swapchainCurrentImageIndex],
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				pipelineLayout,
-				0,
-				1,
-				&offscreenDescriptorSet,
-				0,
-				nullptr);
-			//vkCmdDraw(commandBuffers[swapchainCurrentImageIndex], 3, 1, 0, 0);
-			vkCmdDrawIndexed(commandBuffers[swapchainCurrentImageIndex], 6, 1, 0, 0, 0);
+			gpuProfiler->EndScope(commandBuffer, swapchainCurrentImageIndex, GpuScopeFrame);
 
-			vkCmdEndRenderPass(commandBuffers[swapchainCurrentImageIndex]);
-		}
+			ASSERT(vkEndCommandBuffer(commandBuffer), "couldn't end commandBuffer");
+			commandBuffersRecorded++;
 
-		ASSERT(vkEndCommandBuffer(commandBuffers[swapchainCurrentImageIndex]), "couldn't end commandBuffer");
+			submitted[submittedCount++] = commandBuffer;
+		}
 
 		// finish and send to presentation queue
 		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -975,8 +2336,8 @@ public:
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = &swapchainProcessImageSemaphores[currentFrame];
 		submitInfo.pWaitDstStageMask = &wait_stage;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[swapchainCurrentImageIndex];
+		submitInfo.commandBufferCount = submittedCount;
+		submitInfo.pCommandBuffers = submitted;
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = &swapchainReadyToPresentSemaphores[currentFrame];
 
@@ -990,22 +2351,398 @@ public:
 		presentInfoKHR.swapchainCount = 1;
 		presentInfoKHR.pSwapchains = &swapchain;
 		presentInfoKHR.pImageIndices = &swapchainCurrentImageIndex;
+
+		// the compositor only has to pick up the redrawn parts
+		std::vector<VkRectLayerKHR> presentRectangles;
+		VkPresentRegionKHR presentRegion = {};
+		VkPresentRegionsKHR presentRegions = {};
+		if (incrementalPresent && partialRedraw) {
+			for (const VkRect2D& rect : frameDamage) {
+				presentRectangles.push_back({ rect.offset, rect.extent, 0 });
+			}
+			// no rectangle at all would mean the whole image changed
+			if (presentRectangles.empty()) {
+				presentRectangles.push_back({ { 0, 0 }, { 1, 1 }, 0 });
+			}
+
+			presentRegion.rectangleCount = static_cast<uint32_t>(presentRectangles.size());
+			presentRegion.pRectangles = presentRectangles.data();
+
+			presentRegions.sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+			presentRegions.swapchainCount = 1;
+			presentRegions.pRegions = &presentRegion;
+
+			presentInfoKHR.pNext = &presentRegions;
+		}
+
 		ASSERT(vkQueuePresentKHR(m_vulkanInitializer->queue, &presentInfoKHR), "failed to send to present queue.");
 
-		currentFrame = (currentFrame + 1) % swapchainImageCount;
+		// submitted after the present so it never delays the frame, only the main view in layer 0 is captured
+		if (frameCapture) {
+			frameCapture->Capture(m_vulkanInitializer->queue, offscreenTextureImage, renderExtent, frameNumber);
+		}
+
+		currentFrame = (currentFrame + 1) % framesInFlight;
+		frameNumber++;
+
+		if (m_settings.printStats) {
+			ReportStats();
+		}
+	}
+
+	void BeginCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags flags) {
+		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		commandBufferBeginInfo.flags = flags;
+		ASSERT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo), "couldn't start commandBuffer");
+	}
+
+	/*
+		First renderPass: rendering scene into a texture. Leaves the image in SHADER_READ_ONLY like a
+		skipped pass does, so the present pass samples it the same way either way
+	*/
+	void RecordOffscreenPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t frameIndex) {
+		// compute passes feeding the offscreen pass are timed on their own, its scope only gets the draws
+		if (particleSystem) {
+			gpuProfiler->BeginScope(commandBuffer, imageIndex, GpuScopeParticles);
+			particleSystem->RecordSimulation(commandBuffer, frameIndex);
+			gpuProfiler->EndScope(commandBuffer, imageIndex, GpuScopeParticles);
+		}
+
+		// the light tiles are read by the fragments of the pass, built with the first camera
+		if (lightCulling) {
+			gpuProfiler->BeginScope(commandBuffer, imageIndex, GpuScopeLights);
+			lightCulling->RecordCulling(commandBuffer, frameIndex, GetViewTransform(0), renderExtent);
+			gpuProfiler->EndScope(commandBuffer, imageIndex, GpuScopeLights);
+		}
+
+		gpuProfiler->BeginScope(commandBuffer, imageIndex, GpuScopeOffscreen);
+
+		VkClearValue clearColor = { snapshot.clearColor.r, snapshot.clearColor.g, snapshot.clearColor.b, snapshot.clearColor.a };
+
+		OffscreenPushConstants offscreenPushConstants = {};
+		for (uint32_t view = 0; view < viewCount; view++) {
+			offscreenPushConstants.views[view] = GetViewTransform(view);
+		}
+		offscreenPushConstants.textureIndex = sceneTexture;
+		offscreenPushConstants.viewCount = viewCount;
+		offscreenPushConstants.tileCountX = LightCulling::GetTileCount(renderExtent.width);
+		offscreenPushConstants.lightCount = lightCulling ? lightCulling->GetLightCount() : 0;
+
+		// the draws of this pass come out of the culling, it has to run before the render pass starts
+		if (gpuCulling) {
+			gpuCulling->RecordCulling(commandBuffer, frameIndex, offscreenPushConstants.views, viewCount);
+		}
+
+		VkRenderPassBeginInfo renderPassBeginInfo = {};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = offscreenRenderpass;
+		renderPassBeginInfo.framebuffer = offscreenFramebuffer;
+		renderPassBeginInfo.renderArea.extent.width = renderExtent.width;
+		renderPassBeginInfo.renderArea.extent.height = renderExtent.height;
+		renderPassBeginInfo.clearValueCount = 1;
+		renderPassBeginInfo.pClearValues = &clearColor;
+
+		// every view covers the render area in its own layer
+		if (passStatistics) {
+			uint64_t pixels = static_cast<uint64_t>(renderExtent.width) * renderExtent.height * viewCount;
+			passStatistics->BeginPass(commandBuffer, imageIndex, RenderPassQueryOffscreen, pixels, offscreenSamples);
+		}
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		SetViewportAndScissor(commandBuffer, renderExtent);
+
+		VkDescriptorSet textureSet = textureStreamer->GetDescriptorSet(frameIndex);
+
+		// push constants belong to the layout, they stay valid across the pipeline binds of the queue
+		vkCmdPushConstants(commandBuffer, offscreenPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(OffscreenPushConstants), &offscreenPushConstants);
+
+		// same for set 1, the binds of set 0 below leave it alone
+		if (lightCulling) {
+			VkDescriptorSet lightSet = lightCulling->GetDescriptorSet(frameIndex);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipelineLayout, 1, 1, &lightSet, 0, nullptr);
+		}
+
+		if (gpuCulling) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipelineLayout, 0, 1, &textureSet, 0, nullptr);
+
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, &offset);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+			gpuCulling->RecordDraws(commandBuffer, frameIndex, ObjectInstanceLayout::binding);
+		}
+		else {
+			// one draw per visible object, the recording cost grows with the scene. The layered path
+			// draws every object once per view, multiview repeats it on its own
+			gridResults.clear();
+			sceneGrid.Query(GetVisibleSceneRect(offscreenPushConstants.views), gridResults);
+
+			// the grid query covers every view at once, the exact test drops what no single view sees
+			drawQueue.Clear();
+			for (uint32_t i : gridResults) {
+				const CullObject& object = sceneObjects[i];
+				if (!CullObject::IsVisible(object, offscreenPushConstants.views, viewCount)) {
+					continue;
+				}
+
+				DrawItem item;
+				item.pipeline = offscreenPipeline;
+				item.layout = offscreenPipelineLayout;
+				item.descriptorSet = textureSet;
+				item.vertexBuffer = vertexBuffer.buffer;
+				item.instanceBuffer = objectInstanceBuffer.buffer;
+				item.indexBuffer = indexBuffer.buffer;
+				item.indexCount = object.indexCount;
+				item.instanceCount = instancesPerObject;
+				item.firstIndex = object.firstIndex;
+				item.vertexOffset = object.vertexOffset;
+				item.firstInstance = i * instancesPerObject;
+
+				drawQueue.Submit(DrawQueue::MakeKey(0, PipelineOffscreen, frameIndex, sceneTexture, i), item);
+			}
+
+			drawQueue.Sort();
+			drawQueue.Replay(commandBuffer);
+			cpuDrawnObjects = drawQueue.stats.drawCalls;
+		}
+
+		// over the scene, blended
+		if (particleSystem) {
+			particleSystem->RecordDraw(commandBuffer, offscreenPushConstants.views[0]);
+		}
+		//vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		if (passStatistics) {
+			passStatistics->EndPass(commandBuffer, imageIndex, RenderPassQueryOffscreen);
+		}
+
+		if (offscreenMipLevels > 1) {
+			GenerateOffscreenMips(commandBuffer);
+		}
+
+		gpuProfiler->EndScope(commandBuffer, imageIndex, GpuScopeOffscreen);
 	}
 
-	// Auxiliary functions
-	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(m_vulkanInitializer->physicalDevice, &memProperties);
+	/*
+		Second renderPass: rendering texture in main screen. With damage only those rectangles are
+		cleared and drawn over what the image already shows, no damage at all records nothing
+	*/
+	void RecordPresentPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, const std::vector<VkRect2D>* damage = nullptr) {
+		gpuProfiler->BeginScope(commandBuffer, imageIndex, GpuScopePresent);
+
+		if (damage && damage->empty()) {
+			gpuProfiler->EndScope(commandBuffer, imageIndex, GpuScopePresent);
+			return;
+		}
 
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
+		VkClearValue clearColor = { 0.0f, 1.0f, 0.0f, 1.0f };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = {};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = frameBuffers[imageIndex];
+		renderPassBeginInfo.renderArea.extent.width = extent2D.width;
+		renderPassBeginInfo.renderArea.extent.height = extent2D.height;
+		renderPassBeginInfo.clearValueCount = 1;
+		renderPassBeginInfo.pClearValues = &clearColor;
+
+		if (damage) {
+			VkRect2D bounds = (*damage)[0];
+			for (const VkRect2D& rect : *damage) {
+				bounds = DamageTracker::Union(bounds, rect);
 			}
+
+			renderPassBeginInfo.renderPass = incrementalRenderPass;
+			renderPassBeginInfo.renderArea = bounds;
+			renderPassBeginInfo.clearValueCount = 0;
+			renderPassBeginInfo.pClearValues = nullptr;
+		}
+
+		// relative to the whole window, a partial redraw shades less than a fragment per pixel
+		if (passStatistics) {
+			uint64_t pixels = static_cast<uint64_t>(extent2D.width) * extent2D.height;
+			passStatistics->BeginPass(commandBuffer, imageIndex, RenderPassQueryPresent, pixels, VK_SAMPLE_COUNT_1_BIT);
 		}
 
-		throw std::runtime_error("failed to find suitable memory type!");
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		SetViewportAndScissor(commandBuffer, extent2D);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			pipelineLayout,
+			0,
+			1,
+			&offscreenDescriptorSet,
+			0,
+			nullptr);
+
+		// the offscreen pass that used to bind them may be skipped or in another command buffer
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+		// only the render area of the offscreen image holds the scene
+		PresentPushConstants pushConstants = {};
+		pushConstants.uvScale = glm::vec2(
+			renderExtent.width / static_cast<float>(offscreenExtent.width),
+			renderExtent.height / static_cast<float>(offscreenExtent.height));
+		pushConstants.renderExtent = glm::vec2(renderExtent.width, renderExtent.height);
+
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PresentPushConstants), &pushConstants);
+
+		if (damage) {
+			// the load op keeps everything, the background of the damaged parts is cleared by hand
+			VkClearAttachment clearAttachment = {};
+			clearAttachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			clearAttachment.colorAttachment = 0;
+			clearAttachment.clearValue = clearColor;
+
+			std::vector<VkClearRect> clearRects;
+			for (const VkRect2D& rect : *damage) {
+				clearRects.push_back({ rect, 0, 1 });
+			}
+			vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, static_cast<uint32_t>(clearRects.size()), clearRects.data());
+
+			for (const VkRect2D& rect : *damage) {
+				vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+				vkCmdDrawIndexed(commandBuffer, 6, 1, 0, 0, 0);
+			}
+		}
+		else {
+			//vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, 6, 1, 0, 0, 0);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		if (passStatistics) {
+			passStatistics->EndPass(commandBuffer, imageIndex, RenderPassQueryPresent);
+		}
+
+		gpuProfiler->EndScope(commandBuffer, imageIndex, GpuScopePresent);
+	}
+
+	void SetViewportAndScissor(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+		VkViewport viewport = {};
+		viewport.x = 0;
+		viewport.y = 0;
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.offset = VkOffset2D{ 0, 0 };
+		scissor.extent = extent;
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	// what the last collected frame did in a render pass, per pixel numbers are over its render area
+	void ReportPassCounters(const char* pass, const PassCounters& counters) {
+		std::cout << " | " << pass << " pass:";
+		if (passStatistics->HasStatistics()) {
+			std::cout << " " << counters.inputPrimitives << " primitives (" << counters.ClippedPrimitives() << " clipped), "
+				<< counters.vertexInvocations << " vertex, " << counters.fragmentInvocations << " fragment invocations"
+				<< ", overdraw " << counters.Overdraw();
+		}
+		if (passStatistics->HasOcclusion()) {
+			std::cout << (passStatistics->HasStatistics() ? ", " : " ") << counters.samplesPassed << " samples passed";
+		}
+		if (passStatistics->HasStatistics() && passStatistics->HasOcclusion()) {
+			std::cout << ", " << 100.0 * counters.WastedFragments() << "% of the fragments wasted";
+		}
+	}
+
+	void ReportStats() {
+		statsFrameCount++;
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsedSeconds = std::chrono::duration<double>(now - statsStart).count();
+		if (elapsedSeconds < 1.0) {
+			return;
+		}
+
+		std::cout << "fps: " << statsFrameCount / elapsedSeconds
+			<< " | gpu frame: " << gpuProfiler->GetScopeMilliseconds(GpuScopeFrame) << " ms"
+			<< " (offscreen " << gpuProfiler->GetScopeMilliseconds(GpuScopeOffscreen) << " ms"
+			<< ", present " << gpuProfiler->GetScopeMilliseconds(GpuScopePresent) << " ms)"
+			<< " | present: " << PresentModeName(presentationMode) << ", " << framesInFlight << " in flight"
+			<< " | render scale: " << dynamicResolution.scale
+			<< " (" << renderExtent.width << "x" << renderExtent.height << ")"
+			<< " | command buffers recorded: " << commandBuffersRecorded
+			<< " | offscreen passes: " << offscreenPassesRendered << " rendered, " << offscreenPassesSkipped << " skipped"
+			<< " | objects drawn: " << (gpuCulling ? gpuCulling->visibleObjects : cpuDrawnObjects) << " of " << sceneObjects.size()
+			<< (gpuCulling ? std::string(", gpu culled, ") + GpuCulling::DrawModeName(gpuCulling->drawMode) : std::string(", cpu culled"));
+
+		if (!gpuCulling) {
+			std::cout << " | draw queue: " << drawQueue.stats.drawCalls << " draws, " << drawQueue.stats.binds << " binds, "
+				<< drawQueue.stats.bindsSaved << " saved";
+		}
+
+		if (passStatistics && (passStatistics->HasStatistics() || passStatistics->HasOcclusion())) {
+			ReportPassCounters("offscreen", passStatistics->GetPassCounters(RenderPassQueryOffscreen));
+			ReportPassCounters("present", passStatistics->GetPassCounters(RenderPassQueryPresent));
+		}
+
+		if (particleSystem) {
+			std::cout << " | particles: " << particleSystem->aliveParticles << " of " << particleSystem->capacity
+				<< ", simulated in " << gpuProfiler->GetScopeMilliseconds(GpuScopeParticles) << " ms";
+		}
+
+		if (lightCulling) {
+			std::cout << " | lights: " << lightCulling->GetLightCount();
+			if (m_settings.lights.tiled) {
+				std::cout << ", tiled in " << gpuProfiler->GetScopeMilliseconds(GpuScopeLights) << " ms";
+			}
+			else {
+				std::cout << ", untiled";
+			}
+		}
+
+		if (m_settings.damageTracking) {
+			std::cout << " | redrawn: " << (presentedPixels ? 100.0 * redrawnPixels / presentedPixels : 0.0) << "% of the pixels"
+				<< (incrementalPresent ? ", incremental present" : "");
+		}
+
+		if (textureStreamer->textures.size() > 1) {
+			std::cout << " | textures: " << textureStreamer->CountTextures(TextureStreamer::TextureResident) << "/" << textureStreamer->textures.size() - 1 << " resident"
+				<< ", " << textureStreamer->uploadedBytes / (1024 * 1024) << " MiB uploaded"
+				<< ", " << textureStreamer->SavedBytes() / (1024 * 1024) << " MiB saved by compression"
+				<< ", " << textureStreamer->evictedTextures << " evicted (" << textureStreamer->evictedBytes / (1024 * 1024) << " MiB)";
+		}
+
+		std::cout << " | memory" << (m_vulkanInitializer->IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) ? "" : " (estimated)") << ":";
+		for (uint32_t heap = 0; heap < m_vulkanInitializer->memoryProperties.memoryHeapCount; heap++) {
+			VulkanInitializer::HeapBudget heapBudget = m_vulkanInitializer->GetHeapBudget(heap);
+			bool deviceLocal = (m_vulkanInitializer->memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+			std::cout << (heap ? ", " : " ") << "heap " << heap << (deviceLocal ? " (device) " : " (host) ")
+				<< heapBudget.usage / (1024 * 1024) << "/" << heapBudget.budget / (1024 * 1024) << " MiB";
+		}
+
+		if (shaderHotReload) {
+			std::cout << " | shader reloads: " << shaderHotReload->compiledShaders << " compiled, " << shaderHotReload->failedCompiles << " failed, "
+				<< pipelineSwaps << " pipelines swapped";
+		}
+
+		std::cout << " | pipeline variants: " << pipelineVariants.size() << " (" << pipelineVariantsCreated << " built on demand)";
+
+		if (frameCapture) {
+			std::cout << " | capture: " << frameCapture->writtenFrames << " written, " << frameCapture->droppedFrames << " dropped";
+		}
+
+		std::cout << std::endl;
+
+		statsStart = now;
+		statsFrameCount = 0;
 	}
 };
@@ -1,13 +1,22 @@
 #include "VulkanInitializer.h"
 
-VulkanInitializer::VulkanInitializer(SDL_Window* window)
+VulkanInitializer::VulkanInitializer(SDL_Window* window, ValidationLevel validation)
 {
+	validationLevel = validation;
+	validationLayer = validationLevel != ValidationLevel::Off;
+
+	// has to exist before the instance, its creation is already reported to the callback
+	if (validationLayer) {
+		debugLog = std::make_unique<DebugLog>();
+	}
+
 	CreateInstance(window);
 	CreateValidationLayer();
 	CreateSurface(window);
 	SelectPhysicalDevice();
 	CreateLogicalDevice();
 	SelectQueue();
+	UpdateMemoryBudget();
 }
 
 VulkanInitializer::~VulkanInitializer()
@@ -15,16 +24,21 @@ VulkanInitializer::~VulkanInitializer()
 	vkDeviceWaitIdle(device);
 
 	// destroy validation layer
-	PFN_vkDestroyDebugUtilsMessengerEXT pfnDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-		instance, "vkDestroyDebugUtilsMessengerEXT");
+	if (cb != VK_NULL_HANDLE) {
+		PFN_vkDestroyDebugUtilsMessengerEXT pfnDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+			instance, "vkDestroyDebugUtilsMessengerEXT");
 
-	pfnDestroyDebugUtilsMessengerEXT(instance, cb, nullptr);
+		pfnDestroyDebugUtilsMessengerEXT(instance, cb, nullptr);
+	}
 
 	vkDestroyDevice(device, nullptr);
 
 	vkDestroySurfaceKHR(instance, surface, nullptr);
 
 	vkDestroyInstance(instance, nullptr);
+
+	// flushes the remaining messages
+	debugLog.reset();
 }
 
 void VulkanInitializer::CreateInstance(SDL_Window* window)
@@ -49,24 +63,20 @@ void VulkanInitializer::CreateInstance(SDL_Window* window)
 	applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	applicationInfo.pEngineName = "Game Engine";
 	applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	applicationInfo.apiVersion = VK_API_VERSION_1_0;
+	// 1.1 for multiview and the features2 queries
+	applicationInfo.apiVersion = VK_API_VERSION_1_1;
 
 	VkInstanceCreateInfo instancecCreateInfo{};
 	instancecCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instancecCreateInfo.flags = 0;
 	instancecCreateInfo.pApplicationInfo = &applicationInfo;
 
+	VkDebugUtilsMessengerCreateInfoEXT callback = {};
 	if (validationLayer) {
 		instancecCreateInfo.enabledLayerCount = static_cast<uint32_t>(instanceLayers.size());
 		instancecCreateInfo.ppEnabledLayerNames = instanceLayers.data();
 
-		VkDebugUtilsMessengerCreateInfoEXT callback = {};
-		callback = {};
-		callback.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		callback.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		callback.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-		callback.pfnUserCallback = debugCallback;
-		callback.pUserData = nullptr;
+		callback = GetDebugMessengerCreateInfo();
 		instancecCreateInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&callback;
 	}
 	else {
@@ -80,14 +90,25 @@ void VulkanInitializer::CreateInstance(SDL_Window* window)
 	ASSERT(vkCreateInstance(&instancecCreateInfo, nullptr, &instance), "failed to create Vulkan instance.");
 }
 
-void VulkanInitializer::CreateValidationLayer()
+VkDebugUtilsMessengerCreateInfoEXT VulkanInitializer::GetDebugMessengerCreateInfo()
 {
 	VkDebugUtilsMessengerCreateInfoEXT callback = {};
 	callback.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-	callback.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	callback.messageSeverity = ValidationLevelSeverities(validationLevel);
 	callback.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
 	callback.pfnUserCallback = debugCallback;
-	callback.pUserData = nullptr;
+	callback.pUserData = debugLog.get();
+
+	return callback;
+}
+
+void VulkanInitializer::CreateValidationLayer()
+{
+	if (!validationLayer) {
+		return;
+	}
+
+	VkDebugUtilsMessengerCreateInfoEXT callback = GetDebugMessengerCreateInfo();
 
 	PFN_vkCreateDebugUtilsMessengerEXT pfnCreateDebugUtilsMessengerEXT = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
 		instance, "vkCreateDebugUtilsMessengerEXT");
@@ -160,6 +181,11 @@ void VulkanInitializer::SelectPhysicalDevice()
 	}
 
 	physicalDevice = availablePhysicalDevices[rank.idx];
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	heapBudgets.resize(memoryProperties.memoryHeapCount);
+	allocatedBytes.resize(memoryProperties.memoryHeapCount, 0);
+	allocatedAtBudgetUpdate.resize(memoryProperties.memoryHeapCount, 0);
 }
 
 void VulkanInitializer::CreateLogicalDevice()
@@ -178,7 +204,11 @@ void VulkanInitializer::CreateLogicalDevice()
 	// indexing feature for dynamically create array of textures for shader
 	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
 	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
-	indexingFeatures.pNext = nullptr;
+	indexingFeatures.pNext = &multiviewFeatures;
+
+	// one render pass drawing into several layers, used by the offscreen views
+	multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+	multiviewFeatures.pNext = nullptr;
 
 	// enabling sampler anisotropy
 	VkPhysicalDeviceFeatures deviceFeatures{};
@@ -190,6 +220,7 @@ void VulkanInitializer::CreateLogicalDevice()
 	physical_features2.features = deviceFeatures;
 
 	vkGetPhysicalDeviceFeatures2(physicalDevice, &physical_features2);
+	enabledFeatures = physical_features2.features;
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -197,12 +228,41 @@ void VulkanInitializer::CreateLogicalDevice()
 	deviceCreateInfo.flags = 0;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(deviceQueueCreateInfos.size());
 	deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos.data();
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+	// optional extensions the device has are enabled next to the required ones
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	std::vector<const char*> extensions = deviceExtensions;
+	for (const char* optionalExtension : optionalDeviceExtensions) {
+		for (const auto& availableExtension : availableExtensions) {
+			if (std::string(availableExtension.extensionName) == optionalExtension) {
+				extensions.push_back(optionalExtension);
+				break;
+			}
+		}
+	}
+	enabledDeviceExtensions.assign(extensions.begin(), extensions.end());
+
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
 	ASSERT(vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device), "failed to create logical device");
 }
 
+bool VulkanInitializer::IsDeviceExtensionEnabled(const char* name) const
+{
+	for (const std::string& extension : enabledDeviceExtensions) {
+		if (extension == name) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 uint32_t VulkanInitializer::getQueueFamilyIndex(VkQueueFlagBits queueFlagBits)
 {
 	uint32_t pQueueFamilyPropertyCount = 0;
@@ -224,3 +284,140 @@ void VulkanInitializer::SelectQueue()
 	// not accepting arguments on purpose. Always using graphics queue
 	vkGetDeviceQueue(device, getQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT), 0, &queue);
 }
+
+uint32_t VulkanInitializer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size)
+{
+	uint32_t memoryType = TryFindMemoryType(typeFilter, properties, size);
+	if (memoryType == UINT32_MAX) {
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	return memoryType;
+}
+
+// UINT32_MAX when no type has the properties. A type whose heap still has room for size wins over
+// the ones before it, when every heap is full the first type is taken anyway and the driver may page
+uint32_t VulkanInitializer::TryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size)
+{
+	uint32_t firstMatch = UINT32_MAX;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) == 0 || (memoryProperties.memoryTypes[i].propertyFlags & properties) != properties) {
+			continue;
+		}
+
+		HeapBudget heap = GetHeapBudget(memoryProperties.memoryTypes[i].heapIndex);
+		if (heap.usage + size <= heap.budget) {
+			return i;
+		}
+
+		if (firstMatch == UINT32_MAX) {
+			firstMatch = i;
+		}
+	}
+
+	return firstMatch;
+}
+
+VkResult VulkanInitializer::AllocateMemory(const VkMemoryAllocateInfo* allocateInfo, VkDeviceMemory* memory)
+{
+	VkResult result = vkAllocateMemory(device, allocateInfo, nullptr, memory);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	uint32_t heap = memoryProperties.memoryTypes[allocateInfo->memoryTypeIndex].heapIndex;
+	allocations[*memory] = { heap, allocateInfo->allocationSize };
+	allocatedBytes[heap] += allocateInfo->allocationSize;
+
+	return result;
+}
+
+void VulkanInitializer::FreeMemory(VkDeviceMemory memory)
+{
+	auto allocation = allocations.find(memory);
+	if (allocation != allocations.end()) {
+		allocatedBytes[allocation->second.heap] -= allocation->second.size;
+		allocations.erase(allocation);
+	}
+
+	vkFreeMemory(device, memory, nullptr);
+}
+
+void VulkanInitializer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	ASSERT(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer), "failed to create buffer.");
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties, memRequirements.size);
+
+	ASSERT(AllocateMemory(&allocInfo, &memory), "failed to allocate buffer memory!");
+	ASSERT(vkBindBufferMemory(device, buffer, memory, 0));
+}
+
+void VulkanInitializer::DestroyBuffer(VkBuffer buffer, VkDeviceMemory memory)
+{
+	vkDestroyBuffer(device, buffer, nullptr);
+	FreeMemory(memory);
+}
+
+// the driver numbers are only current right after the query, once a frame is enough
+void VulkanInitializer::UpdateMemoryBudget()
+{
+	if (IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {};
+		memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memoryProperties2.pNext = &budgetProperties;
+
+		vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties2);
+
+		for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+			heapBudgets[heap].budget = budgetProperties.heapBudget[heap];
+			heapBudgets[heap].usage = budgetProperties.heapUsage[heap];
+		}
+	}
+	else {
+		// only what this process allocated, other processes and the driver are what the estimate leaves out
+		for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+			heapBudgets[heap].budget = memoryProperties.memoryHeaps[heap].size * estimatedBudgetPercent / 100;
+			heapBudgets[heap].usage = allocatedBytes[heap];
+		}
+	}
+
+	allocatedAtBudgetUpdate = allocatedBytes;
+}
+
+VulkanInitializer::HeapBudget VulkanInitializer::GetHeapBudget(uint32_t heap) const
+{
+	HeapBudget heapBudget = heapBudgets[heap];
+
+	// allocations since the update, the frees are subtracted without going below 0
+	if (allocatedBytes[heap] >= allocatedAtBudgetUpdate[heap]) {
+		heapBudget.usage += allocatedBytes[heap] - allocatedAtBudgetUpdate[heap];
+	}
+	else {
+		heapBudget.usage -= std::min(heapBudget.usage, allocatedAtBudgetUpdate[heap] - allocatedBytes[heap]);
+	}
+
+	return heapBudget;
+}
+
+// heap UINT32_MAX for memory not allocated through AllocateMemory
+VulkanInitializer::Allocation VulkanInitializer::GetAllocation(VkDeviceMemory memory) const
+{
+	auto allocation = allocations.find(memory);
+	return allocation != allocations.end() ? allocation->second : Allocation{ UINT32_MAX, 0 };
+}
@@ -4,25 +4,38 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 #include <vector>
+#include <algorithm>
 #include <array>
+#include <memory>
+#include <unordered_map>
 
 #include "SDL.h"
 #include "SDL_vulkan.h"
 #include "vulkan/vulkan.h"
 
-// function for handling validation layer
+#include "DebugLog.h"
+
+// function for handling validation layer. Runs on driver threads, so it only queues the message
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 	VkDebugUtilsMessageTypeFlagsEXT messageTypes,
 	const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 	void* pUserData) {
 
-	std::cout << pCallbackData->pMessage << std::endl;
+	DebugLog* debugLog = static_cast<DebugLog*>(pUserData);
+	debugLog->Push(messageSeverity, pCallbackData->messageIdNumber, pCallbackData->pMessage);
 
 	return VK_FALSE;
 }
 
+#ifdef NDEBUG
+static const ValidationLevel defaultValidationLevel = ValidationLevel::Off;
+#else
+static const ValidationLevel defaultValidationLevel = ValidationLevel::Warnings;
+#endif
+
 static void ASSERT(VkResult result, const char* message = nullptr)
 {
 	if (result != VK_SUCCESS) {
@@ -40,7 +53,7 @@ static void ASSERT(uint32_t result, const char* message = nullptr)
 class VulkanInitializer
 {
 public:
-	VulkanInitializer(SDL_Window *window);
+	VulkanInitializer(SDL_Window *window, ValidationLevel validation = defaultValidationLevel);
 	~VulkanInitializer();
 
 	VkInstance instance = VK_NULL_HANDLE;
@@ -50,7 +63,9 @@ public:
 	VkQueue queue = VK_NULL_HANDLE;
 
 	// enable validation layers
+	ValidationLevel validationLevel = defaultValidationLevel;
 	bool validationLayer = true;
+	std::unique_ptr<DebugLog> debugLog;
 
 	std::vector<const char*> instanceLayers = {
 		"VK_LAYER_KHRONOS_validation" // validation layer
@@ -69,12 +84,60 @@ public:
 		//VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME  // add the array texture feature in the frag shader
 	};
 
+	// enabled only when the device has them, features check IsDeviceExtensionEnabled before using them
+	std::vector<const char*> optionalDeviceExtensions = {
+		VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME, // damaged regions handed to the compositor
+		VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME, // gl_Layer from the vertex shader, layered views without multiview
+		VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, // draw count written by the GPU culling pass
+		VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, // heap budgets and usage of the whole process from the driver
+	};
+	std::vector<std::string> enabledDeviceExtensions = {};
+
+	// features the device reported, every supported one is enabled
+	VkPhysicalDeviceFeatures enabledFeatures = {};
+	VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {};
+
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+	// what a heap lets the process use and what it uses, as of the last UpdateMemoryBudget
+	struct HeapBudget {
+		VkDeviceSize budget = 0;
+		VkDeviceSize usage = 0;
+	};
+	std::vector<HeapBudget> heapBudgets = {};
+	// without VK_EXT_memory_budget a heap is assumed to be this full when the process has this share of it
+	static const VkDeviceSize estimatedBudgetPercent = 80;
+
+	// bytes allocated through AllocateMemory per heap, now and at the last budget update, so the
+	// usage includes what changed since. Render thread only
+	std::vector<VkDeviceSize> allocatedBytes = {};
+	std::vector<VkDeviceSize> allocatedAtBudgetUpdate = {};
+	struct Allocation {
+		uint32_t heap = 0;
+		VkDeviceSize size = 0;
+	};
+	std::unordered_map<VkDeviceMemory, Allocation> allocations;
+
 	// functions
 	void CreateInstance(SDL_Window* window);
 	void CreateValidationLayer();
+	VkDebugUtilsMessengerCreateInfoEXT GetDebugMessengerCreateInfo();
 	void CreateSurface(SDL_Window* window);
 	void SelectPhysicalDevice();
 	void CreateLogicalDevice();
+	bool IsDeviceExtensionEnabled(const char* name) const;
+
+	// memory of the device, allocations have to go through AllocateMemory and FreeMemory to be counted
+	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size = 0);
+	uint32_t TryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size = 0);
+	VkResult AllocateMemory(const VkMemoryAllocateInfo* allocateInfo, VkDeviceMemory* memory);
+	void FreeMemory(VkDeviceMemory memory);
+	// a buffer bound to an allocation of its own
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
+	void DestroyBuffer(VkBuffer buffer, VkDeviceMemory memory);
+	void UpdateMemoryBudget();
+	HeapBudget GetHeapBudget(uint32_t heap) const;
+	Allocation GetAllocation(VkDeviceMemory memory) const;
 	uint32_t getQueueFamilyIndex(VkQueueFlagBits queueFlagBits);
 	void SelectQueue();
 };
@@ -1,9 +1,169 @@
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 #include "SDL.h"
 
 #include "ViewportToTexture.cpp"
+#include "Benchmark.h"
 
 int main(int argc, char* argv[]) {
+	// example options from command line
+	ViewportToTextureSettings settings = {};
+	FramePacerSettings pacerSettings = {};
+	SimulationSettings simulationSettings = {};
+	std::string benchmarkName = "";
+	std::string buildPackPath = "";
+	ValidationLevel validationLevel = defaultValidationLevel;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+
+		if (argument == "--offscreen-mips") {
+			settings.generateOffscreenMips = true;
+		}
+		else if (argument == "--dynamic-resolution") {
+			settings.dynamicResolution.enabled = true;
+		}
+		else if (argument == "--target-frame-ms" && i + 1 < argc) {
+			settings.dynamicResolution.targetFrameMs = std::stof(argv[++i]);
+		}
+		else if (argument == "--min-scale" && i + 1 < argc) {
+			settings.dynamicResolution.minScale = std::stof(argv[++i]);
+		}
+		else if (argument == "--max-scale" && i + 1 < argc) {
+			settings.dynamicResolution.maxScale = std::stof(argv[++i]);
+		}
+		else if (argument == "--stats") {
+			settings.printStats = true;
+		}
+		else if (argument == "--msaa" && i + 1 < argc) {
+			settings.offscreenSampleCount = static_cast<VkSampleCountFlagBits>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--capture" && i + 1 < argc) {
+			settings.capture.enabled = true;
+			settings.capture.outputPath = argv[++i];
+		}
+		else if (argument == "--capture-depth" && i + 1 < argc) {
+			settings.capture.queueDepth = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--validation" && i + 1 < argc) {
+			if (!ParseValidationLevel(argv[++i], validationLevel)) {
+				std::cout << "unknown validation level: " << argv[i] << std::endl;
+			}
+		}
+		else if (argument == "--present" && i + 1 < argc) {
+			if (!ParsePresentPolicy(argv[++i], settings.presentPolicy)) {
+				std::cout << "unknown present policy: " << argv[i] << std::endl;
+			}
+		}
+		else if (argument == "--fps" && i + 1 < argc) {
+			pacerSettings.targetFps = std::stof(argv[++i]);
+		}
+		else if (argument == "--frames-in-flight" && i + 1 < argc) {
+			settings.maxFramesInFlight = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--tick-rate" && i + 1 < argc) {
+			simulationSettings.ticksPerSecond = std::stof(argv[++i]);
+		}
+		else if (argument == "--workers" && i + 1 < argc) {
+			settings.workerThreads = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--texture" && i + 1 < argc) {
+			settings.texturePaths.push_back(argv[++i]);
+		}
+		else if (argument == "--upload-budget-kb" && i + 1 < argc) {
+			settings.textureStreaming.uploadBudgetBytes = static_cast<VkDeviceSize>(std::stoi(argv[++i])) * 1024;
+		}
+		else if (argument == "--pack" && i + 1 < argc) {
+			settings.assetPackPath = argv[++i];
+		}
+		else if (argument == "--build-pack" && i + 1 < argc) {
+			buildPackPath = argv[++i];
+		}
+		else if (argument == "--tonemap") {
+			settings.tonemap = true;
+		}
+		else if (argument == "--hot-reload") {
+			settings.shaderHotReload = true;
+		}
+		else if (argument == "--glslc" && i + 1 < argc) {
+			settings.hotReload.compilerPath = argv[++i];
+		}
+		else if (argument == "--reuse-command-buffers") {
+			settings.reuseCommandBuffers = true;
+		}
+		else if (argument == "--lazy-offscreen") {
+			settings.lazyOffscreen = true;
+		}
+		else if (argument == "--damage") {
+			settings.damageTracking = true;
+		}
+		else if (argument == "--views" && i + 1 < argc) {
+			settings.viewCount = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--objects" && i + 1 < argc) {
+			settings.sceneObjects = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--gpu-culling") {
+			settings.gpuCulling = true;
+		}
+		else if (argument == "--particles" && i + 1 < argc) {
+			settings.particles.capacity = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--particle-lifetime" && i + 1 < argc) {
+			settings.particles.lifetime = std::stof(argv[++i]);
+		}
+		else if (argument == "--lights" && i + 1 < argc) {
+			settings.lights.lightCount = static_cast<uint32_t>(std::stoi(argv[++i]));
+		}
+		else if (argument == "--untiled-lights") {
+			settings.lights.tiled = false;
+		}
+		else if (argument == "--pass-statistics") {
+			settings.passStatistics = true;
+		}
+		else if (argument == "--idle") {
+			pacerSettings.idleWhenUnchanged = true;
+		}
+		else if (argument == "--benchmark" && i + 1 < argc) {
+			benchmarkName = argv[++i];
+		}
+	}
+
+	// saving power means not drawing the same frame again
+	if (settings.presentPolicy == PresentPolicy::PowerSaver) {
+		pacerSettings.idleWhenUnchanged = true;
+	}
+
+	// packs the shaders and the given textures, named by the paths they are loaded from
+	if (!buildPackPath.empty()) {
+		std::vector<std::string> assets = {
+			"../Shaders/vert.spv",
+			"../Shaders/frag.spv",
+			"../Shaders/vert_offscreen.spv",
+			"../Shaders/vert_offscreen_multiview.spv",
+			"../Shaders/vert_offscreen_layered.spv",
+			"../Shaders/frag_offscreen.spv",
+			"../Shaders/frag_offscreen_lit.spv",
+			"../Shaders/cull.spv",
+			"../Shaders/particles.spv",
+			"../Shaders/vert_particle.spv",
+			"../Shaders/frag_particle.spv",
+			"../Shaders/lights.spv",
+		};
+		assets.insert(assets.end(), settings.texturePaths.begin(), settings.texturePaths.end());
+
+		if (!AssetPack::Write(buildPackPath, assets)) {
+			return 1;
+		}
+
+		std::cout << "asset pack: wrote " << assets.size() << " assets to " << buildPackPath << std::endl;
+
+		return 0;
+	}
+
 	// setting up SDL
 	SDL_Window *window = nullptr;
 
@@ -28,27 +188,102 @@ int main(int argc, char* argv[]) {
 		throw std::runtime_error("failed to create SDL window");
 	}
 
-	VulkanInitializer vulkanInitializer = VulkanInitializer(window);
+	VulkanInitializer vulkanInitializer = VulkanInitializer(window, validationLevel);
+
+	// benchmarks run their own configurations and exit
+	if (!benchmarkName.empty()) {
+		if (!RunBenchmark(benchmarkName, window, &vulkanInitializer, settings)) {
+			std::cout << "unknown benchmark: " << benchmarkName << std::endl;
+		}
+
+		SDL_Quit();
+
+		return 0;
+	}
+
+	// declared before the example, whose callbacks can still reach it while it is destroyed
+	FramePacer framePacer(pacerSettings);
 
 	// choose the example you want to be executed
-	auto exampleCode = ViewportToTexture(window, &vulkanInitializer);
+	auto exampleCode = ViewportToTexture(window, &vulkanInitializer, settings);
 
-	// main loop
-	SDL_Event eventInfo;
-	bool isApplicationRunning = true;
+	simulationSettings.printStats = settings.printStats;
+	Simulation simulation(simulationSettings);
+	simulation.onSceneChanged = [&framePacer] { framePacer.RequestRedraw(); };
+	exampleCode.onPipelinesChanged = [&framePacer] { framePacer.RequestRedraw(); };
 
-	while (isApplicationRunning) {
-		while (SDL_PollEvent(&eventInfo)) {
-			switch (eventInfo.type) {
-			case SDL_QUIT:
-				isApplicationRunning = false;
+	std::atomic<bool> isApplicationRunning = { true };
+
+	// render thread: draws the latest snapshot, the example is only touched from here
+	std::thread renderThread([&] {
+		uint64_t drawnGeneration = 0;
+		uint64_t lastInputSequence = 0;
+
+		while (isApplicationRunning) {
+			simulation.snapshots.Update();
+			const FrameSnapshot& snapshot = simulation.snapshots.ReadBuffer();
+
+			if (snapshot.inputSequence != lastInputSequence) {
+				lastInputSequence = snapshot.inputSequence;
+				framePacer.RecordInput(snapshot.inputTime);
+			}
+
+			if (settings.printStats) {
+				framePacer.ReportStats();
 			}
+
+			// nothing changed, sleep until the simulation or the window asks for a frame
+			if (pacerSettings.idleWhenUnchanged && snapshot.sceneGeneration == drawnGeneration && !framePacer.WaitForRedraw()) {
+				continue;
+			}
+
+			framePacer.WaitForNextFrame();
+			exampleCode.Draw(snapshot);
+			framePacer.FramePresented(exampleCode.gpuProfiler->GetScopeMilliseconds(ViewportToTexture::GpuScopeFrame));
+
+			drawnGeneration = snapshot.sceneGeneration;
 		}
+	});
 
-		exampleCode.Draw();
+	simulation.Start();
+
+	// main thread only pumps events, SDL wants them on the thread that created the window
+	SDL_Event eventInfo;
+	while (isApplicationRunning) {
+		if (!SDL_WaitEventTimeout(&eventInfo, pacerSettings.idleTimeoutMs)) {
+			continue;
+		}
+
+		SimulationInput input = {};
+		input.time = std::chrono::steady_clock::now();
+
+		switch (eventInfo.type) {
+		case SDL_QUIT:
+			isApplicationRunning = false;
+			break;
+		case SDL_KEYDOWN:
+			if (eventInfo.key.keysym.sym == SDLK_SPACE) {
+				input.type = SimulationInput::ToggleAnimation;
+			}
+			// fall through
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEMOTION:
+		case SDL_MOUSEWHEEL:
+			simulation.PushInput(input);
+			framePacer.RequestRedraw();
+			break;
+		case SDL_WINDOWEVENT:
+			framePacer.RequestRedraw();
+			break;
+		}
 	}
 
+	// a sleeping render thread has to notice the shutdown
+	framePacer.RequestRedraw();
+	renderThread.join();
+	simulation.Stop();
+
 	SDL_Quit();
 
 	return 0;
-}
\ No newline at end of file
+}